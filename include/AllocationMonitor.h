@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_ALLOCATIONMONITOR
+#define HDE_UTILS_ALLOCATIONMONITOR
+
+#include <cstddef>
+
+namespace hde {
+    namespace utils {
+        class AllocationMonitor;
+        std::size_t getNumberOfHeapAllocations();
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Counts the heap allocations performed by the calling thread between begin() and end().
+ *
+ * The counter is active only when the project is built with the
+ * HDE_CHECK_STEADY_STATE_ALLOCATIONS option, which replaces the malloc family of glibc: the
+ * allocations of operator new, of Eigen and of the C library are all counted. Otherwise all
+ * the methods are no-ops and count() always returns zero.
+ */
+class hde::utils::AllocationMonitor
+{
+private:
+    std::size_t m_allocationsAtBegin = 0;
+    std::size_t m_count = 0;
+
+public:
+    static constexpr bool isEnabled()
+    {
+#ifdef HDE_CHECK_STEADY_STATE_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void begin()
+    {
+        if (isEnabled()) {
+            m_allocationsAtBegin = getNumberOfHeapAllocations();
+        }
+    }
+
+    void end()
+    {
+        if (isEnabled()) {
+            m_count += getNumberOfHeapAllocations() - m_allocationsAtBegin;
+        }
+    }
+
+    void reset() { m_count = 0; }
+    std::size_t count() const { return m_count; }
+};
+
+#endif // HDE_UTILS_ALLOCATIONMONITOR
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_BINARYFILE
+#define HDE_UTILS_BINARYFILE
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hde {
+    namespace utils {
+        class MappedFile;
+        class BinaryReader;
+        class BinaryWriter;
+    } // namespace utils
+} // namespace hde
+
+namespace hde {
+    namespace utils {
+        // 64 bit FNV-1a hash. Pass the previous result as seed to hash more buffers.
+        inline std::uint64_t
+        hash(const void* data, const std::size_t size, const std::uint64_t seed = 14695981039346656037ull)
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            std::uint64_t result = seed;
+
+            for (std::size_t i = 0; i < size; ++i) {
+                result ^= bytes[i];
+                result *= 1099511628211ull;
+            }
+
+            return result;
+        }
+
+        inline std::uint64_t hash(const std::string& data, const std::uint64_t seed = 14695981039346656037ull)
+        {
+            return hash(data.data(), data.size(), seed);
+        }
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Read-only memory mapping of a whole file, released in the destructor.
+ */
+class hde::utils::MappedFile
+{
+private:
+    void* m_data = nullptr;
+    std::size_t m_size = 0;
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& fileName)
+    {
+        close();
+
+        const int descriptor = ::open(fileName.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return false;
+        }
+
+        struct stat status;
+        if (::fstat(descriptor, &status) != 0 || status.st_size <= 0) {
+            ::close(descriptor);
+            return false;
+        }
+
+        void* mapping = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+        ::close(descriptor);
+
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+
+        m_data = mapping;
+        m_size = static_cast<std::size_t>(status.st_size);
+        return true;
+    }
+
+    void close()
+    {
+        if (m_data) {
+            ::munmap(m_data, m_size);
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* data() const { return static_cast<const char*>(m_data); }
+    std::size_t size() const { return m_size; }
+};
+
+/**
+ * Sequential reader of a binary buffer in native byte order. Every read checks the bounds
+ * and fails without side effects on the buffer position if the data is not enough.
+ */
+class hde::utils::BinaryReader
+{
+private:
+    const char* m_data;
+    std::size_t m_size;
+    std::size_t m_position = 0;
+
+public:
+    BinaryReader(const char* data, const std::size_t size)
+        : m_data(data)
+        , m_size(size)
+    {}
+
+    bool read(void* destination, const std::size_t size)
+    {
+        if (size > m_size - m_position) {
+            return false;
+        }
+        std::memcpy(destination, m_data + m_position, size);
+        m_position += size;
+        return true;
+    }
+
+    template <typename T>
+    bool read(T& value)
+    {
+        return read(&value, sizeof(T));
+    }
+
+    bool readString(std::string& value, const std::uint32_t maxLength = 4096)
+    {
+        std::uint32_t length = 0;
+        if (!read(length) || length > maxLength || length > m_size - m_position) {
+            return false;
+        }
+        value.assign(m_data + m_position, length);
+        m_position += length;
+        return true;
+    }
+
+    std::size_t remaining() const { return m_size - m_position; }
+    bool atEnd() const { return m_position == m_size; }
+};
+
+/**
+ * Writer of a binary file in native byte order. The data goes to a temporary file that
+ * replaces the destination in commit(), so that readers never see a partial file.
+ */
+class hde::utils::BinaryWriter
+{
+private:
+    std::string m_fileName;
+    std::string m_temporaryFileName;
+    std::ofstream m_file;
+
+public:
+    explicit BinaryWriter(const std::string& fileName)
+        : m_fileName(fileName)
+        , m_temporaryFileName(fileName + ".tmp")
+        , m_file(m_temporaryFileName, std::ios::binary | std::ios::trunc)
+    {}
+
+    ~BinaryWriter()
+    {
+        // Not committed
+        if (m_file.is_open()) {
+            m_file.close();
+            std::remove(m_temporaryFileName.c_str());
+        }
+    }
+
+    bool isOpen() const { return m_file.is_open(); }
+
+    void write(const void* data, const std::size_t size)
+    {
+        m_file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+
+    template <typename T>
+    void write(const T& value)
+    {
+        write(&value, sizeof(T));
+    }
+
+    void writeString(const std::string& value)
+    {
+        write(static_cast<std::uint32_t>(value.size()));
+        write(value.data(), value.size());
+    }
+
+    bool commit()
+    {
+        m_file.close();
+        if (!m_file || std::rename(m_temporaryFileName.c_str(), m_fileName.c_str()) != 0) {
+            std::remove(m_temporaryFileName.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif // HDE_UTILS_BINARYFILE
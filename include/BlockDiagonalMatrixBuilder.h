@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_BLOCKDIAGONALMATRIXBUILDER
+#define HDE_UTILS_BLOCKDIAGONALMATRIXBUILDER
+
+#include <Eigen/SparseCore>
+
+#include <algorithm>
+#include <vector>
+
+namespace hde {
+    namespace utils {
+        class BlockDiagonalMatrixBuilder;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Builder of square block-diagonal sparse matrices, such as the covariance of the stacked
+ * sensors measurements.
+ *
+ * The blocks are appended in increasing offset order and written directly in compressed
+ * sparse column form, without intermediate triplets or sorting: building costs linear time
+ * in the number of non zeros. Each block is either diagonal or dense and symmetric.
+ * Columns not covered by any block are left empty. reset() must be called before reusing
+ * the builder after build().
+ */
+class hde::utils::BlockDiagonalMatrixBuilder
+{
+public:
+    using SparseMatrix = Eigen::SparseMatrix<double, Eigen::ColMajor>;
+    using StorageIndex = SparseMatrix::StorageIndex;
+
+private:
+    Eigen::Index m_size = 0;
+    Eigen::Index m_nextColumn = 0;
+    Eigen::Index m_numberOfEmptyColumns = 0;
+    std::vector<StorageIndex> m_outerIndices;
+    std::vector<StorageIndex> m_innerIndices;
+    std::vector<double> m_values;
+
+    bool beginBlock(const Eigen::Index offset, const Eigen::Index blockSize)
+    {
+        if (offset < m_nextColumn || blockSize <= 0 || offset + blockSize > m_size) {
+            return false;
+        }
+
+        skipColumnsUntil(offset);
+        return true;
+    }
+
+    void skipColumnsUntil(const Eigen::Index column)
+    {
+        m_numberOfEmptyColumns += column - m_nextColumn;
+        for (; m_nextColumn < column; ++m_nextColumn) {
+            m_outerIndices.push_back(static_cast<StorageIndex>(m_innerIndices.size()));
+        }
+    }
+
+public:
+    void reset(const Eigen::Index size)
+    {
+        m_size = size;
+        m_nextColumn = 0;
+        m_numberOfEmptyColumns = 0;
+        m_outerIndices.assign(1, 0);
+        m_innerIndices.clear();
+        m_values.clear();
+    }
+
+    void reserve(const Eigen::Index nonZeros)
+    {
+        m_outerIndices.reserve(m_size + 1);
+        m_innerIndices.reserve(nonZeros);
+        m_values.reserve(nonZeros);
+    }
+
+    // Returns false if the block overlaps the previous one or exceeds the matrix
+    bool appendDiagonalBlock(const Eigen::Index offset, const double* diagonal, const Eigen::Index blockSize)
+    {
+        if (!beginBlock(offset, blockSize)) {
+            return false;
+        }
+
+        for (Eigen::Index j = 0; j < blockSize; ++j) {
+            m_innerIndices.push_back(static_cast<StorageIndex>(offset + j));
+            m_values.push_back(diagonal[j]);
+            m_outerIndices.push_back(static_cast<StorageIndex>(m_innerIndices.size()));
+        }
+
+        m_nextColumn = offset + blockSize;
+        return true;
+    }
+
+    // The values of the symmetric block are passed in row-major (equivalently column-major) order
+    bool appendDenseBlock(const Eigen::Index offset, const double* values, const Eigen::Index blockSize)
+    {
+        if (!beginBlock(offset, blockSize)) {
+            return false;
+        }
+
+        for (Eigen::Index j = 0; j < blockSize; ++j) {
+            for (Eigen::Index i = 0; i < blockSize; ++i) {
+                m_innerIndices.push_back(static_cast<StorageIndex>(offset + i));
+                m_values.push_back(values[j * blockSize + i]);
+            }
+            m_outerIndices.push_back(static_cast<StorageIndex>(m_innerIndices.size()));
+        }
+
+        m_nextColumn = offset + blockSize;
+        return true;
+    }
+
+    // Number of columns not covered by any block, including the trailing ones
+    Eigen::Index numberOfEmptyColumns() const { return m_numberOfEmptyColumns + (m_size - m_nextColumn); }
+
+    void build(SparseMatrix& matrix)
+    {
+        skipColumnsUntil(m_size);
+
+        matrix.resize(m_size, m_size);
+        matrix.resizeNonZeros(static_cast<Eigen::Index>(m_values.size()));
+
+        std::copy(m_outerIndices.begin(), m_outerIndices.end(), matrix.outerIndexPtr());
+        std::copy(m_innerIndices.begin(), m_innerIndices.end(), matrix.innerIndexPtr());
+        std::copy(m_values.begin(), m_values.end(), matrix.valuePtr());
+    }
+};
+
+#endif // HDE_UTILS_BLOCKDIAGONALMATRIXBUILDER
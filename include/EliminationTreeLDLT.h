@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_ESTIMATION_ELIMINATIONTREELDLT
+#define HDE_ESTIMATION_ELIMINATIONTREELDLT
+
+#include <Eigen/SparseCore>
+
+#include <cstddef>
+#include <vector>
+
+namespace hde {
+    namespace estimation {
+        class EliminationTreeLDLT;
+    } // namespace estimation
+    namespace utils {
+        class FixedThreadPool;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Sparse L * D * L^T factorization of a symmetric positive definite matrix, parallel over the
+ * independent subtrees of its elimination tree.
+ *
+ * The factorization is up-looking: the row k of L is computed from the rows of the descendants
+ * of k in the elimination tree, and it writes only in their columns. The rows of two disjoint
+ * subtrees are then independent. analyzePattern() splits the tree from the roots, moving the
+ * most expensive subtree roots to the separator, until every subtree costs a small fraction of
+ * the whole factorization. factorize() runs the subtrees, the most expensive first, as tasks of
+ * the thread pool and then the separator rows on the calling thread, in increasing order.
+ *
+ * The matrix is passed by its upper triangular part, already permuted, like in the simplicial
+ * factorizations of Eigen. The columns of L have sorted inner indices.
+ */
+class hde::estimation::EliminationTreeLDLT
+{
+public:
+    using SparseMatrix = Eigen::SparseMatrix<double, Eigen::ColMajor>;
+    using StorageIndex = SparseMatrix::StorageIndex;
+
+private:
+    // Elimination tree, -1 for the roots
+    std::vector<StorageIndex> m_parent;
+
+    // Strictly lower triangular L with unit diagonal and the diagonal of D
+    SparseMatrix m_factor;
+    Eigen::VectorXd m_diagonal;
+
+    // The rows of the subtree s are m_subtreeRows[m_subtreeOffsets[s], m_subtreeOffsets[s + 1]),
+    // in increasing order. The subtrees are sorted by decreasing cost.
+    std::vector<StorageIndex> m_subtreeOffsets;
+    std::vector<StorageIndex> m_subtreeRows;
+    std::vector<StorageIndex> m_separatorRows;
+
+    // Workspace of the numeric factorization. The rows of a subtree use only the entries of its
+    // nodes and the range of m_pattern of its rows in m_subtreeRows.
+    Eigen::VectorXd m_work;
+    std::vector<StorageIndex> m_flag;
+    std::vector<StorageIndex> m_pattern;
+    std::vector<StorageIndex> m_columnNonZeros;
+    std::vector<unsigned char> m_isSubtreeFactorized;
+
+    bool m_isAnalyzed = false;
+    bool m_isFactorized = false;
+
+    // Row of L and entry of D, pattern is a workspace of patternSize entries
+    bool factorizeRow(const SparseMatrix& upper, StorageIndex row, StorageIndex* pattern, StorageIndex patternSize);
+
+public:
+    // Elimination tree, nonzeros of L and subtrees for the given number of concurrent threads
+    bool analyzePattern(const SparseMatrix& upper, std::size_t concurrency);
+
+    // Numeric factorization, in parallel if a thread pool is passed
+    bool factorize(const SparseMatrix& upper, hde::utils::FixedThreadPool* threadPool);
+
+    // Solves L * D * L^T * x = b, x contains b on input
+    void solveInPlace(Eigen::VectorXd& x) const;
+
+    bool isFactorized() const { return m_isFactorized; }
+    const SparseMatrix& factor() const { return m_factor; }
+    const Eigen::VectorXd& diagonal() const { return m_diagonal; }
+    std::size_t numberOfSubtrees() const { return m_subtreeOffsets.empty() ? 0 : m_subtreeOffsets.size() - 1; }
+    std::size_t numberOfSeparatorRows() const { return m_separatorRows.size(); }
+};
+
+#endif // HDE_ESTIMATION_ELIMINATIONTREELDLT
@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_ESTIMATION_FACTORIZEDMAPSOLVER
+#define HDE_ESTIMATION_FACTORIZEDMAPSOLVER
+
+#include "EliminationTreeLDLT.h"
+
+#include <Eigen/Cholesky>
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseCore>
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace hde {
+    namespace estimation {
+        class FactorizedMAPSolver;
+    } // namespace estimation
+    namespace utils {
+        class FixedThreadPool;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Maximum a posteriori solver of the BERDY problem that reuses the symbolic factorization.
+ *
+ * Given the dynamic constraints D*d + bD = 0 and the measurement equations y = Y*d + bY,
+ * the estimate is the solution of the sparse symmetric positive definite system
+ *
+ *     P * d = Sigma_d^-1 * mu_d - D^T * Sigma_D^-1 * bD + Y^T * Sigma_y^-1 * (y - bY)
+ *     P = Sigma_d^-1 + D^T * Sigma_D^-1 * D + Y^T * Sigma_y^-1 * Y
+ *
+ * The sparsity pattern of P does not change after the model is loaded. analyzePattern()
+ * computes the fill-reducing ordering and the symbolic factorization once, and every
+ * doEstimate() performs only the numeric refactorization and the triangular solves. If the
+ * pattern of the passed matrices changes, the analysis is done again automatically. The sparse
+ * products forming P are planned once for the pattern of D and Y, then every estimate only
+ * rewrites the values of the preallocated nonzeros of P and of its permutation.
+ *
+ * Diagonal prior covariances, the common case in BERDY, are detected when set and stored as
+ * dense vectors of inverse variances. The products with them become row scalings instead of
+ * general sparse products. Other covariances are inverted and used as sparse matrices.
+ *
+ * The priors, the analyzed pattern and the ordering form the setup of the solver. It is
+ * immutable once analyzed and can be shared by several solvers with shareSetup(), e.g. one
+ * per subject or per thread, that keep only their own numeric factors. Modifying a shared
+ * setup (e.g. setting new priors) detaches a private copy first.
+ *
+ * The covariance of a block of dynamic variables or of measurements can be replaced at
+ * runtime with the update*PriorCovariance() methods. Only the values of the affected nonzeros
+ * of the precision are rewritten, then the symbolic analysis stays valid and the change is
+ * used by the next numeric factorization. The block must be uncorrelated with the rest of the
+ * variables and must keep the sparsity pattern of the current precision.
+ *
+ * Measurements can be masked out of the estimate, e.g. when a sensor drops out, with
+ * setMeasurementsActive(). Masked rows of Y get a zero weight, i.e. an infinite variance,
+ * keeping their nonzeros, then the pattern and the symbolic analysis do not change. The mask
+ * is owned by each instance and must cover whole uncorrelated blocks of measurements.
+ *
+ * The variables are eliminated in the AMD ordering unless an elimination order is set with
+ * setEliminationOrder(), e.g. the leaf-to-root order of the kinematic tree. It is part of the
+ * setup and is used by the next symbolic analysis.
+ *
+ * With setMixedPrecision() the numeric factorization is computed in single precision, that
+ * halves the memory traffic of the factors, and the solution is refined in double precision
+ * against the double precision system until the normwise backward error ||r|| / (||P|| ||d||)
+ * is below the tolerance. If the single precision factorization fails or the refinement does
+ * not converge within the allowed steps, the estimate is computed with the double precision
+ * factors.
+ *
+ * For models too large to be factorized, setIterative() replaces the factorization with the
+ * preconditioned conjugate gradient on P * d = r. The preconditioner is block-Jacobi, with
+ * blocks given by the caller (e.g. the variables of each link), and every solve starts from
+ * the last estimate. A solve not reaching the relative residual ||r - P * d|| / ||r|| below the
+ * tolerance within the allowed iterations fails, and the next one restarts from its last
+ * iterate. No ordering and no symbolic factorization are computed in this mode.
+ *
+ * With setNumberOfThreads() the numeric factorization runs on a thread pool owned by the
+ * instance, in parallel over the independent subtrees of the elimination tree of the permuted
+ * P (see EliminationTreeLDLT). The elimination order and the result do not change.
+ *
+ * With setRecursive() the estimate is a fading memory information filter. The information
+ * matrix and vector of the previous estimate, scaled by the forgetting factor alpha, are added
+ * to the ones of the configured priors and of the new constraints and measurements:
+ *
+ *     P_k = alpha * P_k-1 + P,   r_k = alpha * r_k-1 + r,   P_k-1 * d_k-1 = r_k-1
+ *
+ * i.e. the previous estimate is the expected value of an additional prior whose covariance is
+ * the previous posterior covariance inflated by 1 / alpha. The inflation plays the role of the
+ * process noise and, unlike an additive one, keeps the pattern of P and the symbolic analysis.
+ * solveWithLastFactorization() updates only the information vector.
+ *
+ * The solver computes only the expected value of the posterior: the posterior covariance
+ * P^-1 is never formed. On request, computePosteriorCovariance() returns selected entries of
+ * it by selected inversion of the last factorization, i.e. only the entries of P^-1 in the
+ * pattern of the factor are computed, from the last eliminated variable back to the first
+ * requested one.
+ */
+class hde::estimation::FactorizedMAPSolver
+{
+public:
+    using SparseMatrix = Eigen::SparseMatrix<double, Eigen::ColMajor>;
+    using SparseMatrixRef = Eigen::Ref<const SparseMatrix>;
+    using VectorRef = Eigen::Ref<const Eigen::VectorXd>;
+    using Permutation = Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, SparseMatrix::StorageIndex>;
+    using EliminationOrder = std::vector<SparseMatrix::StorageIndex>;
+    using VariablesPair = std::pair<Eigen::Index, Eigen::Index>;
+
+    static constexpr double DefaultRefinementTolerance = 1e-12;
+    static constexpr std::size_t DefaultMaxRefinementSteps = 10;
+    static constexpr double DefaultIterativeTolerance = 1e-8;
+    static constexpr std::size_t DefaultMaxIterations = 1000;
+    static constexpr double DefaultForgettingFactor = 0.5;
+
+private:
+    // Inverse of a prior covariance
+    struct Precision
+    {
+        SparseMatrix matrix;
+        Eigen::VectorXd diagonal; // inverse variances, set only if isDiagonal
+        bool isDiagonal = false;
+    };
+
+    struct Setup
+    {
+        // Priors, stored in information form
+        Eigen::VectorXd dynamicsRegularizationExpectedValue; // mu_d
+        Precision dynamicsRegularizationPrecision; // Sigma_d^-1
+        Precision dynamicsConstraintsPrecision; // Sigma_D^-1
+        Precision measurementsPrecision; // Sigma_y^-1
+        Eigen::VectorXd dynamicsRegularizationInformation; // Sigma_d^-1 * mu_d
+
+        // Variables in elimination order, empty for the AMD ordering
+        EliminationOrder eliminationOrder;
+
+        // Single precision factorization with iterative refinement
+        bool isMixedPrecision = false;
+        double refinementTolerance = DefaultRefinementTolerance;
+        std::size_t maxRefinementSteps = DefaultMaxRefinementSteps;
+
+        // Preconditioned conjugate gradient instead of the factorization
+        bool isIterative = false;
+        double iterativeTolerance = DefaultIterativeTolerance;
+        std::size_t maxIterations = DefaultMaxIterations;
+
+        // Information of the previous estimates used as prior of the next one
+        bool isRecursive = false;
+        double forgettingFactor = DefaultForgettingFactor;
+        // Blocks of the block-Jacobi preconditioner: the variables of block b are
+        // blockVariables[blockOffsets[b], blockOffsets[b + 1]), the variable i is in the block
+        // blockOfVariable[i] at position indexInBlock[i]
+        std::vector<SparseMatrix::StorageIndex> blockOfVariable;
+        std::vector<SparseMatrix::StorageIndex> indexInBlock;
+        std::vector<SparseMatrix::StorageIndex> blockOffsets;
+        std::vector<SparseMatrix::StorageIndex> blockVariables;
+
+        // Pattern of P used in the symbolic analysis and its fill-reducing ordering
+        bool isAnalyzed = false;
+        std::vector<SparseMatrix::StorageIndex> analyzedOuterIndices;
+        std::vector<SparseMatrix::StorageIndex> analyzedInnerIndices;
+        Permutation permutation; // P -> permutation * P * permutation^T
+        Permutation inversePermutation;
+    };
+
+    // Term of a sparse product with a fixed pattern: result[result] += left[left] * right[right],
+    // addressing the nonzeros of the operands and of the result
+    struct ProductTerm
+    {
+        SparseMatrix::StorageIndex left;
+        SparseMatrix::StorageIndex right;
+        SparseMatrix::StorageIndex result;
+    };
+
+    // Assembly of P through the patterns of the last D and Y, computed when they change. Each
+    // product is replayed on the preallocated nonzeros, the weighted matrices have the pattern of
+    // the input ones if the precision is diagonal.
+    struct AssemblyPlan
+    {
+        bool isValid = false;
+        std::vector<SparseMatrix::StorageIndex> constraintsOuterIndices; // pattern of D
+        std::vector<SparseMatrix::StorageIndex> constraintsInnerIndices;
+        std::vector<SparseMatrix::StorageIndex> measurementsOuterIndices; // pattern of Y
+        std::vector<SparseMatrix::StorageIndex> measurementsInnerIndices;
+        std::vector<ProductTerm> weightedConstraintsTerms; // Sigma_D^-1 * D, if not diagonal
+        std::vector<ProductTerm> weightedMeasurementsTerms; // Sigma_y^-1 * Y, if not diagonal
+        std::vector<SparseMatrix::StorageIndex> regularizationPositions; // of Sigma_d^-1 in P
+        std::vector<ProductTerm> constraintsTerms; // D^T * Sigma_D^-1 * D
+        std::vector<ProductTerm> measurementsTerms; // Y^T * Sigma_y^-1 * Y
+    };
+
+    // The ordering is applied explicitly, the factorization only computes the elimination tree.
+    // The upper triangular part is factorized as is: SimplicialLDLT::factorize() allocates an
+    // empty copy of the input also when it does not use it.
+    template <typename Matrix>
+    class PreorderedLDLT
+        : public Eigen::SimplicialLDLT<Matrix, Eigen::Upper, Eigen::NaturalOrdering<SparseMatrix::StorageIndex>>
+    {
+    public:
+        void factorize(const Matrix& upper) { this->template factorize_preordered<true>(upper); }
+    };
+    using Factorization = PreorderedLDLT<SparseMatrix>;
+    using SingleSparseMatrix = Eigen::SparseMatrix<float, Eigen::ColMajor, SparseMatrix::StorageIndex>;
+    using SingleFactorization = PreorderedLDLT<SingleSparseMatrix>;
+
+    std::shared_ptr<Setup> m_setup = std::make_shared<Setup>();
+
+    // Per-instance buffers and numeric factors
+    SparseMatrix m_precision; // P
+    SparseMatrix m_permutedPrecision; // upper triangular part of the permuted P
+    Eigen::VectorXd m_informationVector; // right hand side
+    Eigen::VectorXd m_measurementsResidual; // y - bY
+    Eigen::VectorXd m_weightedMeasurementsResidual; // Sigma_y^-1 * (y - bY)
+    Eigen::VectorXd m_measurementsMask; // 1 for the active measurements, 0 for the masked ones
+    Eigen::Index m_numberOfMaskedMeasurements = 0;
+    Eigen::VectorXd m_weightedConstraintsBias; // Sigma_D^-1 * bD
+    SparseMatrix m_weightedD; // Sigma_D^-1 * D
+    SparseMatrix m_weightedY; // Sigma_y^-1 * Y
+    AssemblyPlan m_assemblyPlan;
+    // Position in the permuted P of each nonzero of P, -1 for the other triangular part
+    std::vector<SparseMatrix::StorageIndex> m_permutedPositions;
+    Eigen::VectorXd m_permutedInformationVector;
+    Eigen::VectorXd m_permutedSolution;
+    Eigen::VectorXd m_estimate;
+    Factorization m_factorization;
+    bool m_hasFactorizationPattern = false;
+    bool m_isFactorized = false;
+    std::size_t m_numberOfSymbolicAnalyses = 0;
+
+    // Mixed precision buffers and factors
+    SingleSparseMatrix m_singlePermutedPrecision;
+    SingleFactorization m_singleFactorization;
+    Eigen::VectorXd m_refinementResidual;
+    Eigen::VectorXf m_singleResidual;
+    Eigen::VectorXf m_singleCorrection;
+    double m_permutedPrecisionNorm = 0; // Frobenius norm of P
+    bool m_isSingleFactorized = false;
+    std::size_t m_numberOfRefinementSteps = 0;
+    std::size_t m_numberOfDoublePrecisionFallbacks = 0;
+
+    // Conjugate gradient buffers and block-Jacobi preconditioner
+    std::vector<Eigen::MatrixXd> m_preconditionerBlocks;
+    std::vector<Eigen::LLT<Eigen::MatrixXd>> m_preconditionerFactors;
+    Eigen::VectorXd m_blockBuffer;
+    Eigen::VectorXd m_cgResidual;
+    Eigen::VectorXd m_cgPreconditionedResidual;
+    Eigen::VectorXd m_cgDirection;
+    Eigen::VectorXd m_cgProduct;
+    std::size_t m_numberOfIterations = 0;
+    double m_iterativeRelativeResidual = 0;
+
+    // Information form of the last estimate, P aligned with the nonzeros of m_precision
+    Eigen::VectorXd m_recursivePrecision;
+    Eigen::VectorXd m_recursiveInformation;
+    bool m_hasRecursivePrior = false;
+
+    // Double precision factorization over the subtrees of the elimination tree, in parallel, used
+    // instead of m_factorization when more threads are set. Like m_factorization, it does not
+    // allocate after the analysis.
+    std::shared_ptr<hde::utils::FixedThreadPool> m_threadPool;
+    hde::estimation::EliminationTreeLDLT m_treeFactorization;
+    bool m_isTreeFactorization = false;
+
+    // Selected inverse of the last factorization, aligned with the nonzeros of the factor
+    Eigen::VectorXd m_selectedInverse;
+    Eigen::VectorXd m_selectedInverseDiagonal;
+
+    static bool computeInverse(const SparseMatrixRef& covariance, Precision& inverse);
+    static bool updatePrecisionBlock(Precision& precision, Eigen::Index offset, const SparseMatrixRef& covariance);
+    static void enumerateProduct(const SparseMatrixRef& left,
+                                 bool transposeLeft,
+                                 const SparseMatrixRef& right,
+                                 std::vector<ProductTerm>& terms,
+                                 std::vector<Eigen::Triplet<double, SparseMatrix::StorageIndex>>& coordinates);
+    static void locateProduct(const SparseMatrix& result,
+                              const std::vector<Eigen::Triplet<double, SparseMatrix::StorageIndex>>& coordinates,
+                              std::vector<ProductTerm>& terms);
+    static void accumulateProduct(const std::vector<ProductTerm>& terms,
+                                  const double* left,
+                                  const double* right,
+                                  double* result);
+    static void buildWeightedPlan(const SparseMatrixRef& matrix,
+                                  const Precision& precision,
+                                  std::vector<ProductTerm>& terms,
+                                  SparseMatrix& weighted);
+    static void weightRows(const SparseMatrixRef& matrix,
+                           const Precision& precision,
+                           const std::vector<ProductTerm>& terms,
+                           SparseMatrix& weighted);
+    void resizeMeasurementsMask(Eigen::Index nrOfMeasurements);
+    void resizeBuffers();
+    Setup& mutableSetup();
+    void buildAssemblyPlan(const SparseMatrixRef& D, const SparseMatrixRef& Y);
+    bool assemblePrecision(const SparseMatrixRef& D, const SparseMatrixRef& Y);
+    bool hasAnalyzedPattern(const SparseMatrix& matrix) const;
+    bool analyzeAssembledPattern();
+    void analyzePermutedPattern();
+    void permuteAssembledPrecision();
+    bool analyzeFactorizationPattern();
+    bool factorize(bool singlePrecision);
+    void solveSingleCorrection();
+    bool refineSolution();
+    void assembleInformationVector(const SparseMatrixRef& D,
+                                   const VectorRef& bD,
+                                   const SparseMatrixRef& Y,
+                                   const VectorRef& bY,
+                                   const VectorRef& measurements);
+    bool solveFactorized(const SparseMatrixRef& D,
+                         const VectorRef& bD,
+                         const SparseMatrixRef& Y,
+                         const VectorRef& bY,
+                         const VectorRef& measurements);
+    void updateRecursivePrior(bool hasNewPrecision);
+    bool resizePreconditioner();
+    bool computePreconditioner();
+    void applyPreconditioner();
+    bool solveIterative(const SparseMatrixRef& D,
+                        const VectorRef& bD,
+                        const SparseMatrixRef& Y,
+                        const VectorRef& bY,
+                        const VectorRef& measurements);
+
+public:
+    FactorizedMAPSolver() = default;
+
+    bool setDynamicsRegularizationPrior(const VectorRef& expectedValue, const SparseMatrixRef& covariance);
+    bool setDynamicsConstraintsPriorCovariance(const SparseMatrixRef& covariance);
+    bool setMeasurementsPriorCovariance(const SparseMatrixRef& covariance);
+
+    // Replace the covariance of the variables [offset, offset + covariance.rows())
+    bool updateDynamicsRegularizationPriorCovariance(Eigen::Index offset, const SparseMatrixRef& covariance);
+    bool updateMeasurementsPriorCovariance(Eigen::Index offset, const SparseMatrixRef& covariance);
+
+    // Overwrite the diagonal block of matrix starting at (offset, offset) with the values of
+    // block, without changing the pattern. The nonzeros of block must be in the pattern of
+    // matrix, and matrix must have no nonzeros coupling the block with the other variables.
+    static bool replaceDiagonalBlock(SparseMatrix& matrix, Eigen::Index offset, const SparseMatrixRef& block);
+
+    // Eliminate the dynamic variables in the given order, a permutation of [0, n). An empty
+    // order restores the AMD ordering. It invalidates the symbolic analysis.
+    bool setEliminationOrder(const EliminationOrder& order);
+
+    // Factorize in single precision and refine in double precision, see the class description.
+    // Changing the mode invalidates the symbolic analysis.
+    bool setMixedPrecision(bool enabled,
+                           double tolerance = DefaultRefinementTolerance,
+                           std::size_t maxRefinementSteps = DefaultMaxRefinementSteps);
+
+    // Solve with the block-Jacobi preconditioned conjugate gradient, see the class description.
+    // blockOfVariable assigns each dynamic variable to a block, a block per variable gives the
+    // Jacobi preconditioner. The iterations stop when ||r - P * d|| <= tolerance * ||r|| or after
+    // maxIterations, keeping the last iterate. Changing the mode invalidates the analysis.
+    bool setIterative(bool enabled,
+                      const std::vector<SparseMatrix::StorageIndex>& blockOfVariable,
+                      double tolerance = DefaultIterativeTolerance,
+                      std::size_t maxIterations = DefaultMaxIterations);
+
+    // Use the information of the previous estimate, scaled by the forgetting factor in (0, 1), as
+    // additional prior of the next one, see the class description. The recursion restarts from
+    // the configured priors when enabled and whenever the pattern of P changes.
+    bool setRecursive(bool enabled, double forgettingFactor = DefaultForgettingFactor);
+
+    // Threads of the numeric factorization, including the calling one. With one thread, the
+    // default, the factorization is the sequential SimplicialLDLT. With more than one it is
+    // parallel over the subtrees of the elimination tree, see the class description. It is not
+    // used in mixed precision and iterative mode.
+    bool setNumberOfThreads(std::size_t numberOfThreads);
+
+    // Symbolic analysis of the system built from the pattern of D and Y. All the methods taking D
+    // and Y require them in compressed format.
+    bool analyzePattern(const SparseMatrixRef& D, const SparseMatrixRef& Y);
+
+    // P assembled with the current priors, e.g. to evaluate elimination orders on its pattern
+    bool computePrecision(const SparseMatrixRef& D, const SparseMatrixRef& Y, SparseMatrix& precision);
+
+    // Use the priors and the symbolic analysis of an analyzed solver, without copying them
+    bool shareSetup(const FactorizedMAPSolver& other);
+
+    // Exclude the measurements [offset, offset + size) from the next estimates, or include them
+    // again. It costs O(size) and can be called between any two estimates after the analysis.
+    bool setMeasurementsActive(Eigen::Index offset, Eigen::Index size, bool active);
+
+    // Numeric factorization and solve. Re-analyzes the pattern only if it changed.
+    bool doEstimate(const SparseMatrixRef& D,
+                    const VectorRef& bD,
+                    const SparseMatrixRef& Y,
+                    const VectorRef& bY,
+                    const VectorRef& measurements);
+
+    // Cheaper approximate estimate: the right hand side is computed from the passed matrices,
+    // but the system is solved with the factorization of the last doEstimate(). In mixed
+    // precision, if the refinement does not converge the same system is factorized in double.
+    bool solveWithLastFactorization(const SparseMatrixRef& D,
+                                    const VectorRef& bD,
+                                    const SparseMatrixRef& Y,
+                                    const VectorRef& bY,
+                                    const VectorRef& measurements);
+
+    // Entries of the posterior covariance P^-1 at the given pairs of dynamic variables, from the
+    // factors of the last estimate. The pairs must be coupled in P, e.g. by a prior, a constraint
+    // or a measurement, or by the fill-in of the factorization. Not available in iterative mode.
+    bool computePosteriorCovariance(const std::vector<VariablesPair>& entries, Eigen::VectorXd& values);
+
+    bool isAnalyzed() const { return m_setup->isAnalyzed; }
+    bool isRecursive() const { return m_setup->isRecursive; }
+    std::size_t numberOfSymbolicAnalyses() const { return m_numberOfSymbolicAnalyses; }
+    Eigen::Index numberOfMaskedMeasurements() const { return m_numberOfMaskedMeasurements; }
+    // Nonzeros of the strictly lower triangular factor of the last factorization, 0 if iterative
+    Eigen::Index factorNonZeros() const
+    {
+        if (!m_isFactorized || m_setup->isIterative) {
+            return 0;
+        }
+        if (m_isTreeFactorization) {
+            return m_treeFactorization.factor().nonZeros();
+        }
+        return m_isSingleFactorized ? m_singleFactorization.matrixL().nestedExpression().nonZeros()
+                                    : m_factorization.matrixL().nestedExpression().nonZeros();
+    }
+    // Refinement steps of the last solve and estimates that fell back to the double precision
+    std::size_t numberOfRefinementSteps() const { return m_numberOfRefinementSteps; }
+    std::size_t numberOfDoublePrecisionFallbacks() const { return m_numberOfDoublePrecisionFallbacks; }
+    // Conjugate gradient iterations and relative residual of the last iterative solve
+    std::size_t numberOfIterations() const { return m_numberOfIterations; }
+    double iterativeRelativeResidual() const { return m_iterativeRelativeResidual; }
+    const Eigen::VectorXd& lastEstimate() const { return m_estimate; }
+};
+
+#endif // HDE_ESTIMATION_FACTORIZEDMAPSOLVER
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_FIXEDTHREADPOOL
+#define HDE_UTILS_FIXEDTHREADPOOL
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hde {
+    namespace utils {
+        class FixedThreadPool;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Fixed set of worker threads that execute blocking parallel loops.
+ *
+ * The threads are created in the constructor and sleep between two calls of parallelFor().
+ * The calling thread takes part to the loop, then a pool of N threads runs N + 1 tasks at
+ * the same time. The tasks are picked dynamically, in increasing index order.
+ * parallelFor() must be called by a single thread at a time.
+ */
+class hde::utils::FixedThreadPool
+{
+public:
+    using Task = std::function<void(std::size_t)>;
+
+private:
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_done;
+    const Task* m_task = nullptr;
+    std::size_t m_numberOfTasks = 0;
+    std::atomic<std::size_t> m_nextTask{0};
+    std::size_t m_generation = 0; // incremented at every parallelFor()
+    std::size_t m_busyWorkers = 0;
+    bool m_stop = false;
+
+    void runTasks()
+    {
+        for (std::size_t index = m_nextTask.fetch_add(1); index < m_numberOfTasks;
+             index = m_nextTask.fetch_add(1)) {
+            (*m_task)(index);
+        }
+    }
+
+    void workerLoop()
+    {
+        std::size_t generation = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wakeUp.wait(lock, [&]() { return m_stop || m_generation != generation; });
+                if (m_stop) {
+                    return;
+                }
+                generation = m_generation;
+            }
+
+            runTasks();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_busyWorkers == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+public:
+    explicit FixedThreadPool(const std::size_t numberOfThreads)
+    {
+        m_threads.reserve(numberOfThreads);
+        for (std::size_t i = 0; i < numberOfThreads; ++i) {
+            m_threads.emplace_back(&FixedThreadPool::workerLoop, this);
+        }
+    }
+
+    ~FixedThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeUp.notify_all();
+
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    FixedThreadPool(const FixedThreadPool&) = delete;
+    FixedThreadPool& operator=(const FixedThreadPool&) = delete;
+
+    // Number of threads executing the loops, including the calling one
+    std::size_t concurrency() const { return m_threads.size() + 1; }
+
+    // Executes task(i) for every i in [0, numberOfTasks) and returns when all of them are done
+    void parallelFor(const std::size_t numberOfTasks, const Task& task)
+    {
+        if (numberOfTasks == 0) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_numberOfTasks = numberOfTasks;
+            m_nextTask.store(0);
+            m_busyWorkers = m_threads.size();
+            ++m_generation;
+        }
+        m_wakeUp.notify_all();
+
+        runTasks();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&]() { return m_busyWorkers == 0; });
+        m_task = nullptr;
+    }
+};
+
+#endif // HDE_UTILS_FIXEDTHREADPOOL
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_ESTIMATION_KINEMATICTREEORDERING
+#define HDE_ESTIMATION_KINEMATICTREEORDERING
+
+#include "FactorizedMAPSolver.h"
+
+#include <vector>
+
+namespace iDynTree {
+    class BerdyHelper;
+} // namespace iDynTree
+
+namespace hde {
+    namespace estimation {
+        class KinematicTreeOrdering;
+    } // namespace estimation
+} // namespace hde
+
+/**
+ * Elimination order of the BERDY dynamic variables that follows the kinematic tree.
+ *
+ * The variables are grouped by link: the link variables (acceleration, net and external
+ * wrenches) with those of the joint connecting the link to its parent in the dynamic
+ * traversal (joint wrench, DOF acceleration and torque). The groups are eliminated from the
+ * leaves to the root, i.e. in reverse traversal order.
+ *
+ * The equations of BERDY couple a link only with its parent and its siblings, then eliminating
+ * a group creates no fill outside the already coupled groups. With this order the factor of the
+ * MAP system has a number of nonzeros, and the factorization a cost, linear in the number of
+ * links, like a recursive leaf-to-root solution on the tree. The same groups are the blocks of
+ * the block-Jacobi preconditioner of the iterative solver.
+ */
+class hde::estimation::KinematicTreeOrdering
+{
+public:
+    using StorageIndex = FactorizedMAPSolver::SparseMatrix::StorageIndex;
+
+    // Group of every dynamic variable: the traversal index of its link, or the number of visited
+    // links for the variables that do not refer to a link or to a joint of the model
+    static bool computeLinkGroups(const iDynTree::BerdyHelper& berdy, std::vector<StorageIndex>& groups);
+
+    // The variables that do not refer to the tree are eliminated last
+    static bool compute(const iDynTree::BerdyHelper& berdy, FactorizedMAPSolver::EliminationOrder& order);
+};
+
+#endif // HDE_ESTIMATION_KINEMATICTREEORDERING
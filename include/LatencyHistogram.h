@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_LATENCYHISTOGRAM
+#define HDE_UTILS_LATENCYHISTOGRAM
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace hde {
+    namespace utils {
+        class LatencyHistogram;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Fixed-bucket histogram of durations, cheap enough to be always enabled.
+ *
+ * Durations are recorded in nanoseconds in log-linear buckets: every power of two is split
+ * in 8 sub-buckets, so quantiles have a relative error below 12.5% and recording is a few
+ * integer operations without any allocation. record() must be called by a single thread,
+ * while the statistics can be read concurrently from any thread.
+ */
+class hde::utils::LatencyHistogram
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Statistics
+    {
+        std::uint64_t count = 0;
+        double p50 = 0; // [s]
+        double p99 = 0; // [s]
+        double max = 0; // [s]
+        std::uint64_t overruns = 0; // samples longer than the overrun threshold
+    };
+
+private:
+    static constexpr unsigned SubBucketBits = 3;
+    static constexpr std::uint64_t SubBuckets = 1u << SubBucketBits;
+    static constexpr std::size_t NumberOfBuckets = 64 * SubBuckets;
+
+    std::array<std::atomic<std::uint64_t>, NumberOfBuckets> m_buckets{};
+    std::atomic<std::uint64_t> m_count{0};
+    std::atomic<std::uint64_t> m_max{0};
+    std::atomic<std::uint64_t> m_overruns{0};
+    std::uint64_t m_overrunThreshold = UINT64_MAX;
+
+    static unsigned mostSignificantBit(const std::uint64_t value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#else
+        unsigned msb = 0;
+        for (std::uint64_t v = value; v > 1; v >>= 1) {
+            ++msb;
+        }
+        return msb;
+#endif
+    }
+
+    static std::size_t bucketIndex(const std::uint64_t nanoseconds)
+    {
+        if (nanoseconds < SubBuckets) {
+            return static_cast<std::size_t>(nanoseconds);
+        }
+
+        const unsigned shift = mostSignificantBit(nanoseconds) - SubBucketBits;
+        const std::uint64_t subBucket = (nanoseconds >> shift) & (SubBuckets - 1);
+        return static_cast<std::size_t>((shift + 1) * SubBuckets + subBucket);
+    }
+
+    // Largest value falling in the bucket
+    static std::uint64_t bucketUpperBound(const std::size_t index)
+    {
+        if (index < SubBuckets) {
+            return index;
+        }
+
+        const unsigned shift = static_cast<unsigned>(index / SubBuckets - 1);
+        const std::uint64_t subBucket = index % SubBuckets;
+        return ((SubBuckets + subBucket + 1) << shift) - 1;
+    }
+
+    static void increment(std::atomic<std::uint64_t>& counter)
+    {
+        // Single writer: a relaxed load and store is enough and avoids a locked instruction
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+public:
+    // Samples longer than the threshold are counted as overruns. Not thread safe.
+    void setOverrunThreshold(const double seconds)
+    {
+        m_overrunThreshold = static_cast<std::uint64_t>(seconds * 1e9);
+    }
+
+    void record(const Clock::duration duration)
+    {
+        const auto nanoseconds = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+
+        increment(m_buckets[bucketIndex(nanoseconds)]);
+        increment(m_count);
+
+        if (nanoseconds > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(nanoseconds, std::memory_order_relaxed);
+        }
+
+        if (nanoseconds > m_overrunThreshold) {
+            increment(m_overruns);
+        }
+    }
+
+    void record(const Clock::time_point& begin) { record(Clock::now() - begin); }
+
+    // Discards the recorded samples. It must not run concurrently with record().
+    void reset()
+    {
+        for (std::atomic<std::uint64_t>& bucket : m_buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_count.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+        m_overruns.store(0, std::memory_order_relaxed);
+    }
+
+    Statistics statistics() const
+    {
+        Statistics statistics;
+        statistics.count = m_count.load(std::memory_order_relaxed);
+        statistics.max = m_max.load(std::memory_order_relaxed) * 1e-9;
+        statistics.overruns = m_overruns.load(std::memory_order_relaxed);
+
+        if (statistics.count == 0) {
+            return statistics;
+        }
+
+        // Ranks of the quantiles, rounded up
+        const std::uint64_t rank50 = (statistics.count * 50 + 99) / 100;
+        const std::uint64_t rank99 = (statistics.count * 99 + 99) / 100;
+
+        std::uint64_t cumulative = 0;
+        bool p50Found = false;
+        for (std::size_t i = 0; i < NumberOfBuckets; ++i) {
+            cumulative += m_buckets[i].load(std::memory_order_relaxed);
+
+            if (!p50Found && cumulative >= rank50) {
+                statistics.p50 = bucketUpperBound(i) * 1e-9;
+                p50Found = true;
+            }
+
+            if (cumulative >= rank99) {
+                statistics.p99 = bucketUpperBound(i) * 1e-9;
+                break;
+            }
+        }
+
+        // The bucket bound can exceed the exact maximum
+        if (statistics.p50 > statistics.max) {
+            statistics.p50 = statistics.max;
+        }
+        if (statistics.p99 > statistics.max) {
+            statistics.p99 = statistics.max;
+        }
+
+        return statistics;
+    }
+};
+
+#endif // HDE_UTILS_LATENCYHISTOGRAM
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_MODELSNAPSHOT
+#define HDE_UTILS_MODELSNAPSHOT
+
+#include <cstdint>
+#include <string>
+
+namespace iDynTree {
+    class Model;
+    class SensorsList;
+} // namespace iDynTree
+
+namespace hde {
+    namespace utils {
+        class ModelSnapshot;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Versioned binary snapshot of an iDynTree::Model and of its SensorsList.
+ *
+ * The snapshot stores the links with their inertia, the fixed, revolute and prismatic joints
+ * with their rest transform, axis and position limits, the additional frames, the default
+ * base and the force-torque, accelerometer, gyroscope, angular accelerometer and contact
+ * force-torque sensors. It is memory-mapped when read and the model is rebuilt directly
+ * through the iDynTree API, skipping the XML parsing of the URDF.
+ *
+ * The header holds the hash of the URDF the snapshot was generated from, so that the caller
+ * can detect a stale snapshot by comparing it with the hash of the current URDF. Models with
+ * other joint or sensor types are not supported and write() fails for them.
+ */
+class hde::utils::ModelSnapshot
+{
+public:
+    static constexpr std::uint32_t Version = 1;
+
+    // Hash of the content of a (URDF) file, false if the file cannot be read
+    static bool hashFile(const std::string& fileName, std::uint64_t& hash);
+
+    // False with the reason if the model has joints or sensors that the snapshot cannot store
+    static bool isSupported(const iDynTree::Model& model, const iDynTree::SensorsList& sensors, std::string& reason);
+
+    static bool read(const std::string& fileName,
+                     const std::uint64_t sourceHash,
+                     iDynTree::Model& model,
+                     iDynTree::SensorsList& sensors);
+    static bool write(const std::string& fileName,
+                      const std::uint64_t sourceHash,
+                      const iDynTree::Model& model,
+                      const iDynTree::SensorsList& sensors);
+};
+
+#endif // HDE_UTILS_MODELSNAPSHOT
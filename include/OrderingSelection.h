@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_ESTIMATION_ORDERINGSELECTION
+#define HDE_ESTIMATION_ORDERINGSELECTION
+
+#include "FactorizedMAPSolver.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hde {
+    namespace estimation {
+        class OrderingSelection;
+    } // namespace estimation
+} // namespace hde
+
+namespace iDynTree {
+    class BerdyHelper;
+} // namespace iDynTree
+
+/**
+ * Selection of the elimination order of the BERDY MAP system among several fill-reducing
+ * orderings, and its cache.
+ *
+ * The candidates are AMD and nested dissection on the graph of P, COLAMD on the stacked rows
+ * of D and Y, whose normal matrix has the pattern of P for diagonal priors, and the leaf-to-root
+ * order of the kinematic tree. Nested dissection bisects the graph recursively on the middle
+ * level of a breadth-first search from a pseudo-peripheral node. Every candidate is evaluated
+ * by the symbolic factorization of P in its order: the nonzeros of L and the flops, estimated
+ * as the sum of the squared column counts of L. The one with the least flops is selected.
+ *
+ * The cache is a versioned binary file with the selected order, keyed by a hash of the pattern
+ * of P, so that it is recomputed whenever the model, the sensors or the priors change it.
+ */
+class hde::estimation::OrderingSelection
+{
+public:
+    using SparseMatrix = FactorizedMAPSolver::SparseMatrix;
+    using SparseMatrixRef = FactorizedMAPSolver::SparseMatrixRef;
+    using EliminationOrder = FactorizedMAPSolver::EliminationOrder;
+
+    struct Candidate
+    {
+        std::string method;
+        EliminationOrder order;
+        Eigen::Index factorNonZeros = 0; // strictly lower part of L
+        double flops = 0;
+    };
+
+    static constexpr std::uint32_t CacheVersion = 1;
+
+    // Nonzeros and flops of the factorization of P, full symmetric pattern, in the given order
+    static bool evaluate(const SparseMatrix& precision, Candidate& candidate);
+
+    // Evaluated candidates, the kinematic tree one only if berdy is passed
+    static bool computeCandidates(const SparseMatrix& precision,
+                                  const SparseMatrixRef& D,
+                                  const SparseMatrixRef& Y,
+                                  const iDynTree::BerdyHelper* berdy,
+                                  std::vector<Candidate>& candidates);
+
+    // Candidate with the least flops, then with the least nonzeros
+    static std::size_t selectBest(const std::vector<Candidate>& candidates);
+
+    static std::uint64_t patternKey(const SparseMatrix& precision);
+
+    // Return false if the file does not exist or does not match the key
+    static bool readCache(const std::string& fileName, std::uint64_t key, Candidate& candidate);
+    // The file is replaced atomically
+    static bool writeCache(const std::string& fileName, std::uint64_t key, const Candidate& candidate);
+};
+
+#endif // HDE_ESTIMATION_ORDERINGSELECTION
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_PRIORSCACHE
+#define HDE_UTILS_PRIORSCACHE
+
+#include <Eigen/SparseCore>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hde {
+    namespace utils {
+        class PriorsCache;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Versioned binary file storing the priors of the BERDY MAP problem after parsing.
+ *
+ * The file starts with a fixed header (magic, format version, byte order mark and the key of
+ * the configuration the priors were built from), followed by the raw arrays of the expected
+ * value, of the three covariance matrices in compressed sparse column form and of the berdy
+ * sensors ordering they refer to. It is memory-mapped when read, so that loading costs only
+ * the copies of the arrays. Files with a different version, byte order or key are rejected, as
+ * well as the ones whose sizes do not match their data, before any allocation.
+ */
+class hde::utils::PriorsCache
+{
+public:
+    using SparseMatrix = Eigen::SparseMatrix<double, Eigen::ColMajor>;
+
+    // Range of a berdy sensor in the measurements vector
+    struct Sensor
+    {
+        std::int32_t type = 0;
+        std::string id;
+        std::int32_t offset = 0;
+        std::int32_t size = 0;
+
+        bool operator==(const Sensor& other) const
+        {
+            return type == other.type && offset == other.offset && size == other.size && id == other.id;
+        }
+    };
+
+    struct Entry
+    {
+        Eigen::VectorXd dynamicsRegularizationExpectedValue; // mu_d
+        SparseMatrix dynamicsRegularizationCovariance; // sigma_d
+        SparseMatrix dynamicsConstraintsCovariance; // sigma_D
+        SparseMatrix measurementsCovariance; // sigma_y
+        std::vector<Sensor> sensors;
+    };
+
+    static constexpr std::uint32_t Version = 1;
+
+    // Return false if the file does not exist or does not match the key
+    static bool read(const std::string& fileName, std::uint64_t key, Entry& entry);
+    // The file is replaced atomically
+    static bool write(const std::string& fileName, std::uint64_t key, const Entry& entry);
+};
+
+#endif // HDE_UTILS_PRIORSCACHE
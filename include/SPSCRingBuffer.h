@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_SPSCRINGBUFFER
+#define HDE_UTILS_SPSCRINGBUFFER
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace hde {
+    namespace utils {
+        template <typename T>
+        class SPSCRingBuffer;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Bounded lock-free ring buffer for one producer thread and one consumer thread.
+ *
+ * The slots are constructed once in resize() and then reused: the producer fills the slot
+ * returned by beginWrite() in place and makes it visible with commitWrite(), the consumer
+ * processes the slot returned by front() in place and gives it back with pop().
+ * No memory is allocated after resize(), that is not thread safe.
+ */
+template <typename T>
+class hde::utils::SPSCRingBuffer
+{
+private:
+    // Padding to keep the indices written by different threads on different cache lines
+    static constexpr std::size_t CacheLineSize = 64;
+
+    std::vector<T> m_slots;
+    char m_padding0[CacheLineSize];
+    std::atomic<std::size_t> m_readIndex{0}; // written only by the consumer
+    char m_padding1[CacheLineSize];
+    std::atomic<std::size_t> m_writeIndex{0}; // written only by the producer
+    char m_padding2[CacheLineSize];
+
+public:
+    void resize(const std::size_t capacity, const T& prototype)
+    {
+        m_slots.assign(capacity, prototype);
+        m_readIndex.store(0);
+        m_writeIndex.store(0);
+    }
+
+    std::size_t capacity() const { return m_slots.size(); }
+
+    std::size_t size() const
+    {
+        return m_writeIndex.load(std::memory_order_acquire) - m_readIndex.load(std::memory_order_acquire);
+    }
+
+    // Producer side. Returns nullptr if the buffer is full.
+    T* beginWrite()
+    {
+        const std::size_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+        if (m_slots.empty() || writeIndex - m_readIndex.load(std::memory_order_acquire) == m_slots.size()) {
+            return nullptr;
+        }
+        return &m_slots[writeIndex % m_slots.size()];
+    }
+
+    void commitWrite() { m_writeIndex.fetch_add(1, std::memory_order_release); }
+
+    // Consumer side. Returns nullptr if the buffer is empty.
+    T* front()
+    {
+        const std::size_t readIndex = m_readIndex.load(std::memory_order_relaxed);
+        if (readIndex == m_writeIndex.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_slots[readIndex % m_slots.size()];
+    }
+
+    void pop() { m_readIndex.fetch_add(1, std::memory_order_release); }
+};
+
+#endif // HDE_UTILS_SPSCRINGBUFFER
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_SEQLOCKCHANNEL
+#define HDE_UTILS_SEQLOCKCHANNEL
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace hde {
+    namespace utils {
+        class SeqLockChannel;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Single-writer multiple-readers channel publishing fixed-size vectors of doubles.
+ *
+ * The writer never blocks and readers never take a lock. Every publication goes to the
+ * next slot of a small ring, protected by its own sequence counter: a reader copies the
+ * last published slot and retries only if the writer lapped the whole ring meanwhile.
+ * publish() is wait-free, read() is only lock-free: a reader can retry as long as the
+ * writer keeps lapping the ring during its copies.
+ *
+ * resize() is not thread safe and must be called before any publish() or read().
+ */
+class hde::utils::SeqLockChannel
+{
+private:
+    static constexpr std::size_t NumberOfSlots = 4;
+
+    struct Slot
+    {
+        // Odd while the slot is being written, 2 * publication number when it is consistent
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<double> timestamp{0};
+        std::atomic<std::uint64_t> tag{0}; // user defined, published with the values
+        std::unique_ptr<std::atomic<double>[]> data;
+    };
+
+    std::size_t m_size = 0;
+    std::array<Slot, NumberOfSlots> m_slots;
+    std::atomic<std::uint64_t> m_lastPublication{0};
+
+public:
+    void resize(const std::size_t size)
+    {
+        m_size = size;
+        m_lastPublication.store(0);
+
+        for (Slot& slot : m_slots) {
+            slot.sequence.store(0);
+            slot.timestamp.store(0);
+            slot.tag.store(0);
+            slot.data.reset(new std::atomic<double>[size]);
+            for (std::size_t i = 0; i < size; ++i) {
+                slot.data[i].store(0);
+            }
+        }
+    }
+
+    std::size_t size() const { return m_size; }
+
+    // Publish m_size values. Only one thread can call this method.
+    void publish(const double* values, const double timestamp, const std::uint64_t tag = 0)
+    {
+        const std::uint64_t publication = m_lastPublication.load(std::memory_order_relaxed) + 1;
+        Slot& slot = m_slots[publication % NumberOfSlots];
+
+        slot.sequence.store(2 * publication - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (std::size_t i = 0; i < m_size; ++i) {
+            slot.data[i].store(values[i], std::memory_order_relaxed);
+        }
+        slot.timestamp.store(timestamp, std::memory_order_relaxed);
+        slot.tag.store(tag, std::memory_order_relaxed);
+
+        slot.sequence.store(2 * publication, std::memory_order_release);
+        m_lastPublication.store(publication, std::memory_order_release);
+    }
+
+    // Copy the last published m_size values. Returns false if nothing has been published yet.
+    bool read(double* values, std::uint64_t& sequence, double& timestamp) const
+    {
+        std::uint64_t tag;
+        return read(values, sequence, timestamp, tag);
+    }
+
+    bool read(double* values, std::uint64_t& sequence, double& timestamp, std::uint64_t& tag) const
+    {
+        while (true) {
+            const std::uint64_t publication = m_lastPublication.load(std::memory_order_acquire);
+            if (publication == 0) {
+                return false;
+            }
+
+            const Slot& slot = m_slots[publication % NumberOfSlots];
+
+            const std::uint64_t sequenceBefore = slot.sequence.load(std::memory_order_acquire);
+            if (sequenceBefore != 2 * publication) {
+                // The writer already reused this slot
+                continue;
+            }
+
+            for (std::size_t i = 0; i < m_size; ++i) {
+                values[i] = slot.data[i].load(std::memory_order_relaxed);
+            }
+            const double slotTimestamp = slot.timestamp.load(std::memory_order_relaxed);
+            const std::uint64_t slotTag = slot.tag.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == sequenceBefore) {
+                sequence = publication;
+                timestamp = slotTimestamp;
+                tag = slotTag;
+                return true;
+            }
+        }
+    }
+};
+
+#endif // HDE_UTILS_SEQLOCKCHANNEL
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#ifndef HDE_UTILS_STARTUPPROFILER
+#define HDE_UTILS_STARTUPPROFILER
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hde {
+    namespace utils {
+        class StartupProfiler;
+    } // namespace utils
+} // namespace hde
+
+/**
+ * Records the wall time and the peak resident set size of consecutive startup phases.
+ *
+ * beginPhase() closes the running phase, if any, and starts a new one. The peak RSS is the
+ * high-water mark of the whole process at the end of the phase: it never decreases, and
+ * the phase that raised it is the one allocating the memory.
+ */
+class hde::utils::StartupProfiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Phase
+    {
+        std::string name;
+        double wallTime = 0; // [s]
+        std::int64_t peakResidentSetSize = 0; // [KiB]
+    };
+
+    // Closes the running phase when it goes out of scope, e.g. on an early return
+    class PhaseGuard
+    {
+    private:
+        StartupProfiler& m_profiler;
+
+    public:
+        explicit PhaseGuard(StartupProfiler& profiler)
+            : m_profiler(profiler)
+        {}
+        ~PhaseGuard() { m_profiler.endPhase(); }
+
+        PhaseGuard(const PhaseGuard&) = delete;
+        PhaseGuard& operator=(const PhaseGuard&) = delete;
+    };
+
+private:
+    std::vector<Phase> m_phases;
+    Clock::time_point m_phaseBegin;
+    bool m_isPhaseRunning = false;
+
+public:
+    void reset();
+    void beginPhase(const std::string& name);
+    void endPhase();
+
+    const std::vector<Phase>& phases() const { return m_phases; }
+    double totalWallTime() const;
+
+    // {"total_wall_time_s": ..., "peak_rss_kib": ..., "phases": [{"name": ..., ...}, ...]}
+    std::string toJSON() const;
+    // One "<name>.wall_time_s=<value> <name>.peak_rss_kib=<value>" line per phase
+    std::string toKeyValue() const;
+
+    // High-water mark of the resident set size of the process, 0 if not available [KiB]
+    static std::int64_t getPeakResidentSetSize();
+
+    // Quoted JSON string of the text, e.g. of a file path
+    static std::string toJSONString(const std::string& text);
+};
+
+#endif // HDE_UTILS_STARTUPPROFILER
@@ -15,11 +15,15 @@
 
 #include "IHumanDynamics.h"
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace hde {
     namespace modules {
         class HumanDynamicsEstimator;
+        class MultiSubjectDynamicsEstimator;
     } // namespace devices
 } // namespace hde
 
@@ -30,7 +34,57 @@ private:
     class Impl;
     std::unique_ptr<Impl> pImpl;
 
+    // Uses the setup of an opened estimator for all its subjects
+    friend class MultiSubjectDynamicsEstimator;
+
 public:
+    // Joint torques published by the last estimation step
+    struct JointTorquesSnapshot
+    {
+        std::vector<double> torques;
+        std::uint64_t sequence = 0; // incremented at every publication
+        double timestamp = 0; // yarp::os::Time::now() at the publication
+        unsigned qualityTier = 0; // 0 is the full quality, see DeadlineStatistics
+        bool isStale = false; // previous estimate published again under overload
+    };
+
+    // Latency statistics of a section of the estimation loop
+    struct StageLatency
+    {
+        std::string stage;
+        std::uint64_t count = 0;
+        double p50 = 0; // [s]
+        double p99 = 0; // [s]
+        double max = 0; // [s]
+        std::uint64_t periodOverruns = 0; // samples longer than the period, for each pipeline stage
+    };
+
+    // State of the deadline-aware mode, enabled by the DEADLINE options group, which is rejected
+    // together with the pipelined estimation.
+    // Under overload the estimation steps down through the quality tiers:
+    // full, reuse_factorization, reuse_matrices, publish_stale.
+    struct DeadlineStatistics
+    {
+        bool enabled = false;
+        double budget = 0; // [s]
+        unsigned currentTier = 0;
+        std::string currentTierName;
+        std::uint64_t overruns = 0; // ticks longer than the budget
+        std::uint64_t degradations = 0; // transitions to a lower tier
+        std::uint64_t recoveries = 0; // transitions to a higher tier
+        std::vector<std::uint64_t> ticksPerTier;
+    };
+
+    // Convergence of the conjugate gradient solver, with the iterative solver backend
+    struct IterativeSolverStatistics
+    {
+        bool enabled = false;
+        std::uint64_t solves = 0;
+        std::uint64_t lastIterations = 0;
+        std::uint64_t maxIterations = 0; // over all the solves
+        double lastRelativeResidual = 0; // ||r - P * d|| / ||r||
+    };
+
     HumanDynamicsEstimator();
     ~HumanDynamicsEstimator() override;
 
@@ -54,6 +108,111 @@ public:
     std::vector<std::string> getJointNames() const override;
     size_t getNumberOfJoints() const override;
     std::vector<double> getJointTorques() const override;
+
+    // Lock-free alternative to getJointTorques(), see SeqLockChannel. It reuses the memory of the
+    // passed snapshot and returns false if no estimate has been published yet.
+    bool getJointTorquesSnapshot(JointTorquesSnapshot& snapshot) const;
+
+    // The estimation computes only the expected value of the joint torques. Their posterior
+    // variances are computed on request, by selected inversion of the factorization of the next
+    // estimation step, then getJointTorquesVariances() returns the last computed ones or false if
+    // none has been computed yet. It is not supported by the iterative solver backend.
+    void requestJointTorquesVariances();
+    bool getJointTorquesVariances(std::vector<double>& variances) const;
+
+    // Latencies of the sections of the estimation loop recorded since the end of the warm-up.
+    // In pipelined mode tick is the acquisition done by the periodic thread and pipeline_latency
+    // the time from the acquisition to the publication of the estimate.
+    std::vector<StageLatency> getStageLatencies() const;
+
+    DeadlineStatistics getDeadlineStatistics() const;
+    IterativeSolverStatistics getIterativeSolverStatistics() const;
+
+    // Replace at runtime the prior covariance of a berdy sensor, identified by the sensor type
+    // name of the PRIORS group and by its id, or of the dynamic variables [offset, offset + size).
+    // The covariance contains either one value for all the variances, the variances or the full
+    // matrix in row-major order. The update is applied before the next estimation step without
+    // re-initializing the solver, then the new covariance must keep the sparsity pattern of the
+    // configured one (e.g. a diagonal prior can only be replaced by a diagonal one).
+    bool setSensorPriorCovariance(const std::string& sensorType,
+                                  const std::string& sensorId,
+                                  const std::vector<double>& covariance);
+    bool setDynamicVariablesPriorCovariance(size_t offset, size_t size, const std::vector<double>& covariance);
+
+    // Exclude a berdy sensor from the estimation, e.g. when its source drops out, or include it
+    // again. Its measurements get an infinite variance from the next estimation step, without
+    // rebuilding the model or the solver. The batch estimation excludes the sensors excluded
+    // when it starts. Removing the sensors permanently is still done with the SENSORS_REMOVAL group.
+    bool setSensorActive(const std::string& sensorType, const std::string& sensorId, bool active);
+
+    // JSON report with wall time and peak RSS of every phase of the last open(). With the
+    // asynchronous warm-up it waits for it, and reports its phases in "asynchronous_warm_up".
+    std::string getStartupReport() const;
+
+    // Offline estimation over a recorded trajectory, using the setup done in open().
+    // Every line of the input file contains, separated by spaces: time, joint positions,
+    // joint velocities, base angular velocity (3) and the values of the wrench sensors (6 each),
+    // and nothing else.
+    // Every line of the output file contains the time followed by the estimated joint torques.
+    // Contiguous chunks of samples are estimated in parallel by numberOfThreads workers, except
+    // with the RECURSIVE group, whose estimates are computed sequentially in time order.
+    bool runBatchEstimation(const std::string& inputFileName,
+                            const std::string& outputFileName,
+                            size_t numberOfThreads);
+
+    // Replay a recorded trajectory, in the format of runBatchEstimation(), through the estimation
+    // loop: every run() reads the next sample in place of the attached interfaces, and fails
+    // after the last one. It must be called after open() and before the loop is started.
+    bool replayRecordedInputs(const std::string& inputFileName);
+};
+
+namespace hde {
+    namespace interfaces {
+        class IHumanState;
+    } // namespace interfaces
+} // namespace hde
+
+namespace yarp {
+    namespace dev {
+        class IAnalogSensor;
+    } // namespace dev
+} // namespace yarp
+
+// Estimator of several subjects sharing the same model and configuration.
+// The model, the sensors ordering, the priors and the symbolic analysis of the solver are
+// built once in open() and shared read-only. Every subject owns only its state buffers,
+// the numeric factors of the solver and the channel publishing its joint torques.
+// The ticks of the subjects are executed in parallel by a fixed pool of threads.
+class hde::modules::MultiSubjectDynamicsEstimator final
+{
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl;
+
+public:
+    using JointTorquesSnapshot = HumanDynamicsEstimator::JointTorquesSnapshot;
+
+    MultiSubjectDynamicsEstimator();
+    ~MultiSubjectDynamicsEstimator();
+
+    // Same options of HumanDynamicsEstimator, plus 'number_of_threads' used for the ticks
+    bool open(yarp::os::Searchable& config);
+    bool close();
+
+    // Subjects can be added only when no tick is running
+    bool addSubject(hde::interfaces::IHumanState* iHumanState,
+                    yarp::dev::IAnalogSensor* iAnalogSensor,
+                    size_t& subjectIndex);
+    size_t getNumberOfSubjects() const;
+
+    // Estimates the joint torques of all the subjects. Returns false if any of them failed.
+    bool runTick();
+
+    // Same of HumanDynamicsEstimator::setSensorActive(), for the sensors of a single subject
+    bool setSensorActive(size_t subjectIndex, const std::string& sensorType, const std::string& sensorId, bool active);
+
+    std::vector<std::string> getJointNames() const;
+    bool getJointTorquesSnapshot(size_t subjectIndex, JointTorquesSnapshot& snapshot) const;
 };
 
 #endif // HDE_DEVICES_HUMANDYNAMICSESTIMATOR
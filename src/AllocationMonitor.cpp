@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#include "AllocationMonitor.h"
+
+#ifdef HDE_CHECK_STEADY_STATE_ALLOCATIONS
+
+#include <cerrno>
+#include <cstdlib>
+
+// The malloc family is replaced, instead of the global operator new, so that also the
+// allocations of Eigen and of the C library are counted. The allocations are forwarded to
+// the glibc allocator, the default operator new calls the replaced malloc.
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t number, std::size_t size);
+void* __libc_realloc(void* ptr, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace {
+    thread_local std::size_t numberOfHeapAllocations = 0;
+} // namespace
+
+std::size_t hde::utils::getNumberOfHeapAllocations()
+{
+    return numberOfHeapAllocations;
+}
+
+extern "C" {
+
+void* malloc(std::size_t size)
+{
+    ++numberOfHeapAllocations;
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t number, std::size_t size)
+{
+    ++numberOfHeapAllocations;
+    return __libc_calloc(number, size);
+}
+
+void* realloc(void* ptr, std::size_t size)
+{
+    ++numberOfHeapAllocations;
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(std::size_t alignment, std::size_t size)
+{
+    ++numberOfHeapAllocations;
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size)
+{
+    ++numberOfHeapAllocations;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, std::size_t alignment, std::size_t size)
+{
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    ++numberOfHeapAllocations;
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr || size == 0 ? 0 : ENOMEM;
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+} // extern "C"
+
+#else
+
+std::size_t hde::utils::getNumberOfHeapAllocations()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#include "EliminationTreeLDLT.h"
+#include "FixedThreadPool.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <utility>
+
+using namespace hde::estimation;
+
+// Subtrees per thread, more subtrees balance better the dynamic scheduling of the pool
+static constexpr double SubtreesPerThread = 4;
+
+bool EliminationTreeLDLT::analyzePattern(const SparseMatrix& upper, const std::size_t concurrency)
+{
+    m_isAnalyzed = false;
+    m_isFactorized = false;
+
+    const StorageIndex size = static_cast<StorageIndex>(upper.cols());
+    if (upper.rows() != upper.cols() || concurrency == 0) {
+        return false;
+    }
+
+    // Elimination tree and nonzeros of every column of L, visiting the row subtrees
+    m_parent.assign(size, -1);
+    m_flag.assign(size, -1);
+    m_columnNonZeros.assign(size, 0);
+    for (StorageIndex row = 0; row < size; ++row) {
+        m_flag[row] = row;
+        for (SparseMatrix::InnerIterator it(upper, row); it; ++it) {
+            for (StorageIndex i = static_cast<StorageIndex>(it.row()); i < row && m_flag[i] != row; i = m_parent[i]) {
+                if (m_parent[i] == -1) {
+                    m_parent[i] = row;
+                }
+                ++m_columnNonZeros[i];
+                m_flag[i] = row;
+            }
+        }
+    }
+
+    m_factor.resize(size, size);
+    StorageIndex* outer = m_factor.outerIndexPtr();
+    outer[0] = 0;
+    for (StorageIndex column = 0; column < size; ++column) {
+        outer[column + 1] = outer[column] + m_columnNonZeros[column];
+    }
+    m_factor.resizeNonZeros(outer[size]);
+
+    // Children of every node and cost of every subtree, the parents follow their children
+    std::vector<StorageIndex> childOffsets(size + 1, 0);
+    std::vector<double> subtreeCost(size);
+    for (StorageIndex node = 0; node < size; ++node) {
+        subtreeCost[node] += 1.0 + static_cast<double>(m_columnNonZeros[node]) * m_columnNonZeros[node];
+        if (m_parent[node] >= 0) {
+            ++childOffsets[m_parent[node] + 1];
+            subtreeCost[m_parent[node]] += subtreeCost[node];
+        }
+    }
+    std::partial_sum(childOffsets.begin(), childOffsets.end(), childOffsets.begin());
+
+    std::vector<StorageIndex> children(childOffsets[size]);
+    std::vector<StorageIndex> childPosition(childOffsets.begin(), childOffsets.end() - 1);
+    double totalCost = 0;
+    std::priority_queue<std::pair<double, StorageIndex>> subtrees;
+    for (StorageIndex node = 0; node < size; ++node) {
+        if (m_parent[node] >= 0) {
+            children[childPosition[m_parent[node]]++] = node;
+        }
+        else {
+            totalCost += subtreeCost[node];
+            subtrees.emplace(subtreeCost[node], node);
+        }
+    }
+
+    // Split the most expensive subtree until all of them are cheap enough
+    const double targetCost = totalCost / (SubtreesPerThread * concurrency);
+    m_separatorRows.clear();
+    while (!subtrees.empty() && subtrees.top().first > targetCost) {
+        const StorageIndex root = subtrees.top().second;
+        subtrees.pop();
+
+        m_separatorRows.push_back(root);
+        for (StorageIndex k = childOffsets[root]; k < childOffsets[root + 1]; ++k) {
+            subtrees.emplace(subtreeCost[children[k]], children[k]);
+        }
+    }
+    std::sort(m_separatorRows.begin(), m_separatorRows.end());
+
+    // Rows of every subtree, in decreasing order of cost
+    m_subtreeOffsets.assign(1, 0);
+    m_subtreeRows.clear();
+    while (!subtrees.empty()) {
+        const std::size_t begin = m_subtreeRows.size();
+        m_subtreeRows.push_back(subtrees.top().second);
+        subtrees.pop();
+
+        for (std::size_t k = begin; k < m_subtreeRows.size(); ++k) {
+            const StorageIndex node = m_subtreeRows[k];
+            m_subtreeRows.insert(
+                m_subtreeRows.end(), children.begin() + childOffsets[node], children.begin() + childOffsets[node + 1]);
+        }
+
+        std::sort(m_subtreeRows.begin() + begin, m_subtreeRows.end());
+        m_subtreeOffsets.push_back(static_cast<StorageIndex>(m_subtreeRows.size()));
+    }
+
+    m_diagonal.resize(size);
+    m_work.setZero(size);
+    m_pattern.resize(size);
+    m_isSubtreeFactorized.assign(numberOfSubtrees(), 0);
+
+    m_isAnalyzed = true;
+    return true;
+}
+
+bool EliminationTreeLDLT::factorizeRow(const SparseMatrix& upper,
+                                       const StorageIndex row,
+                                       StorageIndex* pattern,
+                                       const StorageIndex patternSize)
+{
+    const StorageIndex* outer = m_factor.outerIndexPtr();
+    StorageIndex* inner = m_factor.innerIndexPtr();
+    double* values = m_factor.valuePtr();
+
+    // Scatter the column of the upper part and find the nonzeros of the row of L, in
+    // topological order, on the paths of the elimination tree from them to the row
+    StorageIndex top = patternSize;
+    m_work[row] = 0;
+    m_flag[row] = row;
+    m_columnNonZeros[row] = 0;
+
+    for (SparseMatrix::InnerIterator it(upper, row); it; ++it) {
+        StorageIndex i = static_cast<StorageIndex>(it.row());
+        if (i > row) {
+            continue;
+        }
+
+        m_work[i] += it.value();
+        StorageIndex length = 0;
+        for (; m_flag[i] != row; i = m_parent[i]) {
+            pattern[length++] = i;
+            m_flag[i] = row;
+        }
+        while (length > 0) {
+            pattern[--top] = pattern[--length];
+        }
+    }
+
+    // Sparse triangular solve for the row of L and update of the diagonal
+    double diagonal = m_work[row];
+    m_work[row] = 0;
+    for (; top < patternSize; ++top) {
+        const StorageIndex column = pattern[top];
+        const double value = m_work[column];
+        m_work[column] = 0;
+
+        StorageIndex p = outer[column];
+        for (const StorageIndex end = outer[column] + m_columnNonZeros[column]; p < end; ++p) {
+            m_work[inner[p]] -= values[p] * value;
+        }
+
+        const double factorValue = value / m_diagonal[column];
+        diagonal -= factorValue * value;
+        inner[p] = row;
+        values[p] = factorValue;
+        ++m_columnNonZeros[column];
+    }
+
+    m_diagonal[row] = diagonal;
+    return diagonal > 0;
+}
+
+bool EliminationTreeLDLT::factorize(const SparseMatrix& upper, hde::utils::FixedThreadPool* threadPool)
+{
+    m_isFactorized = false;
+    if (!m_isAnalyzed || upper.cols() != static_cast<Eigen::Index>(m_parent.size())) {
+        return false;
+    }
+
+    // A failed factorization can leave values in the workspace
+    m_work.setZero();
+    std::fill(m_flag.begin(), m_flag.end(), -1);
+
+    // The nonzeros of a row never exceed the rows of its subtree, then every subtree uses the
+    // range of m_pattern at the same position of its rows in m_subtreeRows
+    const auto factorizeSubtree = [this, &upper](const std::size_t subtree) {
+        const StorageIndex begin = m_subtreeOffsets[subtree];
+        const StorageIndex end = m_subtreeOffsets[subtree + 1];
+
+        bool factorized = true;
+        for (StorageIndex k = begin; k < end && factorized; ++k) {
+            factorized = factorizeRow(upper, m_subtreeRows[k], m_pattern.data() + begin, end - begin);
+        }
+        m_isSubtreeFactorized[subtree] = factorized;
+    };
+
+    if (threadPool) {
+        threadPool->parallelFor(numberOfSubtrees(), factorizeSubtree);
+    }
+    else {
+        for (std::size_t subtree = 0; subtree < numberOfSubtrees(); ++subtree) {
+            factorizeSubtree(subtree);
+        }
+    }
+
+    if (std::find(m_isSubtreeFactorized.begin(), m_isSubtreeFactorized.end(), 0) != m_isSubtreeFactorized.end()) {
+        return false;
+    }
+
+    for (const StorageIndex row : m_separatorRows) {
+        if (!factorizeRow(upper, row, m_pattern.data(), static_cast<StorageIndex>(m_pattern.size()))) {
+            return false;
+        }
+    }
+
+    m_isFactorized = true;
+    return true;
+}
+
+void EliminationTreeLDLT::solveInPlace(Eigen::VectorXd& x) const
+{
+    const StorageIndex* outer = m_factor.outerIndexPtr();
+    const StorageIndex* inner = m_factor.innerIndexPtr();
+    const double* values = m_factor.valuePtr();
+    const StorageIndex size = static_cast<StorageIndex>(m_factor.cols());
+
+    for (StorageIndex column = 0; column < size; ++column) {
+        for (StorageIndex p = outer[column]; p < outer[column + 1]; ++p) {
+            x[inner[p]] -= values[p] * x[column];
+        }
+    }
+
+    x.array() /= m_diagonal.array();
+
+    for (StorageIndex column = size - 1; column >= 0; --column) {
+        for (StorageIndex p = outer[column]; p < outer[column + 1]; ++p) {
+            x[column] -= values[p] * x[inner[p]];
+        }
+    }
+}
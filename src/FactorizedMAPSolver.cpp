@@ -0,0 +1,1255 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#include "FactorizedMAPSolver.h"
+#include "FixedThreadPool.h"
+
+#include <Eigen/OrderingMethods>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace hde::estimation;
+
+constexpr double FactorizedMAPSolver::DefaultRefinementTolerance;
+constexpr std::size_t FactorizedMAPSolver::DefaultMaxRefinementSteps;
+constexpr double FactorizedMAPSolver::DefaultIterativeTolerance;
+constexpr std::size_t FactorizedMAPSolver::DefaultMaxIterations;
+constexpr double FactorizedMAPSolver::DefaultForgettingFactor;
+
+// Returns true if the matrix has all and only the diagonal elements, all positive
+static bool isPositiveDiagonal(const FactorizedMAPSolver::SparseMatrixRef& matrix)
+{
+    for (Eigen::Index column = 0; column < matrix.outerSize(); ++column) {
+        FactorizedMAPSolver::SparseMatrixRef::InnerIterator it(matrix, column);
+        if (!it || it.row() != column || !(it.value() > 0) || ++it) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Position of the row in the sorted column of the factor, -1 if it is not a nonzero
+template <typename LowerFactor>
+static Eigen::Index findInColumn(const LowerFactor& factor, const Eigen::Index row, const Eigen::Index column)
+{
+    const auto* first = factor.innerIndexPtr() + factor.outerIndexPtr()[column];
+    const auto* last = factor.innerIndexPtr() + factor.outerIndexPtr()[column + 1];
+    const auto* found = std::lower_bound(first, last, row);
+    return found != last && *found == row ? found - factor.innerIndexPtr() : -1;
+}
+
+// Selected inversion of L * D * L^T with the Takahashi recurrence: the entries of the inverse
+// in the pattern of the strictly lower L go to lowerValues, aligned with the nonzeros of L, and
+// its diagonal to diagonal. Only the columns from firstColumn on are computed, each of them
+// depends only on the columns that follow. The inner indices of L are sorted by construction.
+template <typename LowerFactor, typename FactorDiagonal>
+static void computeSelectedInverse(const LowerFactor& factor,
+                                   const FactorDiagonal& factorDiagonal,
+                                   const Eigen::Index firstColumn,
+                                   Eigen::VectorXd& lowerValues,
+                                   Eigen::VectorXd& diagonal)
+{
+    const auto* outer = factor.outerIndexPtr();
+    const auto* inner = factor.innerIndexPtr();
+    const auto* values = factor.valuePtr();
+
+    lowerValues.resize(factor.nonZeros());
+    diagonal.resize(factor.cols());
+
+    for (Eigen::Index column = factor.cols() - 1; column >= firstColumn; --column) {
+        // Z(i, j) = -sum_k Z(i, k) * L(k, j), over the nonzeros k of the column j
+        for (Eigen::Index p = outer[column]; p < outer[column + 1]; ++p) {
+            const Eigen::Index row = inner[p];
+            double sum = 0;
+            for (Eigen::Index q = outer[column]; q < outer[column + 1]; ++q) {
+                const Eigen::Index k = inner[q];
+                const double inverse = row == k ? diagonal[k]
+                                       : row > k ? lowerValues[findInColumn(factor, row, k)]
+                                                 : lowerValues[findInColumn(factor, k, row)];
+                sum += inverse * static_cast<double>(values[q]);
+            }
+            lowerValues[p] = -sum;
+        }
+
+        // Z(j, j) = 1 / D(j) - sum_k L(k, j) * Z(k, j)
+        double sum = 0;
+        for (Eigen::Index p = outer[column]; p < outer[column + 1]; ++p) {
+            sum += static_cast<double>(values[p]) * lowerValues[p];
+        }
+        diagonal[column] = 1 / static_cast<double>(factorDiagonal[column]) - sum;
+    }
+}
+
+bool FactorizedMAPSolver::computeInverse(const SparseMatrixRef& covariance, Precision& inverse)
+{
+    if (covariance.rows() != covariance.cols() || covariance.rows() == 0) {
+        return false;
+    }
+
+    inverse.isDiagonal = isPositiveDiagonal(covariance);
+
+    if (inverse.isDiagonal) {
+        inverse.diagonal.resize(covariance.rows());
+        inverse.matrix.resize(covariance.rows(), covariance.cols());
+        inverse.matrix.reserve(Eigen::VectorXi::Ones(covariance.cols()));
+        for (Eigen::Index i = 0; i < covariance.rows(); ++i) {
+            inverse.diagonal(i) = 1.0 / SparseMatrixRef::InnerIterator(covariance, i).value();
+            inverse.matrix.insert(i, i) = inverse.diagonal(i);
+        }
+        inverse.matrix.makeCompressed();
+        return true;
+    }
+
+    inverse.diagonal.resize(0);
+
+    Eigen::SimplicialLDLT<SparseMatrix> factorization(covariance);
+    if (factorization.info() != Eigen::Success) {
+        return false;
+    }
+
+    SparseMatrix identity(covariance.rows(), covariance.cols());
+    identity.setIdentity();
+
+    // For the (block) diagonal covariances used by BERDY the inverse keeps the same pattern
+    inverse.matrix = factorization.solve(identity);
+    inverse.matrix.prune(0.0);
+    inverse.matrix.makeCompressed();
+    return factorization.info() == Eigen::Success;
+}
+
+FactorizedMAPSolver::Setup& FactorizedMAPSolver::mutableSetup()
+{
+    // Copy on write: other solvers keep using the previous setup
+    if (m_setup.use_count() > 1) {
+        m_setup = std::make_shared<Setup>(*m_setup);
+    }
+    return *m_setup;
+}
+
+bool FactorizedMAPSolver::setDynamicsRegularizationPrior(const VectorRef& expectedValue,
+                                                         const SparseMatrixRef& covariance)
+{
+    Setup& setup = mutableSetup();
+
+    if (expectedValue.size() != covariance.rows()
+        || !computeInverse(covariance, setup.dynamicsRegularizationPrecision)) {
+        return false;
+    }
+
+    setup.dynamicsRegularizationExpectedValue = expectedValue;
+    setup.dynamicsRegularizationInformation = setup.dynamicsRegularizationPrecision.matrix * expectedValue;
+    setup.isAnalyzed = false;
+    return true;
+}
+
+bool FactorizedMAPSolver::setDynamicsConstraintsPriorCovariance(const SparseMatrixRef& covariance)
+{
+    Setup& setup = mutableSetup();
+    setup.isAnalyzed = false;
+    return computeInverse(covariance, setup.dynamicsConstraintsPrecision);
+}
+
+bool FactorizedMAPSolver::setMeasurementsPriorCovariance(const SparseMatrixRef& covariance)
+{
+    Setup& setup = mutableSetup();
+    setup.isAnalyzed = false;
+    return computeInverse(covariance, setup.measurementsPrecision);
+}
+
+bool FactorizedMAPSolver::setEliminationOrder(const EliminationOrder& order)
+{
+    std::vector<bool> isEliminated(order.size(), false);
+    for (const SparseMatrix::StorageIndex variable : order) {
+        if (variable < 0 || static_cast<std::size_t>(variable) >= order.size() || isEliminated[variable]) {
+            return false;
+        }
+        isEliminated[variable] = true;
+    }
+
+    Setup& setup = mutableSetup();
+    setup.eliminationOrder = order;
+    setup.isAnalyzed = false;
+    return true;
+}
+
+bool FactorizedMAPSolver::setMixedPrecision(const bool enabled,
+                                            const double tolerance,
+                                            const std::size_t maxRefinementSteps)
+{
+    if (!(tolerance > 0)) {
+        return false;
+    }
+
+    Setup& setup = mutableSetup();
+
+    // The single precision factors need their own analysis
+    if (setup.isMixedPrecision != enabled) {
+        setup.isAnalyzed = false;
+    }
+
+    setup.isMixedPrecision = enabled;
+    setup.refinementTolerance = tolerance;
+    setup.maxRefinementSteps = maxRefinementSteps;
+    return true;
+}
+
+bool FactorizedMAPSolver::setIterative(const bool enabled,
+                                       const std::vector<SparseMatrix::StorageIndex>& blockOfVariable,
+                                       const double tolerance,
+                                       const std::size_t maxIterations)
+{
+    if (!(tolerance > 0) || (enabled && blockOfVariable.empty())) {
+        return false;
+    }
+
+    // Variables grouped by block with a counting sort, the blocks are numbered from 0
+    std::vector<SparseMatrix::StorageIndex> blockOffsets(1, 0);
+    for (const SparseMatrix::StorageIndex block : blockOfVariable) {
+        if (block < 0) {
+            return false;
+        }
+        if (static_cast<std::size_t>(block) + 2 > blockOffsets.size()) {
+            blockOffsets.resize(block + 2, 0);
+        }
+        ++blockOffsets[block + 1];
+    }
+    for (std::size_t block = 1; block < blockOffsets.size(); ++block) {
+        blockOffsets[block] += blockOffsets[block - 1];
+    }
+
+    std::vector<SparseMatrix::StorageIndex> blockVariables(blockOfVariable.size());
+    std::vector<SparseMatrix::StorageIndex> indexInBlock(blockOfVariable.size());
+    std::vector<SparseMatrix::StorageIndex> blockEnds(blockOffsets.begin(), blockOffsets.end() - 1);
+    for (std::size_t variable = 0; variable < blockOfVariable.size(); ++variable) {
+        const SparseMatrix::StorageIndex block = blockOfVariable[variable];
+        indexInBlock[variable] = blockEnds[block] - blockOffsets[block];
+        blockVariables[blockEnds[block]++] = static_cast<SparseMatrix::StorageIndex>(variable);
+    }
+
+    Setup& setup = mutableSetup();
+    setup.isAnalyzed = setup.isAnalyzed && setup.isIterative == enabled;
+    setup.isIterative = enabled;
+    setup.iterativeTolerance = tolerance;
+    setup.maxIterations = maxIterations;
+    setup.blockOfVariable = blockOfVariable;
+    setup.indexInBlock = std::move(indexInBlock);
+    setup.blockOffsets = std::move(blockOffsets);
+    setup.blockVariables = std::move(blockVariables);
+    return true;
+}
+
+bool FactorizedMAPSolver::setRecursive(const bool enabled, const double forgettingFactor)
+{
+    if (!(forgettingFactor > 0 && forgettingFactor < 1)) {
+        return false;
+    }
+
+    // The pattern does not change, the analysis stays valid
+    Setup& setup = mutableSetup();
+    setup.isRecursive = enabled;
+    setup.forgettingFactor = forgettingFactor;
+
+    m_hasRecursivePrior = false;
+    return true;
+}
+
+bool FactorizedMAPSolver::setNumberOfThreads(const std::size_t numberOfThreads)
+{
+    if (numberOfThreads == 0) {
+        return false;
+    }
+
+    if (numberOfThreads == 1) {
+        m_threadPool.reset();
+    }
+    else if (!m_threadPool || m_threadPool->concurrency() != numberOfThreads) {
+        m_threadPool = std::make_shared<hde::utils::FixedThreadPool>(numberOfThreads - 1);
+    }
+
+    // The subtrees depend on the number of threads
+    m_hasFactorizationPattern = false;
+    m_isFactorized = false;
+    return true;
+}
+
+bool FactorizedMAPSolver::replaceDiagonalBlock(SparseMatrix& matrix,
+                                               const Eigen::Index offset,
+                                               const SparseMatrixRef& block)
+{
+    const Eigen::Index size = block.rows();
+
+    if (block.cols() != size || size == 0 || offset < 0 || offset + size > matrix.cols() || !matrix.isCompressed()) {
+        return false;
+    }
+
+    // Check the patterns before writing, so that a failure leaves the matrix unchanged
+    for (Eigen::Index j = 0; j < size; ++j) {
+        SparseMatrixRef::InnerIterator blockIt(block, j);
+
+        for (SparseMatrix::InnerIterator it(matrix, offset + j); it; ++it) {
+            if (it.row() < offset || it.row() >= offset + size) {
+                return false;
+            }
+            if (blockIt && blockIt.row() + offset == it.row()) {
+                ++blockIt;
+            }
+        }
+
+        // Nonzeros of the block not in the pattern of the matrix
+        if (blockIt) {
+            return false;
+        }
+    }
+
+    for (Eigen::Index j = 0; j < size; ++j) {
+        SparseMatrixRef::InnerIterator blockIt(block, j);
+
+        for (SparseMatrix::InnerIterator it(matrix, offset + j); it; ++it) {
+            if (blockIt && blockIt.row() + offset == it.row()) {
+                it.valueRef() = blockIt.value();
+                ++blockIt;
+            }
+            else {
+                it.valueRef() = 0;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool FactorizedMAPSolver::updatePrecisionBlock(Precision& precision,
+                                               const Eigen::Index offset,
+                                               const SparseMatrixRef& covariance)
+{
+    Precision blockPrecision;
+    if (!computeInverse(covariance, blockPrecision)) {
+        return false;
+    }
+
+    // A diagonal precision keeps using the fast path, then it accepts only diagonal updates
+    if (precision.isDiagonal && !blockPrecision.isDiagonal) {
+        return false;
+    }
+
+    if (!replaceDiagonalBlock(precision.matrix, offset, blockPrecision.matrix)) {
+        return false;
+    }
+
+    if (precision.isDiagonal) {
+        precision.diagonal.segment(offset, covariance.rows()) = blockPrecision.diagonal;
+    }
+    return true;
+}
+
+bool FactorizedMAPSolver::updateDynamicsRegularizationPriorCovariance(const Eigen::Index offset,
+                                                                      const SparseMatrixRef& covariance)
+{
+    Setup& setup = mutableSetup();
+
+    if (!updatePrecisionBlock(setup.dynamicsRegularizationPrecision, offset, covariance)) {
+        return false;
+    }
+
+    setup.dynamicsRegularizationInformation =
+        setup.dynamicsRegularizationPrecision.matrix * setup.dynamicsRegularizationExpectedValue;
+    return true;
+}
+
+bool FactorizedMAPSolver::updateMeasurementsPriorCovariance(const Eigen::Index offset,
+                                                            const SparseMatrixRef& covariance)
+{
+    return updatePrecisionBlock(mutableSetup().measurementsPrecision, offset, covariance);
+}
+
+// Returns true if the matrix has the given compressed pattern
+static bool hasPattern(const FactorizedMAPSolver::SparseMatrixRef& matrix,
+                       const std::vector<FactorizedMAPSolver::SparseMatrix::StorageIndex>& outerIndices,
+                       const std::vector<FactorizedMAPSolver::SparseMatrix::StorageIndex>& innerIndices)
+{
+    return static_cast<std::size_t>(matrix.outerSize() + 1) == outerIndices.size()
+           && static_cast<std::size_t>(matrix.nonZeros()) == innerIndices.size()
+           && std::equal(outerIndices.begin(), outerIndices.end(), matrix.outerIndexPtr())
+           && std::equal(innerIndices.begin(), innerIndices.end(), matrix.innerIndexPtr());
+}
+
+void FactorizedMAPSolver::enumerateProduct(const SparseMatrixRef& left,
+                                           const bool transposeLeft,
+                                           const SparseMatrixRef& right,
+                                           std::vector<ProductTerm>& terms,
+                                           std::vector<Eigen::Triplet<double, SparseMatrix::StorageIndex>>& coordinates)
+{
+    using StorageIndex = SparseMatrix::StorageIndex;
+
+    // Nonzeros of the left operand grouped by the index multiplying the rows of the right one,
+    // i.e. by column, or by row if transposed, with their position in the values
+    const Eigen::Index sharedSize = transposeLeft ? left.rows() : left.cols();
+    std::vector<StorageIndex> sharedOuter(sharedSize + 1, 0);
+    std::vector<StorageIndex> sharedRows(left.nonZeros());
+    std::vector<StorageIndex> sharedPositions(left.nonZeros());
+
+    const StorageIndex* leftOuter = left.outerIndexPtr();
+    const StorageIndex* leftInner = left.innerIndexPtr();
+    for (Eigen::Index column = 0; column < left.outerSize(); ++column) {
+        for (StorageIndex p = leftOuter[column]; p < leftOuter[column + 1]; ++p) {
+            ++sharedOuter[(transposeLeft ? leftInner[p] : column) + 1];
+        }
+    }
+    for (Eigen::Index k = 0; k < sharedSize; ++k) {
+        sharedOuter[k + 1] += sharedOuter[k];
+    }
+    std::vector<StorageIndex> sharedEnds(sharedOuter.begin(), sharedOuter.end() - 1);
+    for (Eigen::Index column = 0; column < left.outerSize(); ++column) {
+        for (StorageIndex p = leftOuter[column]; p < leftOuter[column + 1]; ++p) {
+            const StorageIndex shared = transposeLeft ? leftInner[p] : static_cast<StorageIndex>(column);
+            sharedRows[sharedEnds[shared]] = transposeLeft ? static_cast<StorageIndex>(column) : leftInner[p];
+            sharedPositions[sharedEnds[shared]++] = p;
+        }
+    }
+
+    // (left * right)(i, j) = sum_k left(i, k) * right(k, j)
+    const StorageIndex* rightOuter = right.outerIndexPtr();
+    const StorageIndex* rightInner = right.innerIndexPtr();
+    for (Eigen::Index column = 0; column < right.outerSize(); ++column) {
+        for (StorageIndex p = rightOuter[column]; p < rightOuter[column + 1]; ++p) {
+            const StorageIndex shared = rightInner[p];
+            for (StorageIndex q = sharedOuter[shared]; q < sharedOuter[shared + 1]; ++q) {
+                terms.push_back({sharedPositions[q], p, -1});
+                coordinates.emplace_back(sharedRows[q], static_cast<StorageIndex>(column), 0.0);
+            }
+        }
+    }
+}
+
+void FactorizedMAPSolver::locateProduct(
+    const SparseMatrix& result,
+    const std::vector<Eigen::Triplet<double, SparseMatrix::StorageIndex>>& coordinates,
+    std::vector<ProductTerm>& terms)
+{
+    // The coordinates of the terms follow the ones of the entries added before them
+    const std::size_t firstCoordinate = coordinates.size() - terms.size();
+    for (std::size_t k = 0; k < terms.size(); ++k) {
+        const Eigen::Triplet<double, SparseMatrix::StorageIndex>& coordinate = coordinates[firstCoordinate + k];
+        terms[k].result =
+            static_cast<SparseMatrix::StorageIndex>(findInColumn(result, coordinate.row(), coordinate.col()));
+    }
+}
+
+void FactorizedMAPSolver::accumulateProduct(const std::vector<ProductTerm>& terms,
+                                            const double* left,
+                                            const double* right,
+                                            double* result)
+{
+    for (const ProductTerm& term : terms) {
+        result[term.result] += left[term.left] * right[term.right];
+    }
+}
+
+void FactorizedMAPSolver::buildWeightedPlan(const SparseMatrixRef& matrix,
+                                            const Precision& precision,
+                                            std::vector<ProductTerm>& terms,
+                                            SparseMatrix& weighted)
+{
+    terms.clear();
+
+    // A diagonal precision scales the rows, keeping the pattern of the input
+    if (precision.isDiagonal) {
+        weighted = matrix;
+        return;
+    }
+
+    std::vector<Eigen::Triplet<double, SparseMatrix::StorageIndex>> coordinates;
+    enumerateProduct(precision.matrix, false, matrix, terms, coordinates);
+    weighted.resize(matrix.rows(), matrix.cols());
+    weighted.setFromTriplets(coordinates.begin(), coordinates.end());
+    weighted.makeCompressed();
+    locateProduct(weighted, coordinates, terms);
+}
+
+void FactorizedMAPSolver::weightRows(const SparseMatrixRef& matrix,
+                                     const Precision& precision,
+                                     const std::vector<ProductTerm>& terms,
+                                     SparseMatrix& weighted)
+{
+    Eigen::Map<Eigen::VectorXd> weightedValues(weighted.valuePtr(), weighted.nonZeros());
+
+    if (!precision.isDiagonal) {
+        weightedValues.setZero();
+        accumulateProduct(terms, precision.matrix.valuePtr(), matrix.valuePtr(), weighted.valuePtr());
+        return;
+    }
+
+    const SparseMatrix::StorageIndex* rows = matrix.innerIndexPtr();
+    const double* values = matrix.valuePtr();
+    const double* weights = precision.diagonal.data();
+
+    for (Eigen::Index k = 0; k < matrix.nonZeros(); ++k) {
+        weightedValues[k] = values[k] * weights[rows[k]];
+    }
+}
+
+void FactorizedMAPSolver::buildAssemblyPlan(const SparseMatrixRef& D, const SparseMatrixRef& Y)
+{
+    const Setup& setup = *m_setup;
+    AssemblyPlan& plan = m_assemblyPlan;
+
+    plan.constraintsOuterIndices.assign(D.outerIndexPtr(), D.outerIndexPtr() + D.outerSize() + 1);
+    plan.constraintsInnerIndices.assign(D.innerIndexPtr(), D.innerIndexPtr() + D.nonZeros());
+    plan.measurementsOuterIndices.assign(Y.outerIndexPtr(), Y.outerIndexPtr() + Y.outerSize() + 1);
+    plan.measurementsInnerIndices.assign(Y.innerIndexPtr(), Y.innerIndexPtr() + Y.nonZeros());
+
+    buildWeightedPlan(D, setup.dynamicsConstraintsPrecision, plan.weightedConstraintsTerms, m_weightedD);
+    buildWeightedPlan(Y, setup.measurementsPrecision, plan.weightedMeasurementsTerms, m_weightedY);
+
+    // Pattern of P: the union of the patterns of the three terms
+    const SparseMatrix& regularization = setup.dynamicsRegularizationPrecision.matrix;
+    std::vector<Eigen::Triplet<double, SparseMatrix::StorageIndex>> coordinates;
+    for (Eigen::Index column = 0; column < regularization.outerSize(); ++column) {
+        for (SparseMatrix::InnerIterator it(regularization, column); it; ++it) {
+            coordinates.emplace_back(it.row(), it.col(), 0.0);
+        }
+    }
+    const std::size_t nrOfRegularizationEntries = coordinates.size();
+
+    plan.constraintsTerms.clear();
+    enumerateProduct(D, true, m_weightedD, plan.constraintsTerms, coordinates);
+    const std::size_t nrOfConstraintsEntries = coordinates.size();
+
+    plan.measurementsTerms.clear();
+    enumerateProduct(Y, true, m_weightedY, plan.measurementsTerms, coordinates);
+
+    m_precision.resize(regularization.rows(), regularization.cols());
+    m_precision.setFromTriplets(coordinates.begin(), coordinates.end());
+    m_precision.makeCompressed();
+
+    plan.regularizationPositions.resize(nrOfRegularizationEntries);
+    for (std::size_t k = 0; k < nrOfRegularizationEntries; ++k) {
+        plan.regularizationPositions[k] = static_cast<SparseMatrix::StorageIndex>(
+            findInColumn(m_precision, coordinates[k].row(), coordinates[k].col()));
+    }
+    locateProduct(m_precision, coordinates, plan.measurementsTerms);
+    coordinates.resize(nrOfConstraintsEntries);
+    locateProduct(m_precision, coordinates, plan.constraintsTerms);
+
+    plan.isValid = true;
+}
+
+bool FactorizedMAPSolver::assemblePrecision(const SparseMatrixRef& D, const SparseMatrixRef& Y)
+{
+    if (!D.isCompressed() || !Y.isCompressed()) {
+        return false;
+    }
+
+    AssemblyPlan& plan = m_assemblyPlan;
+    if (!plan.isValid || !hasPattern(D, plan.constraintsOuterIndices, plan.constraintsInnerIndices)
+        || !hasPattern(Y, plan.measurementsOuterIndices, plan.measurementsInnerIndices)) {
+        buildAssemblyPlan(D, Y);
+    }
+
+    const Setup& setup = *m_setup;
+    weightRows(D, setup.dynamicsConstraintsPrecision, plan.weightedConstraintsTerms, m_weightedD);
+    weightRows(Y, setup.measurementsPrecision, plan.weightedMeasurementsTerms, m_weightedY);
+
+    // Zero weight for the masked rows, keeping them in the pattern
+    if (m_numberOfMaskedMeasurements > 0) {
+        const SparseMatrix::StorageIndex* rows = m_weightedY.innerIndexPtr();
+        double* values = m_weightedY.valuePtr();
+
+        for (Eigen::Index k = 0; k < m_weightedY.nonZeros(); ++k) {
+            values[k] *= m_measurementsMask(rows[k]);
+        }
+    }
+
+    double* precisionValues = m_precision.valuePtr();
+    Eigen::Map<Eigen::VectorXd>(precisionValues, m_precision.nonZeros()).setZero();
+
+    const double* regularizationValues = setup.dynamicsRegularizationPrecision.matrix.valuePtr();
+    for (std::size_t k = 0; k < plan.regularizationPositions.size(); ++k) {
+        precisionValues[plan.regularizationPositions[k]] += regularizationValues[k];
+    }
+    accumulateProduct(plan.constraintsTerms, D.valuePtr(), m_weightedD.valuePtr(), precisionValues);
+    accumulateProduct(plan.measurementsTerms, Y.valuePtr(), m_weightedY.valuePtr(), precisionValues);
+    return true;
+}
+
+void FactorizedMAPSolver::resizeBuffers()
+{
+    const Setup& setup = *m_setup;
+    const Eigen::Index nrOfDynamicVariables = setup.dynamicsRegularizationPrecision.matrix.rows();
+
+    m_informationVector.resize(nrOfDynamicVariables);
+    m_permutedInformationVector.resize(nrOfDynamicVariables);
+    m_permutedSolution.resize(nrOfDynamicVariables);
+    m_measurementsResidual.resize(setup.measurementsPrecision.matrix.rows());
+    m_weightedMeasurementsResidual.resize(setup.measurementsPrecision.matrix.rows());
+    m_weightedConstraintsBias.resize(setup.dynamicsConstraintsPrecision.matrix.rows());
+    m_estimate.setZero(nrOfDynamicVariables);
+    resizeMeasurementsMask(setup.measurementsPrecision.matrix.rows());
+    m_hasRecursivePrior = false;
+
+    if (setup.isIterative) {
+        m_cgResidual.resize(nrOfDynamicVariables);
+        m_cgPreconditionedResidual.resize(nrOfDynamicVariables);
+        m_cgDirection.resize(nrOfDynamicVariables);
+        m_cgProduct.resize(nrOfDynamicVariables);
+    }
+
+    if (setup.isMixedPrecision) {
+        m_refinementResidual.resize(nrOfDynamicVariables);
+        m_singleResidual.resize(nrOfDynamicVariables);
+        m_singleCorrection.resize(nrOfDynamicVariables);
+    }
+}
+
+void FactorizedMAPSolver::resizeMeasurementsMask(const Eigen::Index nrOfMeasurements)
+{
+    // The mask of the same measurements survives a new analysis
+    if (m_measurementsMask.size() != nrOfMeasurements) {
+        m_measurementsMask.setOnes(nrOfMeasurements);
+        m_numberOfMaskedMeasurements = 0;
+    }
+}
+
+bool FactorizedMAPSolver::setMeasurementsActive(const Eigen::Index offset, const Eigen::Index size, const bool active)
+{
+    if (offset < 0 || size < 0 || offset + size > m_measurementsMask.size()) {
+        return false;
+    }
+
+    const double weight = active ? 1.0 : 0.0;
+    for (Eigen::Index i = offset; i < offset + size; ++i) {
+        if (m_measurementsMask(i) != weight) {
+            m_measurementsMask(i) = weight;
+            m_numberOfMaskedMeasurements += active ? -1 : 1;
+        }
+    }
+
+    return true;
+}
+
+bool FactorizedMAPSolver::hasAnalyzedPattern(const SparseMatrix& matrix) const
+{
+    const Setup& setup = *m_setup;
+
+    if (!setup.isAnalyzed || !matrix.isCompressed()
+        || static_cast<std::size_t>(matrix.outerSize() + 1) != setup.analyzedOuterIndices.size()
+        || static_cast<std::size_t>(matrix.nonZeros()) != setup.analyzedInnerIndices.size()) {
+        return false;
+    }
+
+    return std::equal(setup.analyzedOuterIndices.begin(), setup.analyzedOuterIndices.end(), matrix.outerIndexPtr())
+           && std::equal(setup.analyzedInnerIndices.begin(), setup.analyzedInnerIndices.end(), matrix.innerIndexPtr());
+}
+
+bool FactorizedMAPSolver::analyzeAssembledPattern()
+{
+    Setup& setup = mutableSetup();
+    m_precision.makeCompressed();
+
+    if (setup.isIterative) {
+        // The conjugate gradient needs no ordering
+        setup.inversePermutation.resize(0);
+    }
+    else if (setup.eliminationOrder.empty()) {
+        // Fill-reducing ordering computed on the full symmetric pattern
+        Eigen::AMDOrdering<SparseMatrix::StorageIndex> ordering;
+        ordering(m_precision, setup.inversePermutation);
+    }
+    else {
+        if (static_cast<Eigen::Index>(setup.eliminationOrder.size()) != m_precision.cols()) {
+            return false;
+        }
+
+        // The k-th eliminated variable goes to the k-th row of the permuted system
+        setup.inversePermutation.resize(m_precision.cols());
+        std::copy(setup.eliminationOrder.begin(),
+                  setup.eliminationOrder.end(),
+                  setup.inversePermutation.indices().data());
+    }
+    setup.permutation = setup.inversePermutation.inverse();
+
+    setup.analyzedOuterIndices.assign(m_precision.outerIndexPtr(),
+                                      m_precision.outerIndexPtr() + m_precision.outerSize() + 1);
+    setup.analyzedInnerIndices.assign(m_precision.innerIndexPtr(),
+                                      m_precision.innerIndexPtr() + m_precision.nonZeros());
+    setup.isAnalyzed = true;
+
+    ++m_numberOfSymbolicAnalyses;
+    return analyzeFactorizationPattern();
+}
+
+void FactorizedMAPSolver::analyzePermutedPattern()
+{
+    const Permutation& permutation = m_setup->permutation;
+
+    // The permutation allocates its result, then it is done once and replayed as a scatter
+    m_permutedPrecision.selfadjointView<Eigen::Upper>() =
+        m_precision.selfadjointView<Eigen::Lower>().twistedBy(permutation);
+
+    // The permuted matrix has unsorted inner indices, its columns are searched linearly
+    m_permutedPositions.assign(m_precision.nonZeros(), -1);
+    const SparseMatrix::StorageIndex* permutedOuter = m_permutedPrecision.outerIndexPtr();
+    const SparseMatrix::StorageIndex* permutedInner = m_permutedPrecision.innerIndexPtr();
+
+    for (Eigen::Index column = 0; column < m_precision.outerSize(); ++column) {
+        for (Eigen::Index p = m_precision.outerIndexPtr()[column]; p < m_precision.outerIndexPtr()[column + 1]; ++p) {
+            const Eigen::Index row = m_precision.innerIndexPtr()[p];
+            if (row < column) {
+                continue;
+            }
+
+            const Eigen::Index first = permutation.indices()[row];
+            const Eigen::Index second = permutation.indices()[column];
+            const Eigen::Index permutedRow = std::min(first, second);
+            const Eigen::Index permutedColumn = first + second - permutedRow;
+
+            const SparseMatrix::StorageIndex* begin = permutedInner + permutedOuter[permutedColumn];
+            const SparseMatrix::StorageIndex* end = permutedInner + permutedOuter[permutedColumn + 1];
+            m_permutedPositions[p] =
+                static_cast<SparseMatrix::StorageIndex>(std::find(begin, end, permutedRow) - permutedInner);
+        }
+    }
+}
+
+void FactorizedMAPSolver::permuteAssembledPrecision()
+{
+    // Same pattern of the analysis, every nonzero of the lower triangular part of P is copied
+    const double* values = m_precision.valuePtr();
+    double* permutedValues = m_permutedPrecision.valuePtr();
+
+    for (std::size_t k = 0; k < m_permutedPositions.size(); ++k) {
+        if (m_permutedPositions[k] >= 0) {
+            permutedValues[m_permutedPositions[k]] = values[k];
+        }
+    }
+}
+
+bool FactorizedMAPSolver::analyzeFactorizationPattern()
+{
+    m_isFactorized = false;
+    m_isSingleFactorized = false;
+    m_isTreeFactorization = false;
+
+    if (m_setup->isIterative) {
+        m_hasFactorizationPattern = resizePreconditioner();
+        return m_hasFactorizationPattern;
+    }
+
+    // Elimination tree and column counts of the already permuted matrix. The factorization over
+    // the subtrees is used only with more than one thread.
+    m_isTreeFactorization = m_threadPool && !m_setup->isMixedPrecision;
+    analyzePermutedPattern();
+
+    if (m_isTreeFactorization) {
+        m_hasFactorizationPattern =
+            m_treeFactorization.analyzePattern(m_permutedPrecision, m_threadPool ? m_threadPool->concurrency() : 1);
+        return m_hasFactorizationPattern;
+    }
+
+    m_factorization.analyzePattern(m_permutedPrecision);
+    m_hasFactorizationPattern = m_factorization.info() == Eigen::Success;
+
+    // The double precision analysis is kept for the fallback
+    if (m_hasFactorizationPattern && m_setup->isMixedPrecision) {
+        // Copied as is: the permuted matrix has unsorted inner indices, that cast() rejects
+        m_singlePermutedPrecision.resize(m_permutedPrecision.rows(), m_permutedPrecision.cols());
+        m_singlePermutedPrecision.resizeNonZeros(m_permutedPrecision.nonZeros());
+        std::copy_n(m_permutedPrecision.outerIndexPtr(),
+                    m_permutedPrecision.outerSize() + 1,
+                    m_singlePermutedPrecision.outerIndexPtr());
+        std::copy_n(m_permutedPrecision.innerIndexPtr(),
+                    m_permutedPrecision.nonZeros(),
+                    m_singlePermutedPrecision.innerIndexPtr());
+        std::copy_n(m_permutedPrecision.valuePtr(),
+                    m_permutedPrecision.nonZeros(),
+                    m_singlePermutedPrecision.valuePtr());
+        m_singleFactorization.analyzePattern(m_singlePermutedPrecision);
+        m_hasFactorizationPattern = m_singleFactorization.info() == Eigen::Success;
+    }
+
+    return m_hasFactorizationPattern;
+}
+
+bool FactorizedMAPSolver::analyzePattern(const SparseMatrixRef& D, const SparseMatrixRef& Y)
+{
+    const Eigen::Index nrOfDynamicVariables = m_setup->dynamicsRegularizationPrecision.matrix.rows();
+
+    if (nrOfDynamicVariables == 0 || D.cols() != nrOfDynamicVariables || Y.cols() != nrOfDynamicVariables
+        || D.rows() != m_setup->dynamicsConstraintsPrecision.matrix.rows()
+        || Y.rows() != m_setup->measurementsPrecision.matrix.rows()) {
+        return false;
+    }
+
+    // The priors may have a new pattern
+    resizeBuffers();
+    m_assemblyPlan.isValid = false;
+    return assemblePrecision(D, Y) && analyzeAssembledPattern();
+}
+
+bool FactorizedMAPSolver::computePrecision(const SparseMatrixRef& D, const SparseMatrixRef& Y, SparseMatrix& precision)
+{
+    const Eigen::Index nrOfDynamicVariables = m_setup->dynamicsRegularizationPrecision.matrix.rows();
+
+    if (nrOfDynamicVariables == 0 || D.cols() != nrOfDynamicVariables || Y.cols() != nrOfDynamicVariables
+        || D.rows() != m_setup->dynamicsConstraintsPrecision.matrix.rows()
+        || Y.rows() != m_setup->measurementsPrecision.matrix.rows()) {
+        return false;
+    }
+
+    resizeMeasurementsMask(Y.rows());
+    m_assemblyPlan.isValid = false;
+    if (!assemblePrecision(D, Y)) {
+        return false;
+    }
+    precision = m_precision;
+    precision.makeCompressed();
+    return true;
+}
+
+bool FactorizedMAPSolver::shareSetup(const FactorizedMAPSolver& other)
+{
+    if (!other.isAnalyzed()) {
+        return false;
+    }
+
+    m_setup = other.m_setup;
+    resizeBuffers();
+    m_assemblyPlan.isValid = false;
+
+    // The factorization pattern is computed from the first assembled matrix
+    m_hasFactorizationPattern = false;
+    m_isFactorized = false;
+    return true;
+}
+
+bool FactorizedMAPSolver::doEstimate(const SparseMatrixRef& D,
+                                     const VectorRef& bD,
+                                     const SparseMatrixRef& Y,
+                                     const VectorRef& bY,
+                                     const VectorRef& measurements)
+{
+    if (!isAnalyzed() && !analyzePattern(D, Y)) {
+        return false;
+    }
+
+    if (bD.size() != D.rows() || bY.size() != Y.rows() || measurements.size() != Y.rows()) {
+        return false;
+    }
+
+    if (!assemblePrecision(D, Y)) {
+        return false;
+    }
+
+    // The information of the previous estimates is added only to a system with the same pattern
+    const bool isPatternAnalyzed = hasAnalyzedPattern(m_precision);
+    if (!isPatternAnalyzed) {
+        m_hasRecursivePrior = false;
+    }
+    else if (m_hasRecursivePrior) {
+        Eigen::Map<Eigen::VectorXd>(m_precision.valuePtr(), m_precision.nonZeros()) +=
+            m_setup->forgettingFactor * m_recursivePrecision;
+    }
+
+    if (!isPatternAnalyzed) {
+        if (!analyzeAssembledPattern()) {
+            return false;
+        }
+    }
+    else if (!m_hasFactorizationPattern) {
+        if (!analyzeFactorizationPattern()) {
+            return false;
+        }
+    }
+    else if (!m_setup->isIterative) {
+        permuteAssembledPrecision();
+    }
+
+    bool estimated = false;
+    if (m_setup->isIterative) {
+        m_isFactorized = computePreconditioner();
+        estimated = m_isFactorized && solveIterative(D, bD, Y, bY, measurements);
+    }
+    else if (factorize(m_setup->isMixedPrecision) && solveFactorized(D, bD, Y, bY, measurements)) {
+        estimated = true;
+    }
+    else if (m_isSingleFactorized) {
+        // The single precision factors are not accurate enough for this system
+        ++m_numberOfDoublePrecisionFallbacks;
+        estimated = factorize(false) && solveFactorized(D, bD, Y, bY, measurements);
+    }
+
+    if (estimated) {
+        updateRecursivePrior(true);
+    }
+    return estimated;
+}
+
+void FactorizedMAPSolver::updateRecursivePrior(const bool hasNewPrecision)
+{
+    if (!m_setup->isRecursive) {
+        return;
+    }
+
+    // Information form of the estimate: P * d = r
+    if (hasNewPrecision) {
+        m_recursivePrecision = Eigen::Map<const Eigen::VectorXd>(m_precision.valuePtr(), m_precision.nonZeros());
+        m_hasRecursivePrior = true;
+    }
+    if (m_hasRecursivePrior) {
+        m_recursiveInformation = m_informationVector;
+    }
+}
+
+bool FactorizedMAPSolver::factorize(const bool singlePrecision)
+{
+    if (m_isTreeFactorization) {
+        m_isFactorized = m_treeFactorization.factorize(m_permutedPrecision, m_threadPool.get());
+        return m_isFactorized;
+    }
+
+    if (!singlePrecision) {
+        m_factorization.factorize(m_permutedPrecision);
+        m_isSingleFactorized = false;
+        m_isFactorized = m_factorization.info() == Eigen::Success;
+        return m_isFactorized;
+    }
+
+    // Same pattern of the analysis, only the values are converted
+    Eigen::Map<Eigen::VectorXf>(m_singlePermutedPrecision.valuePtr(), m_singlePermutedPrecision.nonZeros()) =
+        Eigen::Map<const Eigen::VectorXd>(m_permutedPrecision.valuePtr(), m_permutedPrecision.nonZeros())
+            .cast<float>();
+
+    // Frobenius norm of the symmetric matrix from its upper triangular part
+    double squaredNorm = 0;
+    for (Eigen::Index column = 0; column < m_permutedPrecision.outerSize(); ++column) {
+        for (SparseMatrix::InnerIterator it(m_permutedPrecision, column); it; ++it) {
+            squaredNorm += (it.row() == column ? 1 : 2) * it.value() * it.value();
+        }
+    }
+    m_permutedPrecisionNorm = std::sqrt(squaredNorm);
+
+    m_singleFactorization.factorize(m_singlePermutedPrecision);
+    m_isSingleFactorized = m_singleFactorization.info() == Eigen::Success;
+    m_isFactorized = m_isSingleFactorized;
+
+    if (!m_isSingleFactorized) {
+        ++m_numberOfDoublePrecisionFallbacks;
+        return factorize(false);
+    }
+    return true;
+}
+
+bool FactorizedMAPSolver::computePosteriorCovariance(const std::vector<VariablesPair>& entries,
+                                                     Eigen::VectorXd& values)
+{
+    if (!m_isFactorized || m_setup->isIterative) {
+        return false;
+    }
+
+    const Permutation& permutation = m_setup->permutation;
+    const Eigen::Index nrOfDynamicVariables = permutation.size();
+
+    // The recurrence starts from the last eliminated variable and stops at the first requested one
+    Eigen::Index firstColumn = nrOfDynamicVariables;
+    for (const VariablesPair& entry : entries) {
+        if (entry.first < 0 || entry.first >= nrOfDynamicVariables || entry.second < 0
+            || entry.second >= nrOfDynamicVariables) {
+            return false;
+        }
+        firstColumn = std::min<Eigen::Index>(
+            firstColumn, std::min(permutation.indices()[entry.first], permutation.indices()[entry.second]));
+    }
+
+    const auto selectEntries = [&](const auto& factor, const auto& factorDiagonal) {
+        computeSelectedInverse(factor, factorDiagonal, firstColumn, m_selectedInverse, m_selectedInverseDiagonal);
+
+        values.resize(entries.size());
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            const Eigen::Index first = permutation.indices()[entries[i].first];
+            const Eigen::Index second = permutation.indices()[entries[i].second];
+            if (first == second) {
+                values[i] = m_selectedInverseDiagonal[first];
+                continue;
+            }
+
+            const Eigen::Index position = findInColumn(factor, std::max(first, second), std::min(first, second));
+            if (position < 0) {
+                return false;
+            }
+            values[i] = m_selectedInverse[position];
+        }
+        return true;
+    };
+
+    if (m_isTreeFactorization) {
+        return selectEntries(m_treeFactorization.factor(), m_treeFactorization.diagonal());
+    }
+    if (m_isSingleFactorized) {
+        return selectEntries(m_singleFactorization.matrixL().nestedExpression(), m_singleFactorization.vectorD());
+    }
+    return selectEntries(m_factorization.matrixL().nestedExpression(), m_factorization.vectorD());
+}
+
+bool FactorizedMAPSolver::solveWithLastFactorization(const SparseMatrixRef& D,
+                                                     const VectorRef& bD,
+                                                     const SparseMatrixRef& Y,
+                                                     const VectorRef& bY,
+                                                     const VectorRef& measurements)
+{
+    if (!m_isFactorized || D.rows() != bD.size() || Y.rows() != bY.size() || measurements.size() != Y.rows()
+        || D.rows() != m_weightedConstraintsBias.size() || Y.rows() != m_measurementsResidual.size()
+        || D.cols() != m_informationVector.size() || Y.cols() != m_informationVector.size()) {
+        return false;
+    }
+
+    // The iterative solver reuses the last assembled P and its preconditioner
+    bool estimated = m_setup->isIterative ? solveIterative(D, bD, Y, bY, measurements)
+                                          : solveFactorized(D, bD, Y, bY, measurements);
+
+    // As in doEstimate(), the last assembled P is factorized again in double precision
+    if (!estimated && m_isSingleFactorized) {
+        ++m_numberOfDoublePrecisionFallbacks;
+        estimated = factorize(false) && solveFactorized(D, bD, Y, bY, measurements);
+    }
+
+    // The recursive precision of the last factorization is kept
+    if (estimated) {
+        updateRecursivePrior(false);
+    }
+    return estimated;
+}
+
+void FactorizedMAPSolver::solveSingleCorrection()
+{
+    // Correction of the residual stored in m_refinementResidual, in single precision. vectorD()
+    // returns a copy, solve() uses the factors in place.
+    m_singleResidual = m_refinementResidual.cast<float>();
+    m_singleCorrection = m_singleFactorization.solve(m_singleResidual);
+    m_permutedSolution += m_singleCorrection.cast<double>();
+}
+
+bool FactorizedMAPSolver::refineSolution()
+{
+    const Setup& setup = *m_setup;
+
+    m_permutedSolution.setZero();
+    m_refinementResidual = m_permutedInformationVector;
+    solveSingleCorrection();
+
+    for (m_numberOfRefinementSteps = 0;; ++m_numberOfRefinementSteps) {
+        // Residual of the double precision system. The upper triangular part is traversed
+        // explicitly, selfadjointView() products require sorted inner indices.
+        m_refinementResidual = m_permutedInformationVector;
+        for (Eigen::Index column = 0; column < m_permutedPrecision.outerSize(); ++column) {
+            for (SparseMatrix::InnerIterator it(m_permutedPrecision, column); it; ++it) {
+                m_refinementResidual(it.row()) -= it.value() * m_permutedSolution(column);
+                if (it.row() != column) {
+                    m_refinementResidual(column) -= it.value() * m_permutedSolution(it.row());
+                }
+            }
+        }
+
+        if (m_refinementResidual.norm()
+            <= setup.refinementTolerance * m_permutedPrecisionNorm * m_permutedSolution.norm()) {
+            return true;
+        }
+
+        if (m_numberOfRefinementSteps == setup.maxRefinementSteps || !m_permutedSolution.allFinite()) {
+            return false;
+        }
+
+        solveSingleCorrection();
+    }
+}
+
+void FactorizedMAPSolver::assembleInformationVector(const SparseMatrixRef& D,
+                                                    const VectorRef& bD,
+                                                    const SparseMatrixRef& Y,
+                                                    const VectorRef& bY,
+                                                    const VectorRef& measurements)
+{
+    const Setup& setup = *m_setup;
+
+    if (setup.dynamicsConstraintsPrecision.isDiagonal) {
+        m_weightedConstraintsBias = setup.dynamicsConstraintsPrecision.diagonal.cwiseProduct(bD);
+    }
+    else {
+        m_weightedConstraintsBias.noalias() = setup.dynamicsConstraintsPrecision.matrix * bD;
+    }
+
+    // The product with a full Sigma_y^-1 cannot be computed in place without a temporary
+    m_measurementsResidual = measurements - bY;
+    if (setup.measurementsPrecision.isDiagonal) {
+        m_weightedMeasurementsResidual = setup.measurementsPrecision.diagonal.cwiseProduct(m_measurementsResidual);
+    }
+    else {
+        m_weightedMeasurementsResidual.noalias() = setup.measurementsPrecision.matrix * m_measurementsResidual;
+    }
+    if (m_numberOfMaskedMeasurements > 0) {
+        m_weightedMeasurementsResidual.array() *= m_measurementsMask.array();
+    }
+
+    m_informationVector = setup.dynamicsRegularizationInformation;
+    m_informationVector.noalias() -= D.transpose() * m_weightedConstraintsBias;
+    m_informationVector.noalias() += Y.transpose() * m_weightedMeasurementsResidual;
+
+    if (m_hasRecursivePrior) {
+        m_informationVector += setup.forgettingFactor * m_recursiveInformation;
+    }
+}
+
+bool FactorizedMAPSolver::solveFactorized(const SparseMatrixRef& D,
+                                          const VectorRef& bD,
+                                          const SparseMatrixRef& Y,
+                                          const VectorRef& bY,
+                                          const VectorRef& measurements)
+{
+    const Setup& setup = *m_setup;
+    assembleInformationVector(D, bD, Y, bY, measurements);
+
+    // Solve in the permuted space and map the solution back
+    if (m_isSingleFactorized) {
+        m_permutedInformationVector = setup.permutation * m_informationVector;
+        if (!refineSolution()) {
+            return false;
+        }
+    }
+    else if (m_isTreeFactorization) {
+        m_permutedSolution = setup.permutation * m_informationVector;
+        m_treeFactorization.solveInPlace(m_permutedSolution);
+        m_numberOfRefinementSteps = 0;
+    }
+    else {
+        m_permutedInformationVector = setup.permutation * m_informationVector;
+        m_permutedSolution = m_factorization.solve(m_permutedInformationVector);
+        m_numberOfRefinementSteps = 0;
+    }
+
+    m_estimate = setup.inversePermutation * m_permutedSolution;
+    return true;
+}
+
+bool FactorizedMAPSolver::resizePreconditioner()
+{
+    const Setup& setup = *m_setup;
+
+    if (static_cast<Eigen::Index>(setup.blockOfVariable.size()) != m_estimate.size()) {
+        return false;
+    }
+
+    const std::size_t nrOfBlocks = setup.blockOffsets.size() - 1;
+    Eigen::Index maxBlockSize = 0;
+    m_preconditionerBlocks.resize(nrOfBlocks);
+    m_preconditionerFactors.resize(nrOfBlocks);
+    for (std::size_t block = 0; block < nrOfBlocks; ++block) {
+        const Eigen::Index blockSize = setup.blockOffsets[block + 1] - setup.blockOffsets[block];
+        m_preconditionerBlocks[block].resize(blockSize, blockSize);
+        m_preconditionerFactors[block] = Eigen::LLT<Eigen::MatrixXd>(blockSize);
+        maxBlockSize = std::max(maxBlockSize, blockSize);
+    }
+    m_blockBuffer.resize(maxBlockSize);
+    return true;
+}
+
+bool FactorizedMAPSolver::computePreconditioner()
+{
+    const Setup& setup = *m_setup;
+
+    for (Eigen::MatrixXd& block : m_preconditionerBlocks) {
+        block.setZero();
+    }
+
+    // Diagonal blocks of P, positive definite as P
+    for (Eigen::Index column = 0; column < m_precision.outerSize(); ++column) {
+        const SparseMatrix::StorageIndex block = setup.blockOfVariable[column];
+        for (SparseMatrix::InnerIterator it(m_precision, column); it; ++it) {
+            if (setup.blockOfVariable[it.row()] == block) {
+                m_preconditionerBlocks[block](setup.indexInBlock[it.row()], setup.indexInBlock[column]) = it.value();
+            }
+        }
+    }
+
+    for (std::size_t block = 0; block < m_preconditionerBlocks.size(); ++block) {
+        m_preconditionerFactors[block].compute(m_preconditionerBlocks[block]);
+        if (m_preconditionerFactors[block].info() != Eigen::Success) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FactorizedMAPSolver::applyPreconditioner()
+{
+    const Setup& setup = *m_setup;
+
+    // Gathers the residual of every block, solves with its factors and scatters the result
+    for (std::size_t block = 0; block < m_preconditionerFactors.size(); ++block) {
+        const SparseMatrix::StorageIndex* variables = setup.blockVariables.data() + setup.blockOffsets[block];
+        const Eigen::Index blockSize = setup.blockOffsets[block + 1] - setup.blockOffsets[block];
+        auto blockResidual = m_blockBuffer.head(blockSize);
+
+        for (Eigen::Index k = 0; k < blockSize; ++k) {
+            blockResidual(k) = m_cgResidual(variables[k]);
+        }
+        m_preconditionerFactors[block].solveInPlace(blockResidual);
+        for (Eigen::Index k = 0; k < blockSize; ++k) {
+            m_cgPreconditionedResidual(variables[k]) = blockResidual(k);
+        }
+    }
+}
+
+bool FactorizedMAPSolver::solveIterative(const SparseMatrixRef& D,
+                                         const VectorRef& bD,
+                                         const SparseMatrixRef& Y,
+                                         const VectorRef& bY,
+                                         const VectorRef& measurements)
+{
+    const Setup& setup = *m_setup;
+    assembleInformationVector(D, bD, Y, bY, measurements);
+
+    // Warm start from the last estimate
+    if (!m_estimate.allFinite()) {
+        m_estimate.setZero();
+    }
+
+    m_cgResidual = m_informationVector;
+    m_cgResidual.noalias() -= m_precision * m_estimate;
+    applyPreconditioner();
+    m_cgDirection = m_cgPreconditionedResidual;
+    double residualProduct = m_cgResidual.dot(m_cgPreconditionedResidual);
+
+    const double informationNorm = m_informationVector.norm();
+    m_numberOfIterations = 0;
+
+    // The relative residual is not defined, the solution is zero
+    if (informationNorm == 0) {
+        m_estimate.setZero();
+        m_iterativeRelativeResidual = 0;
+        return true;
+    }
+
+    while (m_cgResidual.norm() > setup.iterativeTolerance * informationNorm
+           && m_numberOfIterations < setup.maxIterations) {
+        m_cgProduct.noalias() = m_precision * m_cgDirection;
+        const double step = residualProduct / m_cgDirection.dot(m_cgProduct);
+
+        m_estimate += step * m_cgDirection;
+        m_cgResidual -= step * m_cgProduct;
+        applyPreconditioner();
+
+        const double previousResidualProduct = residualProduct;
+        residualProduct = m_cgResidual.dot(m_cgPreconditionedResidual);
+        m_cgDirection = m_cgPreconditionedResidual + (residualProduct / previousResidualProduct) * m_cgDirection;
+        ++m_numberOfIterations;
+    }
+
+    // The last iterate is kept as the start of the next solve also if it did not converge
+    m_iterativeRelativeResidual = m_cgResidual.norm() / informationNorm;
+    return m_estimate.allFinite() && m_iterativeRelativeResidual <= setup.iterativeTolerance;
+}
@@ -0,0 +1,509 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+// Unit tests of FactorizedMAPSolver on synthetic MAP problems, without a model
+
+#include "AllocationMonitor.h"
+#include "FactorizedMAPSolver.h"
+
+#include <iDynTree/Core/TestUtils.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/*
+ * Runtime replacement of a diagonal block of the prior covariances: the pattern must be kept,
+ * the values are overwritten in place and the estimate is the one of a solver configured with
+ * the updated covariance from the start, without a new symbolic analysis.
+ */
+void testPriorCovarianceUpdates()
+{
+    using hde::estimation::FactorizedMAPSolver;
+    using Triplet = Eigen::Triplet<double, FactorizedMAPSolver::SparseMatrix::StorageIndex>;
+
+    // Block diagonal matrix with the 2x2 blocks {0, 1} and {2, 3} and the 1x1 block {4}
+    const std::vector<Triplet> triplets = {
+        {0, 0, 4}, {1, 0, 1}, {0, 1, 1}, {1, 1, 4}, {2, 2, 5}, {3, 2, 2}, {2, 3, 2}, {3, 3, 5}, {4, 4, 3}};
+    FactorizedMAPSolver::SparseMatrix matrix(5, 5);
+    matrix.setFromTriplets(triplets.begin(), triplets.end());
+    matrix.makeCompressed();
+    const FactorizedMAPSolver::SparseMatrix original = matrix;
+
+    // The block {1, 2} couples two blocks of the matrix, the full block {3, 4} adds nonzeros
+    FactorizedMAPSolver::SparseMatrix block(2, 2);
+    block.setIdentity();
+    ASSERT_IS_TRUE(!FactorizedMAPSolver::replaceDiagonalBlock(matrix, 1, block));
+    FactorizedMAPSolver::SparseMatrix fullBlock = Eigen::MatrixXd::Constant(2, 2, 1.0).sparseView();
+    ASSERT_IS_TRUE(!FactorizedMAPSolver::replaceDiagonalBlock(matrix, 3, fullBlock));
+    ASSERT_IS_TRUE(!FactorizedMAPSolver::replaceDiagonalBlock(matrix, 4, block));
+    ASSERT_IS_TRUE((Eigen::MatrixXd(matrix) - Eigen::MatrixXd(original)).norm() == 0);
+
+    // A diagonal block in a full pattern zeroes the other nonzeros of the block, in place
+    const double* values = matrix.valuePtr();
+    block *= 7;
+    ASSERT_IS_TRUE(FactorizedMAPSolver::replaceDiagonalBlock(matrix, 2, block));
+    ASSERT_IS_TRUE(matrix.valuePtr() == values && matrix.nonZeros() == original.nonZeros());
+    Eigen::MatrixXd expected(original);
+    expected.block(2, 2, 2, 2) = 7 * Eigen::MatrixXd::Identity(2, 2);
+    ASSERT_IS_TRUE((Eigen::MatrixXd(matrix) - expected).norm() == 0);
+
+    // MAP problem with 5 variables, 2 constraints and 3 measurements
+    FactorizedMAPSolver::SparseMatrix D = Eigen::MatrixXd::Random(2, 5).sparseView();
+    FactorizedMAPSolver::SparseMatrix Y = Eigen::MatrixXd::Random(3, 5).sparseView();
+    D.makeCompressed();
+    Y.makeCompressed();
+    const Eigen::VectorXd bD = Eigen::VectorXd::Random(2);
+    const Eigen::VectorXd bY = Eigen::VectorXd::Random(3);
+    const Eigen::VectorXd y = Eigen::VectorXd::Random(3);
+    const Eigen::VectorXd mu_d = Eigen::VectorXd::Random(5);
+    FactorizedMAPSolver::SparseMatrix sigma_D(2, 2);
+    FactorizedMAPSolver::SparseMatrix sigma_y(3, 3);
+    sigma_D.setIdentity();
+    sigma_y.setIdentity();
+
+    // The expected value of the prior enters the information vector through the new precision
+    FactorizedMAPSolver updated;
+    bool ok = updated.setDynamicsRegularizationPrior(mu_d, original)
+              && updated.setDynamicsConstraintsPriorCovariance(sigma_D)
+              && updated.setMeasurementsPriorCovariance(sigma_y) && updated.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+    const std::size_t nrOfAnalyses = updated.numberOfSymbolicAnalyses();
+
+    FactorizedMAPSolver::SparseMatrix covarianceBlock(2, 2);
+    covarianceBlock.setIdentity();
+    covarianceBlock *= 0.5;
+    ok = updated.updateDynamicsRegularizationPriorCovariance(2, covarianceBlock)
+         && updated.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE(updated.numberOfSymbolicAnalyses() == nrOfAnalyses);
+    ASSERT_IS_TRUE(!updated.updateDynamicsRegularizationPriorCovariance(3, covarianceBlock));
+
+    FactorizedMAPSolver::SparseMatrix sigma_d = original;
+    ok = FactorizedMAPSolver::replaceDiagonalBlock(sigma_d, 2, covarianceBlock);
+    ASSERT_IS_TRUE(ok);
+    FactorizedMAPSolver reference;
+    ok = reference.setDynamicsRegularizationPrior(mu_d, sigma_d)
+         && reference.setDynamicsConstraintsPriorCovariance(sigma_D)
+         && reference.setMeasurementsPriorCovariance(sigma_y) && reference.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE((updated.lastEstimate() - reference.lastEstimate()).norm()
+                   <= 1e-12 * (1.0 + reference.lastEstimate().norm()));
+}
+
+void testMeasurementsMask()
+{
+    using hde::estimation::FactorizedMAPSolver;
+    using Triplet = Eigen::Triplet<double, FactorizedMAPSolver::SparseMatrix::StorageIndex>;
+
+    // MAP problem with 6 variables, 2 constraints and 5 measurements of two sensors, the
+    // correlated block {0, 1} and the block {2, 3, 4}
+    FactorizedMAPSolver::SparseMatrix D = Eigen::MatrixXd::Random(2, 6).sparseView();
+    FactorizedMAPSolver::SparseMatrix Y = Eigen::MatrixXd::Random(5, 6).sparseView();
+    D.makeCompressed();
+    Y.makeCompressed();
+    const Eigen::VectorXd bD = Eigen::VectorXd::Random(2);
+    const Eigen::VectorXd bY = Eigen::VectorXd::Random(5);
+    const Eigen::VectorXd y = Eigen::VectorXd::Random(5);
+    const Eigen::VectorXd mu_d = Eigen::VectorXd::Random(6);
+
+    FactorizedMAPSolver::SparseMatrix sigma_d(6, 6);
+    FactorizedMAPSolver::SparseMatrix sigma_D(2, 2);
+    sigma_d.setIdentity();
+    sigma_D.setIdentity();
+    sigma_D *= 1e-2;
+
+    const std::vector<Triplet> triplets = {
+        {0, 0, 2}, {1, 0, 0.5}, {0, 1, 0.5}, {1, 1, 1}, {2, 2, 3}, {3, 3, 3}, {4, 4, 3}};
+    FactorizedMAPSolver::SparseMatrix sigma_y(5, 5);
+    sigma_y.setFromTriplets(triplets.begin(), triplets.end());
+
+    FactorizedMAPSolver masked;
+    bool ok = masked.setDynamicsRegularizationPrior(mu_d, sigma_d)
+              && masked.setDynamicsConstraintsPriorCovariance(sigma_D)
+              && masked.setMeasurementsPriorCovariance(sigma_y) && masked.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+    const Eigen::VectorXd unmaskedEstimate = masked.lastEstimate();
+    const std::size_t nrOfAnalyses = masked.numberOfSymbolicAnalyses();
+
+    // Masking the first sensor is the same as removing its rows from Y, bY, y and sigma_y
+    ASSERT_IS_TRUE(!masked.setMeasurementsActive(4, 2, false));
+    ok = masked.setMeasurementsActive(0, 2, false) && masked.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE(masked.numberOfMaskedMeasurements() == 2);
+    ASSERT_IS_TRUE(masked.numberOfSymbolicAnalyses() == nrOfAnalyses);
+
+    FactorizedMAPSolver::SparseMatrix removedY = Y.bottomRows(3);
+    FactorizedMAPSolver::SparseMatrix removedSigma_y = sigma_y.bottomRightCorner(3, 3);
+    removedY.makeCompressed();
+    FactorizedMAPSolver removed;
+    ok = removed.setDynamicsRegularizationPrior(mu_d, sigma_d) && removed.setDynamicsConstraintsPriorCovariance(sigma_D)
+         && removed.setMeasurementsPriorCovariance(removedSigma_y)
+         && removed.doEstimate(D, bD, removedY, bY.tail(3), y.tail(3));
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE((masked.lastEstimate() - removed.lastEstimate()).norm()
+                   <= 1e-12 * (1.0 + removed.lastEstimate().norm()));
+
+    // The sensor included again gives back the unmasked estimate
+    ok = masked.setMeasurementsActive(0, 2, true) && masked.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE(masked.numberOfMaskedMeasurements() == 0);
+    ASSERT_IS_TRUE((masked.lastEstimate() - unmaskedEstimate).norm() <= 1e-12 * (1.0 + unmaskedEstimate.norm()));
+}
+
+void testMixedPrecision()
+{
+    using hde::estimation::FactorizedMAPSolver;
+
+    // Well conditioned MAP problem with 40 variables, 10 constraints and 30 measurements
+    const Eigen::MatrixXd denseD = Eigen::MatrixXd::Random(10, 40);
+    const Eigen::MatrixXd denseY = Eigen::MatrixXd::Random(30, 40);
+    FactorizedMAPSolver::SparseMatrix D = (denseD.array().abs() > 0.5).select(denseD, 0).sparseView();
+    FactorizedMAPSolver::SparseMatrix Y = (denseY.array().abs() > 0.5).select(denseY, 0).sparseView();
+    D.makeCompressed();
+    Y.makeCompressed();
+    const Eigen::VectorXd bD = Eigen::VectorXd::Random(10);
+    const Eigen::VectorXd bY = Eigen::VectorXd::Random(30);
+    const Eigen::VectorXd y = Eigen::VectorXd::Random(30);
+    const Eigen::VectorXd mu_d = Eigen::VectorXd::Random(40);
+
+    FactorizedMAPSolver::SparseMatrix sigma_d(40, 40);
+    FactorizedMAPSolver::SparseMatrix sigma_D(10, 10);
+    FactorizedMAPSolver::SparseMatrix sigma_y(30, 30);
+    sigma_d.setIdentity();
+    sigma_D.setIdentity();
+    sigma_y.setIdentity();
+
+    FactorizedMAPSolver reference, mixed;
+    for (FactorizedMAPSolver* solver : {&reference, &mixed}) {
+        const bool ok = solver->setDynamicsRegularizationPrior(mu_d, sigma_d)
+                        && solver->setDynamicsConstraintsPriorCovariance(sigma_D)
+                        && solver->setMeasurementsPriorCovariance(sigma_y);
+        ASSERT_IS_TRUE(ok);
+    }
+    bool ok = mixed.setMixedPrecision(true) && reference.doEstimate(D, bD, Y, bY, y)
+              && mixed.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+
+    // The single precision factors are refined to the double precision estimate
+    ASSERT_IS_TRUE(mixed.numberOfDoublePrecisionFallbacks() == 0);
+    ASSERT_IS_TRUE(mixed.numberOfRefinementSteps() >= 1
+                   && mixed.numberOfRefinementSteps() <= FactorizedMAPSolver::DefaultMaxRefinementSteps);
+    ASSERT_IS_TRUE((mixed.lastEstimate() - reference.lastEstimate()).norm()
+                   <= 1e-10 * (1.0 + reference.lastEstimate().norm()));
+
+    // With an unreachable tolerance the refinement of the last factorization does not converge,
+    // and the same system is factorized again in double precision
+    const Eigen::VectorXd updatedY = Eigen::VectorXd::Random(30);
+    ok = mixed.setMixedPrecision(true, 1e-30) && reference.solveWithLastFactorization(D, bD, Y, bY, updatedY)
+         && mixed.solveWithLastFactorization(D, bD, Y, bY, updatedY);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE(mixed.numberOfDoublePrecisionFallbacks() == 1);
+    ASSERT_IS_TRUE((mixed.lastEstimate() - reference.lastEstimate()).norm()
+                   <= 1e-12 * (1.0 + reference.lastEstimate().norm()));
+}
+
+/*
+ * Chains of blocks of 6 variables, like the links of a model, each one with 6 measurements and
+ * weakly coupled to the next one by 6 constraints. The conjugate gradient with the blocks as
+ * preconditioner gives the estimate of the factorization, with a number of iterations that does
+ * not grow with the length of the chain.
+ */
+void testIterativeSolver()
+{
+    using hde::estimation::FactorizedMAPSolver;
+    using Triplet = Eigen::Triplet<double, FactorizedMAPSolver::SparseMatrix::StorageIndex>;
+
+    const double tolerance = 1e-10;
+    std::vector<std::size_t> iterations;
+
+    for (const Eigen::Index nrOfBlocks : {10, 100, 1000}) {
+        const Eigen::Index nrOfVariables = 6 * nrOfBlocks;
+        const Eigen::Index nrOfConstraints = 6 * (nrOfBlocks - 1);
+
+        std::vector<Triplet> constraintsTriplets;
+        std::vector<Triplet> measurementsTriplets;
+        std::vector<FactorizedMAPSolver::SparseMatrix::StorageIndex> blockOfVariable(nrOfVariables);
+        for (Eigen::Index block = 0; block < nrOfBlocks; ++block) {
+            const Eigen::MatrixXd measurements = Eigen::MatrixXd::Random(6, 6);
+            const Eigen::MatrixXd coupling = Eigen::MatrixXd::Random(6, 12);
+            for (Eigen::Index i = 0; i < 6; ++i) {
+                blockOfVariable[6 * block + i] = static_cast<FactorizedMAPSolver::SparseMatrix::StorageIndex>(block);
+                for (Eigen::Index j = 0; j < 6; ++j) {
+                    measurementsTriplets.emplace_back(6 * block + i, 6 * block + j, measurements(i, j));
+                }
+                for (Eigen::Index j = 0; block + 1 < nrOfBlocks && j < 12; ++j) {
+                    constraintsTriplets.emplace_back(6 * block + i, 6 * block + j, coupling(i, j));
+                }
+            }
+        }
+
+        FactorizedMAPSolver::SparseMatrix D(nrOfConstraints, nrOfVariables);
+        FactorizedMAPSolver::SparseMatrix Y(nrOfVariables, nrOfVariables);
+        D.setFromTriplets(constraintsTriplets.begin(), constraintsTriplets.end());
+        Y.setFromTriplets(measurementsTriplets.begin(), measurementsTriplets.end());
+        const Eigen::VectorXd bD = Eigen::VectorXd::Random(nrOfConstraints);
+        const Eigen::VectorXd bY = Eigen::VectorXd::Random(nrOfVariables);
+        const Eigen::VectorXd y = Eigen::VectorXd::Random(nrOfVariables);
+        const Eigen::VectorXd mu_d = Eigen::VectorXd::Zero(nrOfVariables);
+
+        FactorizedMAPSolver::SparseMatrix sigma_d(nrOfVariables, nrOfVariables);
+        FactorizedMAPSolver::SparseMatrix sigma_D(nrOfConstraints, nrOfConstraints);
+        FactorizedMAPSolver::SparseMatrix sigma_y(nrOfVariables, nrOfVariables);
+        sigma_d.setIdentity();
+        sigma_D.setIdentity();
+        sigma_D *= 10;
+        sigma_y.setIdentity();
+
+        FactorizedMAPSolver direct, iterative;
+        for (FactorizedMAPSolver* solver : {&direct, &iterative}) {
+            const bool ok = solver->setDynamicsRegularizationPrior(mu_d, sigma_d)
+                            && solver->setDynamicsConstraintsPriorCovariance(sigma_D)
+                            && solver->setMeasurementsPriorCovariance(sigma_y);
+            ASSERT_IS_TRUE(ok);
+        }
+        bool ok = iterative.setIterative(true, blockOfVariable, tolerance) && direct.doEstimate(D, bD, Y, bY, y)
+                  && iterative.doEstimate(D, bD, Y, bY, y);
+        ASSERT_IS_TRUE(ok);
+        ASSERT_IS_TRUE(iterative.iterativeRelativeResidual() <= tolerance);
+        ASSERT_IS_TRUE((iterative.lastEstimate() - direct.lastEstimate()).norm()
+                       <= 1e-6 * (1.0 + direct.lastEstimate().norm()));
+        iterations.push_back(iterative.numberOfIterations());
+
+        // Not converging within the allowed iterations is a failure, from a cold start
+        FactorizedMAPSolver truncated;
+        ok = truncated.setDynamicsRegularizationPrior(mu_d, sigma_d)
+             && truncated.setDynamicsConstraintsPriorCovariance(sigma_D)
+             && truncated.setMeasurementsPriorCovariance(sigma_y)
+             && truncated.setIterative(true, blockOfVariable, tolerance, 1);
+        ASSERT_IS_TRUE(ok);
+        ASSERT_IS_TRUE(!truncated.doEstimate(D, bD, Y, bY, y));
+        ASSERT_IS_TRUE(truncated.numberOfIterations() == 1 && truncated.iterativeRelativeResidual() > tolerance);
+    }
+
+    std::cout << "Iterative solver iterations for 10, 100 and 1000 blocks: " << iterations[0] << " " << iterations[1]
+              << " " << iterations[2] << std::endl;
+    ASSERT_IS_TRUE(iterations.back() <= 2 * iterations.front());
+}
+
+/*
+ * Recursive estimation over a sequence of measurements, with Y changing values but not pattern:
+ * every estimate solves the information matrix and vector accumulated explicitly with the
+ * forgetting factor, P_k = alpha * P_k-1 + P and r_k = alpha * r_k-1 + r.
+ */
+void testRecursiveEstimation()
+{
+    using hde::estimation::FactorizedMAPSolver;
+
+    const double forgettingFactor = 0.7;
+
+    // MAP problem with 12 variables, 4 constraints and 8 measurements
+    const Eigen::MatrixXd denseD = Eigen::MatrixXd::Random(4, 12);
+    const Eigen::MatrixXd denseY = Eigen::MatrixXd::Random(8, 12);
+    FactorizedMAPSolver::SparseMatrix D = (denseD.array().abs() > 0.5).select(denseD, 0).sparseView();
+    FactorizedMAPSolver::SparseMatrix Y = (denseY.array().abs() > 0.5).select(denseY, 0).sparseView();
+    D.makeCompressed();
+    Y.makeCompressed();
+    const Eigen::VectorXd bD = Eigen::VectorXd::Random(4);
+    const Eigen::VectorXd bY = Eigen::VectorXd::Random(8);
+    const Eigen::VectorXd mu_d = Eigen::VectorXd::Random(12);
+
+    FactorizedMAPSolver::SparseMatrix sigma_d(12, 12);
+    FactorizedMAPSolver::SparseMatrix sigma_D(4, 4);
+    FactorizedMAPSolver::SparseMatrix sigma_y(8, 8);
+    sigma_d.setIdentity();
+    sigma_d *= 10;
+    sigma_D.setIdentity();
+    sigma_D *= 1e-2;
+    sigma_y.setIdentity();
+
+    FactorizedMAPSolver recursive;
+    bool ok = recursive.setDynamicsRegularizationPrior(mu_d, sigma_d)
+              && recursive.setDynamicsConstraintsPriorCovariance(sigma_D)
+              && recursive.setMeasurementsPriorCovariance(sigma_y) && recursive.setRecursive(true, forgettingFactor);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE(recursive.isRecursive());
+
+    Eigen::MatrixXd accumulatedPrecision = Eigen::MatrixXd::Zero(12, 12);
+    Eigen::VectorXd accumulatedInformation = Eigen::VectorXd::Zero(12);
+    for (size_t step = 0; step < 5; ++step) {
+        FactorizedMAPSolver::SparseMatrix Yk = Y;
+        Eigen::Map<Eigen::VectorXd>(Yk.valuePtr(), Yk.nonZeros()).array() *=
+            1 + 0.5 * Eigen::ArrayXd::Random(Yk.nonZeros());
+        const Eigen::VectorXd y = Eigen::VectorXd::Random(8);
+
+        ok = recursive.doEstimate(D, bD, Yk, bY, y);
+        ASSERT_IS_TRUE(ok);
+        ASSERT_IS_TRUE(recursive.numberOfSymbolicAnalyses() == 1);
+
+        // sigma_d, sigma_D and sigma_y are scaled identities
+        const Eigen::MatrixXd precision = Eigen::MatrixXd::Identity(12, 12) / 10
+                                          + Eigen::MatrixXd(D.transpose() * D) / 1e-2
+                                          + Eigen::MatrixXd(Yk.transpose() * Yk);
+        const Eigen::VectorXd information = mu_d / 10 - D.transpose() * bD / 1e-2 + Yk.transpose() * (y - bY);
+        accumulatedPrecision = forgettingFactor * accumulatedPrecision + precision;
+        accumulatedInformation = forgettingFactor * accumulatedInformation + information;
+
+        const Eigen::VectorXd expected = accumulatedPrecision.ldlt().solve(accumulatedInformation);
+        ASSERT_IS_TRUE((recursive.lastEstimate() - expected).norm() <= 1e-10 * (1.0 + expected.norm()));
+    }
+
+    // Enabling it again restarts from the configured priors
+    const Eigen::VectorXd y = Eigen::VectorXd::Random(8);
+    FactorizedMAPSolver single;
+    ok = single.setDynamicsRegularizationPrior(mu_d, sigma_d) && single.setDynamicsConstraintsPriorCovariance(sigma_D)
+         && single.setMeasurementsPriorCovariance(sigma_y) && single.doEstimate(D, bD, Y, bY, y)
+         && recursive.setRecursive(true, forgettingFactor) && recursive.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE((recursive.lastEstimate() - single.lastEstimate()).norm()
+                   <= 1e-12 * (1.0 + single.lastEstimate().norm()));
+}
+
+/*
+ * The default backend, the sequential factorization, and the one parallel over the elimination
+ * tree give the solution of the MAP system computed with SimplicialLDLT from its definition.
+ */
+void testFactorizationBackends()
+{
+    using hde::estimation::FactorizedMAPSolver;
+
+    const Eigen::MatrixXd denseD = Eigen::MatrixXd::Random(20, 60);
+    const Eigen::MatrixXd denseY = Eigen::MatrixXd::Random(45, 60);
+    FactorizedMAPSolver::SparseMatrix D = (denseD.array().abs() > 0.7).select(denseD, 0).sparseView();
+    FactorizedMAPSolver::SparseMatrix Y = (denseY.array().abs() > 0.7).select(denseY, 0).sparseView();
+    D.makeCompressed();
+    Y.makeCompressed();
+    const Eigen::VectorXd bD = Eigen::VectorXd::Random(20);
+    const Eigen::VectorXd bY = Eigen::VectorXd::Random(45);
+    const Eigen::VectorXd y = Eigen::VectorXd::Random(45);
+    const Eigen::VectorXd mu_d = Eigen::VectorXd::Random(60);
+
+    FactorizedMAPSolver::SparseMatrix sigma_d(60, 60);
+    FactorizedMAPSolver::SparseMatrix sigma_D(20, 20);
+    FactorizedMAPSolver::SparseMatrix sigma_y(45, 45);
+    sigma_d.setIdentity();
+    sigma_d *= 10;
+    sigma_D.setIdentity();
+    sigma_D *= 0.1;
+    sigma_y.setIdentity();
+    sigma_y *= 0.5;
+
+    // P * d = r with P = Sigma_d^-1 + D^T * Sigma_D^-1 * D + Y^T * Sigma_y^-1 * Y
+    FactorizedMAPSolver::SparseMatrix precision(60, 60);
+    precision.setIdentity();
+    precision *= 0.1;
+    precision += 10 * FactorizedMAPSolver::SparseMatrix(D.transpose() * D);
+    precision += 2 * FactorizedMAPSolver::SparseMatrix(Y.transpose() * Y);
+    const Eigen::VectorXd information = 0.1 * mu_d - 10 * (D.transpose() * bD) + 2 * (Y.transpose() * (y - bY));
+    Eigen::SimplicialLDLT<FactorizedMAPSolver::SparseMatrix> reference(precision);
+    ASSERT_IS_TRUE(reference.info() == Eigen::Success);
+    const Eigen::VectorXd expected = reference.solve(information);
+
+    FactorizedMAPSolver sequential, parallel;
+    for (FactorizedMAPSolver* solver : {&sequential, &parallel}) {
+        const bool ok = solver->setDynamicsRegularizationPrior(mu_d, sigma_d)
+                        && solver->setDynamicsConstraintsPriorCovariance(sigma_D)
+                        && solver->setMeasurementsPriorCovariance(sigma_y);
+        ASSERT_IS_TRUE(ok);
+    }
+    const bool ok = parallel.setNumberOfThreads(3) && sequential.doEstimate(D, bD, Y, bY, y)
+                    && parallel.doEstimate(D, bD, Y, bY, y);
+    ASSERT_IS_TRUE(ok);
+
+    for (const FactorizedMAPSolver* solver : {&sequential, &parallel}) {
+        ASSERT_IS_TRUE((solver->lastEstimate() - expected).norm() <= 1e-10 * (1.0 + expected.norm()));
+    }
+}
+
+/*
+ * After the first estimates the steady state ticks must not allocate, also with a measurements
+ * covariance that is not diagonal, with the parallel factorization and with the mixed precision
+ * one, both when the refinement converges and when it falls back to double precision.
+ */
+void testSteadyStateAllocations()
+{
+    using hde::estimation::FactorizedMAPSolver;
+    using hde::utils::AllocationMonitor;
+
+    // The monitor must see the allocations of operator new and of Eigen
+    AllocationMonitor probe;
+    probe.begin();
+    std::vector<double>* vector = new std::vector<double>(10);
+    Eigen::VectorXd* eigenVector = new Eigen::VectorXd(10);
+    probe.end();
+    delete vector;
+    delete eigenVector;
+    ASSERT_IS_TRUE(!AllocationMonitor::isEnabled() || probe.count() >= 4);
+
+    const Eigen::MatrixXd denseD = Eigen::MatrixXd::Random(10, 40);
+    const Eigen::MatrixXd denseY = Eigen::MatrixXd::Random(30, 40);
+    FactorizedMAPSolver::SparseMatrix D = (denseD.array().abs() > 0.5).select(denseD, 0).sparseView();
+    FactorizedMAPSolver::SparseMatrix Y = (denseY.array().abs() > 0.5).select(denseY, 0).sparseView();
+    D.makeCompressed();
+    Y.makeCompressed();
+    const Eigen::VectorXd bD = Eigen::VectorXd::Random(10);
+    const Eigen::VectorXd bY = Eigen::VectorXd::Random(30);
+    const Eigen::VectorXd mu_d = Eigen::VectorXd::Random(40);
+    const std::vector<Eigen::VectorXd> measurements = {Eigen::VectorXd::Random(30), Eigen::VectorXd::Random(30)};
+
+    FactorizedMAPSolver::SparseMatrix sigma_d(40, 40);
+    FactorizedMAPSolver::SparseMatrix sigma_D(10, 10);
+    sigma_d.setIdentity();
+    sigma_D.setIdentity();
+
+    // Tridiagonal, diagonally dominant measurements covariance
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (int i = 0; i < 30; ++i) {
+        triplets.emplace_back(i, i, 2.0);
+        if (i > 0) {
+            triplets.emplace_back(i, i - 1, 0.5);
+            triplets.emplace_back(i - 1, i, 0.5);
+        }
+    }
+    FactorizedMAPSolver::SparseMatrix sigma_y(30, 30);
+    sigma_y.setFromTriplets(triplets.begin(), triplets.end());
+
+    FactorizedMAPSolver doublePrecision, parallel, mixed, fallback;
+    bool ok = parallel.setNumberOfThreads(3) && mixed.setMixedPrecision(true)
+              && fallback.setMixedPrecision(true, 1e-30);
+    ASSERT_IS_TRUE(ok);
+
+    for (FactorizedMAPSolver* solver : {&doublePrecision, &parallel, &mixed, &fallback}) {
+        ok = solver->setDynamicsRegularizationPrior(mu_d, sigma_d)
+             && solver->setDynamicsConstraintsPriorCovariance(sigma_D)
+             && solver->setMeasurementsPriorCovariance(sigma_y);
+        for (std::size_t tick = 0; ok && tick < 2; ++tick) {
+            ok = solver->doEstimate(D, bD, Y, bY, measurements[tick]);
+        }
+        ASSERT_IS_TRUE(ok);
+
+        AllocationMonitor monitor;
+        monitor.begin();
+        for (std::size_t tick = 0; ok && tick < 10; ++tick) {
+            ok = solver->doEstimate(D, bD, Y, bY, measurements[tick % 2])
+                 && solver->solveWithLastFactorization(D, bD, Y, bY, measurements[(tick + 1) % 2]);
+        }
+        monitor.end();
+        ASSERT_IS_TRUE(ok);
+        ASSERT_IS_TRUE(monitor.count() == 0);
+    }
+    ASSERT_IS_TRUE(fallback.numberOfDoublePrecisionFallbacks() > 0);
+}
+
+int main()
+{
+    testPriorCovarianceUpdates();
+    testMeasurementsMask();
+    testMixedPrecision();
+    testIterativeSolver();
+    testRecursiveEstimation();
+    testFactorizationBackends();
+    testSteadyStateAllocations();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#include "KinematicTreeOrdering.h"
+
+#include <iDynTree/Estimation/BerdyHelper.h>
+#include <iDynTree/Model/Model.h>
+#include <iDynTree/Model/Traversal.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+using namespace hde::estimation;
+
+bool KinematicTreeOrdering::computeLinkGroups(const iDynTree::BerdyHelper& berdy,
+                                              std::vector<StorageIndex>& groups)
+{
+    const iDynTree::Model& model = berdy.model();
+    const iDynTree::Traversal& traversal = berdy.dynamicTraversal();
+    const size_t nrOfVisitedLinks = traversal.getNrOfVisitedLinks();
+
+    // Group of every link and joint, the joints belong to the group of their child link.
+    // The last group collects the variables not referring to the tree.
+    const size_t unmappedGroup = nrOfVisitedLinks;
+    std::vector<size_t> linkGroups(model.getNrOfLinks(), unmappedGroup);
+    std::vector<size_t> jointGroups(model.getNrOfJoints(), unmappedGroup);
+
+    for (size_t traversalIndex = 0; traversalIndex < nrOfVisitedLinks; ++traversalIndex) {
+        linkGroups[traversal.getLink(traversalIndex)->getIndex()] = traversalIndex;
+
+        const iDynTree::IJointConstPtr parentJoint = traversal.getParentJoint(traversalIndex);
+        if (parentJoint) {
+            jointGroups[parentJoint->getIndex()] = traversalIndex;
+        }
+    }
+
+    groups.assign(berdy.getNrOfDynamicVariables(), -1);
+    for (const iDynTree::BerdyDynamicVariable& variable : berdy.getDynamicVariablesOrdering()) {
+        size_t group = unmappedGroup;
+
+        const iDynTree::LinkIndex linkIndex = model.getLinkIndex(variable.id);
+        const iDynTree::JointIndex jointIndex = model.getJointIndex(variable.id);
+        if (linkIndex != iDynTree::LINK_INVALID_INDEX) {
+            group = linkGroups[linkIndex];
+        }
+        else if (jointIndex != iDynTree::JOINT_INVALID_INDEX) {
+            group = jointGroups[jointIndex];
+        }
+
+        // The ranges must cover every dynamic variable exactly once
+        for (std::ptrdiff_t i = variable.range.offset; i < variable.range.offset + variable.range.size; ++i) {
+            if (i < 0 || i >= static_cast<std::ptrdiff_t>(groups.size()) || groups[i] >= 0) {
+                return false;
+            }
+            groups[i] = static_cast<StorageIndex>(group);
+        }
+    }
+
+    return std::find(groups.begin(), groups.end(), -1) == groups.end();
+}
+
+bool KinematicTreeOrdering::compute(const iDynTree::BerdyHelper& berdy, FactorizedMAPSolver::EliminationOrder& order)
+{
+    std::vector<StorageIndex> groups;
+    if (!computeLinkGroups(berdy, groups)) {
+        return false;
+    }
+
+    // The parents precede their children in the traversal, then the groups are eliminated in
+    // reverse traversal order. The unmapped group is the last one.
+    const StorageIndex unmappedGroup = static_cast<StorageIndex>(berdy.dynamicTraversal().getNrOfVisitedLinks());
+    const auto eliminationRank = [unmappedGroup](const StorageIndex group) {
+        return group == unmappedGroup ? group : unmappedGroup - 1 - group;
+    };
+
+    order.resize(groups.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](const StorageIndex first, const StorageIndex second) {
+        return eliminationRank(groups[first]) < eliminationRank(groups[second]);
+    });
+
+    return true;
+}
@@ -0,0 +1,604 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#include "ModelSnapshot.h"
+#include "BinaryFile.h"
+
+#include <iDynTree/Model/FixedJoint.h>
+#include <iDynTree/Model/Model.h>
+#include <iDynTree/Model/PrismaticJoint.h>
+#include <iDynTree/Model/RevoluteJoint.h>
+#include <iDynTree/Sensors/AccelerometerSensor.h>
+#include <iDynTree/Sensors/GyroscopeSensor.h>
+#include <iDynTree/Sensors/Sensors.h>
+#include <iDynTree/Sensors/SixAxisForceTorqueSensor.h>
+#include <iDynTree/Sensors/ThreeAxisAngularAccelerometerSensor.h>
+#include <iDynTree/Sensors/ThreeAxisForceTorqueContactSensor.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace hde::utils;
+
+namespace {
+    const char Magic[8] = {'H', 'D', 'E', 'M', 'O', 'D', 'E', 'L'};
+    constexpr std::uint32_t ByteOrderMark = 0x01020304;
+    constexpr std::uint64_t MaxNumberOfElements = 1u << 20;
+
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrderMark;
+        std::uint64_t sourceHash;
+    };
+
+    enum class JointType : std::uint8_t
+    {
+        Fixed = 0,
+        Revolute,
+        Prismatic,
+    };
+
+    const iDynTree::SensorType LinkSensorTypes[] = {
+        iDynTree::ACCELEROMETER, iDynTree::GYROSCOPE, iDynTree::THREE_AXIS_ANGULAR_ACCELEROMETER};
+
+    std::size_t getNrOfSensors(const iDynTree::SensorsList& sensors)
+    {
+        std::size_t nrOfSensors = 0;
+        for (int type = 0; type < iDynTree::NR_OF_SENSOR_TYPES; ++type) {
+            nrOfSensors += sensors.getNrOfSensors(static_cast<iDynTree::SensorType>(type));
+        }
+        return nrOfSensors;
+    }
+
+    // =========
+    // SERIALIZE
+    // =========
+
+    void writeVector3(BinaryWriter& writer, const double x, const double y, const double z)
+    {
+        const double values[3] = {x, y, z};
+        writer.write(values, sizeof(values));
+    }
+
+    void writeTransform(BinaryWriter& writer, const iDynTree::Transform& transform)
+    {
+        const iDynTree::Rotation rotation = transform.getRotation();
+        const iDynTree::Position position = transform.getPosition();
+
+        for (unsigned row = 0; row < 3; ++row) {
+            for (unsigned col = 0; col < 3; ++col) {
+                writer.write(rotation(row, col));
+            }
+        }
+        writeVector3(writer, position(0), position(1), position(2));
+    }
+
+    void writeLinkSensor(BinaryWriter& writer, const iDynTree::LinkSensor& sensor)
+    {
+        writer.writeString(sensor.getName());
+        writer.writeString(sensor.getParentLink());
+        writer.write(static_cast<std::int64_t>(sensor.getParentLinkIndex()));
+        writeTransform(writer, sensor.getLinkSensorTransform());
+    }
+
+    bool writeJoint(BinaryWriter& writer, const iDynTree::Model& model, const iDynTree::JointIndex index)
+    {
+        const iDynTree::IJointConstPtr joint = model.getJoint(index);
+        const iDynTree::LinkIndex firstLink = joint->getFirstAttachedLink();
+        const iDynTree::LinkIndex secondLink = joint->getSecondAttachedLink();
+
+        iDynTree::Axis axis;
+        if (const auto* revolute = dynamic_cast<const iDynTree::RevoluteJoint*>(joint)) {
+            writer.write(JointType::Revolute);
+            axis = revolute->getAxis(firstLink);
+        }
+        else if (const auto* prismatic = dynamic_cast<const iDynTree::PrismaticJoint*>(joint)) {
+            writer.write(JointType::Prismatic);
+            axis = prismatic->getAxis(firstLink);
+        }
+        else if (dynamic_cast<const iDynTree::FixedJoint*>(joint)) {
+            writer.write(JointType::Fixed);
+        }
+        else {
+            // Unsupported joint type
+            return false;
+        }
+
+        writer.writeString(model.getJointName(index));
+        writer.write(static_cast<std::int64_t>(firstLink));
+        writer.write(static_cast<std::int64_t>(secondLink));
+        writeTransform(writer, joint->getRestTransform(firstLink, secondLink));
+
+        if (joint->getNrOfDOFs() == 0) {
+            return true;
+        }
+
+        const iDynTree::Direction& direction = axis.getDirection();
+        const iDynTree::Position& origin = axis.getOrigin();
+        writeVector3(writer, direction(0), direction(1), direction(2));
+        writeVector3(writer, origin(0), origin(1), origin(2));
+
+        double min = 0;
+        double max = 0;
+        const std::uint8_t hasPosLimits = joint->hasPosLimits() ? 1 : 0;
+        if (hasPosLimits) {
+            joint->getPosLimits(0, min, max);
+        }
+        writer.write(hasPosLimits);
+        writer.write(min);
+        writer.write(max);
+        return true;
+    }
+
+    // ===========
+    // DESERIALIZE
+    // ===========
+
+    bool readIndex(BinaryReader& reader, const std::uint64_t size, std::ptrdiff_t& index)
+    {
+        std::int64_t value = 0;
+        if (!reader.read(value) || value < 0 || static_cast<std::uint64_t>(value) >= size) {
+            return false;
+        }
+        index = static_cast<std::ptrdiff_t>(value);
+        return true;
+    }
+
+    bool readCount(BinaryReader& reader, std::uint64_t& count)
+    {
+        return reader.read(count) && count <= MaxNumberOfElements;
+    }
+
+    bool readTransform(BinaryReader& reader, iDynTree::Transform& transform)
+    {
+        double values[12];
+        if (!reader.read(values, sizeof(values))) {
+            return false;
+        }
+
+        transform.setRotation(iDynTree::Rotation(values[0],
+                                                 values[1],
+                                                 values[2],
+                                                 values[3],
+                                                 values[4],
+                                                 values[5],
+                                                 values[6],
+                                                 values[7],
+                                                 values[8]));
+        transform.setPosition(iDynTree::Position(values[9], values[10], values[11]));
+        return true;
+    }
+
+    bool readLinkSensor(BinaryReader& reader, const iDynTree::Model& model, iDynTree::LinkSensor& sensor)
+    {
+        std::string name;
+        std::string parentLink;
+        std::ptrdiff_t parentLinkIndex = 0;
+        iDynTree::Transform transform;
+
+        if (!reader.readString(name) || !reader.readString(parentLink)
+            || !readIndex(reader, model.getNrOfLinks(), parentLinkIndex) || !readTransform(reader, transform)
+            || model.getLinkName(parentLinkIndex) != parentLink) {
+            return false;
+        }
+
+        sensor.setName(name);
+        sensor.setParentLink(parentLink);
+        sensor.setParentLinkIndex(parentLinkIndex);
+        sensor.setLinkSensorTransform(transform);
+        return true;
+    }
+
+    bool readLinks(BinaryReader& reader, iDynTree::Model& model)
+    {
+        std::uint64_t nrOfLinks = 0;
+        if (!readCount(reader, nrOfLinks) || nrOfLinks == 0) {
+            return false;
+        }
+
+        for (std::uint64_t i = 0; i < nrOfLinks; ++i) {
+            std::string name;
+            double mass = 0;
+            double centerOfMass[3];
+            double rotationalInertia[9];
+
+            if (!reader.readString(name) || !reader.read(mass) || !reader.read(centerOfMass, sizeof(centerOfMass))
+                || !reader.read(rotationalInertia, sizeof(rotationalInertia))) {
+                return false;
+            }
+
+            iDynTree::RotationalInertiaRaw rotationalInertiaWrtCenterOfMass;
+            for (unsigned row = 0; row < 3; ++row) {
+                for (unsigned col = 0; col < 3; ++col) {
+                    rotationalInertiaWrtCenterOfMass(row, col) = rotationalInertia[3 * row + col];
+                }
+            }
+
+            iDynTree::Link link;
+            link.setInertia(iDynTree::SpatialInertia(
+                mass,
+                iDynTree::Position(centerOfMass[0], centerOfMass[1], centerOfMass[2]),
+                rotationalInertiaWrtCenterOfMass));
+
+            if (model.addLink(name, link) != static_cast<iDynTree::LinkIndex>(i)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool readJoints(BinaryReader& reader, iDynTree::Model& model)
+    {
+        std::uint64_t nrOfJoints = 0;
+        if (!readCount(reader, nrOfJoints)) {
+            return false;
+        }
+
+        for (std::uint64_t i = 0; i < nrOfJoints; ++i) {
+            JointType type;
+            std::string name;
+            std::ptrdiff_t firstLink = 0;
+            std::ptrdiff_t secondLink = 0;
+            iDynTree::Transform firstLink_H_secondLink;
+
+            if (!reader.read(type) || !reader.readString(name) || !readIndex(reader, model.getNrOfLinks(), firstLink)
+                || !readIndex(reader, model.getNrOfLinks(), secondLink)
+                || !readTransform(reader, firstLink_H_secondLink)) {
+                return false;
+            }
+
+            if (type == JointType::Fixed) {
+                iDynTree::FixedJoint joint(firstLink, secondLink, firstLink_H_secondLink);
+                if (model.addJoint(name, &joint) == iDynTree::JOINT_INVALID_INDEX) {
+                    return false;
+                }
+                continue;
+            }
+
+            double direction[3];
+            double origin[3];
+            std::uint8_t hasPosLimits = 0;
+            double min = 0;
+            double max = 0;
+
+            if (!reader.read(direction, sizeof(direction)) || !reader.read(origin, sizeof(origin))
+                || !reader.read(hasPosLimits) || !reader.read(min) || !reader.read(max)) {
+                return false;
+            }
+
+            const iDynTree::Axis axis(iDynTree::Direction(direction[0], direction[1], direction[2]),
+                                      iDynTree::Position(origin[0], origin[1], origin[2]));
+
+            iDynTree::JointIndex index = iDynTree::JOINT_INVALID_INDEX;
+            if (type == JointType::Revolute) {
+                iDynTree::RevoluteJoint joint(firstLink, secondLink, firstLink_H_secondLink, axis);
+                joint.enablePosLimits(hasPosLimits != 0);
+                joint.setPosLimits(0, min, max);
+                index = model.addJoint(name, &joint);
+            }
+            else if (type == JointType::Prismatic) {
+                iDynTree::PrismaticJoint joint(firstLink, secondLink, firstLink_H_secondLink, axis);
+                joint.enablePosLimits(hasPosLimits != 0);
+                joint.setPosLimits(0, min, max);
+                index = model.addJoint(name, &joint);
+            }
+
+            if (index == iDynTree::JOINT_INVALID_INDEX) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool readFrames(BinaryReader& reader, iDynTree::Model& model)
+    {
+        std::uint64_t nrOfAdditionalFrames = 0;
+        if (!readCount(reader, nrOfAdditionalFrames)) {
+            return false;
+        }
+
+        for (std::uint64_t i = 0; i < nrOfAdditionalFrames; ++i) {
+            std::string name;
+            std::ptrdiff_t link = 0;
+            iDynTree::Transform link_H_frame;
+
+            if (!reader.readString(name) || !readIndex(reader, model.getNrOfLinks(), link)
+                || !readTransform(reader, link_H_frame)
+                || !model.addAdditionalFrameToLink(model.getLinkName(link), name, link_H_frame)) {
+                return false;
+            }
+        }
+
+        std::ptrdiff_t defaultBaseLink = 0;
+        return readIndex(reader, model.getNrOfLinks(), defaultBaseLink) && model.setDefaultBaseLink(defaultBaseLink);
+    }
+
+    template <typename SensorType>
+    bool readLinkSensors(BinaryReader& reader, const iDynTree::Model& model, iDynTree::SensorsList& sensors)
+    {
+        std::uint64_t nrOfSensors = 0;
+        if (!readCount(reader, nrOfSensors)) {
+            return false;
+        }
+
+        for (std::uint64_t i = 0; i < nrOfSensors; ++i) {
+            SensorType sensor;
+            if (!readLinkSensor(reader, model, sensor) || sensors.addSensor(sensor) < 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool readForceTorqueSensors(BinaryReader& reader, const iDynTree::Model& model, iDynTree::SensorsList& sensors)
+    {
+        std::uint64_t nrOfSensors = 0;
+        if (!readCount(reader, nrOfSensors)) {
+            return false;
+        }
+
+        for (std::uint64_t i = 0; i < nrOfSensors; ++i) {
+            std::string name;
+            std::string parentJoint;
+            std::ptrdiff_t parentJointIndex = 0;
+            std::ptrdiff_t firstLink = 0;
+            std::ptrdiff_t secondLink = 0;
+            std::ptrdiff_t appliedWrenchLink = 0;
+            iDynTree::Transform firstLink_H_sensor;
+            iDynTree::Transform secondLink_H_sensor;
+
+            if (!reader.readString(name) || !reader.readString(parentJoint)
+                || !readIndex(reader, model.getNrOfJoints(), parentJointIndex)
+                || !readIndex(reader, model.getNrOfLinks(), firstLink)
+                || !readIndex(reader, model.getNrOfLinks(), secondLink)
+                || !readIndex(reader, model.getNrOfLinks(), appliedWrenchLink)
+                || !readTransform(reader, firstLink_H_sensor) || !readTransform(reader, secondLink_H_sensor)
+                || model.getJointName(parentJointIndex) != parentJoint) {
+                return false;
+            }
+
+            iDynTree::SixAxisForceTorqueSensor sensor;
+            sensor.setName(name);
+            sensor.setParentJoint(parentJoint);
+            sensor.setParentJointIndex(parentJointIndex);
+            sensor.setFirstLinkName(model.getLinkName(firstLink));
+            sensor.setSecondLinkName(model.getLinkName(secondLink));
+            sensor.setFirstLinkSensorTransform(firstLink, firstLink_H_sensor);
+            sensor.setSecondLinkSensorTransform(secondLink, secondLink_H_sensor);
+            sensor.setAppliedWrenchLink(appliedWrenchLink);
+
+            if (sensors.addSensor(sensor) < 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool readContactForceTorqueSensors(BinaryReader& reader,
+                                       const iDynTree::Model& model,
+                                       iDynTree::SensorsList& sensors)
+    {
+        std::uint64_t nrOfSensors = 0;
+        if (!readCount(reader, nrOfSensors)) {
+            return false;
+        }
+
+        for (std::uint64_t i = 0; i < nrOfSensors; ++i) {
+            iDynTree::ThreeAxisForceTorqueContactSensor sensor;
+            std::uint64_t nrOfLoadCells = 0;
+
+            if (!readLinkSensor(reader, model, sensor) || !readCount(reader, nrOfLoadCells)) {
+                return false;
+            }
+
+            std::vector<iDynTree::Position> loadCellLocations(nrOfLoadCells);
+            for (iDynTree::Position& location : loadCellLocations) {
+                double values[3];
+                if (!reader.read(values, sizeof(values))) {
+                    return false;
+                }
+                location = iDynTree::Position(values[0], values[1], values[2]);
+            }
+            sensor.setLoadCellLocations(loadCellLocations);
+
+            if (sensors.addSensor(sensor) < 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool parse(BinaryReader& reader,
+               const std::uint64_t sourceHash,
+               iDynTree::Model& model,
+               iDynTree::SensorsList& sensors)
+    {
+        Header header;
+        if (!reader.read(header) || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+            || header.version != ModelSnapshot::Version || header.byteOrderMark != ByteOrderMark
+            || header.sourceHash != sourceHash) {
+            return false;
+        }
+
+        model = iDynTree::Model();
+        sensors = iDynTree::SensorsList();
+
+        return readLinks(reader, model) && readJoints(reader, model) && readFrames(reader, model)
+               && readForceTorqueSensors(reader, model, sensors)
+               && readLinkSensors<iDynTree::AccelerometerSensor>(reader, model, sensors)
+               && readLinkSensors<iDynTree::GyroscopeSensor>(reader, model, sensors)
+               && readLinkSensors<iDynTree::ThreeAxisAngularAccelerometerSensor>(reader, model, sensors)
+               && readContactForceTorqueSensors(reader, model, sensors) && reader.atEnd();
+    }
+} // namespace
+
+bool ModelSnapshot::hashFile(const std::string& fileName, std::uint64_t& hash)
+{
+    MappedFile file;
+    if (!file.open(fileName)) {
+        return false;
+    }
+
+    hash = hde::utils::hash(file.data(), file.size());
+    return true;
+}
+
+bool ModelSnapshot::isSupported(const iDynTree::Model& model,
+                                const iDynTree::SensorsList& sensors,
+                                std::string& reason)
+{
+    for (size_t i = 0; i < model.getNrOfJoints(); ++i) {
+        const iDynTree::IJointConstPtr joint = model.getJoint(i);
+        if (!dynamic_cast<const iDynTree::RevoluteJoint*>(joint)
+            && !dynamic_cast<const iDynTree::PrismaticJoint*>(joint)
+            && !dynamic_cast<const iDynTree::FixedJoint*>(joint)) {
+            reason = "joint " + model.getJointName(i) + " is not fixed, revolute or prismatic";
+            return false;
+        }
+    }
+
+    std::size_t nrOfSupportedSensors = sensors.getNrOfSensors(iDynTree::SIX_AXIS_FORCE_TORQUE)
+                                       + sensors.getNrOfSensors(iDynTree::THREE_AXIS_FORCE_TORQUE_CONTACT);
+    for (const iDynTree::SensorType type : LinkSensorTypes) {
+        nrOfSupportedSensors += sensors.getNrOfSensors(type);
+    }
+    if (nrOfSupportedSensors != getNrOfSensors(sensors)) {
+        reason = "the model has sensors of unsupported types";
+        return false;
+    }
+
+    return true;
+}
+
+bool ModelSnapshot::read(const std::string& fileName,
+                         const std::uint64_t sourceHash,
+                         iDynTree::Model& model,
+                         iDynTree::SensorsList& sensors)
+{
+    MappedFile file;
+    if (!file.open(fileName)) {
+        return false;
+    }
+
+    BinaryReader reader(file.data(), file.size());
+    return parse(reader, sourceHash, model, sensors);
+}
+
+bool ModelSnapshot::write(const std::string& fileName,
+                          const std::uint64_t sourceHash,
+                          const iDynTree::Model& model,
+                          const iDynTree::SensorsList& sensors)
+{
+    std::string reason;
+    if (!isSupported(model, sensors, reason)) {
+        return false;
+    }
+
+    BinaryWriter writer(fileName);
+    if (!writer.isOpen()) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrderMark = ByteOrderMark;
+    header.sourceHash = sourceHash;
+    writer.write(header);
+
+    // Links
+    writer.write(static_cast<std::uint64_t>(model.getNrOfLinks()));
+    for (size_t i = 0; i < model.getNrOfLinks(); ++i) {
+        const iDynTree::SpatialInertia& inertia = model.getLink(i)->getInertia();
+        const iDynTree::Position centerOfMass = inertia.getCenterOfMass();
+        const iDynTree::RotationalInertiaRaw rotationalInertia = inertia.getRotationalInertiaWrtCenterOfMass();
+
+        writer.writeString(model.getLinkName(i));
+        writer.write(inertia.getMass());
+        writeVector3(writer, centerOfMass(0), centerOfMass(1), centerOfMass(2));
+        for (unsigned row = 0; row < 3; ++row) {
+            for (unsigned col = 0; col < 3; ++col) {
+                writer.write(rotationalInertia(row, col));
+            }
+        }
+    }
+
+    // Joints
+    writer.write(static_cast<std::uint64_t>(model.getNrOfJoints()));
+    for (size_t i = 0; i < model.getNrOfJoints(); ++i) {
+        if (!writeJoint(writer, model, i)) {
+            return false;
+        }
+    }
+
+    // Additional frames
+    writer.write(static_cast<std::uint64_t>(model.getNrOfFrames() - model.getNrOfLinks()));
+    for (size_t i = model.getNrOfLinks(); i < model.getNrOfFrames(); ++i) {
+        writer.writeString(model.getFrameName(i));
+        writer.write(static_cast<std::int64_t>(model.getFrameLink(i)));
+        writeTransform(writer, model.getFrameTransform(i));
+    }
+    writer.write(static_cast<std::int64_t>(model.getDefaultBaseLink()));
+
+    // Sensors
+    std::size_t nrOfWrittenSensors = 0;
+    const std::ptrdiff_t nrOfForceTorqueSensors = sensors.getNrOfSensors(iDynTree::SIX_AXIS_FORCE_TORQUE);
+    writer.write(static_cast<std::uint64_t>(nrOfForceTorqueSensors));
+    for (std::ptrdiff_t i = 0; i < nrOfForceTorqueSensors; ++i) {
+        const auto* sensor =
+            static_cast<const iDynTree::SixAxisForceTorqueSensor*>(sensors.getSensor(iDynTree::SIX_AXIS_FORCE_TORQUE, i));
+
+        iDynTree::Transform firstLink_H_sensor;
+        iDynTree::Transform secondLink_H_sensor;
+        sensor->getLinkSensorTransform(sensor->getFirstLinkIndex(), firstLink_H_sensor);
+        sensor->getLinkSensorTransform(sensor->getSecondLinkIndex(), secondLink_H_sensor);
+
+        writer.writeString(sensor->getName());
+        writer.writeString(sensor->getParentJoint());
+        writer.write(static_cast<std::int64_t>(sensor->getParentJointIndex()));
+        writer.write(static_cast<std::int64_t>(sensor->getFirstLinkIndex()));
+        writer.write(static_cast<std::int64_t>(sensor->getSecondLinkIndex()));
+        writer.write(static_cast<std::int64_t>(sensor->getAppliedWrenchLink()));
+        writeTransform(writer, firstLink_H_sensor);
+        writeTransform(writer, secondLink_H_sensor);
+        ++nrOfWrittenSensors;
+    }
+
+    for (const iDynTree::SensorType type : LinkSensorTypes) {
+        writer.write(static_cast<std::uint64_t>(sensors.getNrOfSensors(type)));
+        for (std::ptrdiff_t i = 0; i < sensors.getNrOfSensors(type); ++i) {
+            writeLinkSensor(writer, *static_cast<const iDynTree::LinkSensor*>(sensors.getSensor(type, i)));
+            ++nrOfWrittenSensors;
+        }
+    }
+
+    const std::ptrdiff_t nrOfContactSensors = sensors.getNrOfSensors(iDynTree::THREE_AXIS_FORCE_TORQUE_CONTACT);
+    writer.write(static_cast<std::uint64_t>(nrOfContactSensors));
+    for (std::ptrdiff_t i = 0; i < nrOfContactSensors; ++i) {
+        const auto* sensor = static_cast<const iDynTree::ThreeAxisForceTorqueContactSensor*>(
+            sensors.getSensor(iDynTree::THREE_AXIS_FORCE_TORQUE_CONTACT, i));
+
+        writeLinkSensor(writer, *sensor);
+        const std::vector<iDynTree::Position> loadCellLocations = sensor->getLoadCellLocations();
+        writer.write(static_cast<std::uint64_t>(loadCellLocations.size()));
+        for (const iDynTree::Position& location : loadCellLocations) {
+            writeVector3(writer, location(0), location(1), location(2));
+        }
+        ++nrOfWrittenSensors;
+    }
+
+    // A snapshot missing some sensors would silently change the BERDY measurements
+    return nrOfWrittenSensors == getNrOfSensors(sensors) && writer.commit();
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#include "OrderingSelection.h"
+#include "BinaryFile.h"
+#include "EliminationTreeLDLT.h"
+#include "KinematicTreeOrdering.h"
+
+#include <Eigen/OrderingMethods>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace hde::estimation;
+
+constexpr std::uint32_t OrderingSelection::CacheVersion;
+
+namespace {
+    using StorageIndex = OrderingSelection::SparseMatrix::StorageIndex;
+
+    const char Magic[8] = {'H', 'D', 'E', 'O', 'R', 'D', 'E', 'R'};
+    constexpr std::uint32_t ByteOrderMark = 0x01020304;
+
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrderMark;
+        std::uint64_t key;
+        std::uint64_t size;
+    };
+
+    bool isPermutation(const OrderingSelection::EliminationOrder& order, const Eigen::Index size)
+    {
+        if (static_cast<Eigen::Index>(order.size()) != size) {
+            return false;
+        }
+
+        std::vector<bool> isVisited(order.size(), false);
+        for (const StorageIndex variable : order) {
+            if (variable < 0 || variable >= size || isVisited[variable]) {
+                return false;
+            }
+            isVisited[variable] = true;
+        }
+        return true;
+    }
+
+    // Nested dissection on the graph of a symmetric pattern. The parts are bisected on a level
+    // of the breadth-first search from a pseudo-peripheral node, every part is ordered before its
+    // separator. The parts smaller than LeafSize are ordered as they are.
+    class NestedDissection
+    {
+    private:
+        static constexpr std::size_t LeafSize = 16;
+        static constexpr StorageIndex SeparatorPart = -1;
+
+        const OrderingSelection::SparseMatrix& m_graph;
+        std::vector<StorageIndex> m_part;
+        std::vector<StorageIndex> m_level; // -1 if not reached by the current search
+        StorageIndex m_numberOfParts = 1;
+
+        // Visits the part of the root, returns the number of levels
+        StorageIndex search(const StorageIndex root, std::vector<StorageIndex>& visited)
+        {
+            const StorageIndex part = m_part[root];
+            visited.assign(1, root);
+            m_level[root] = 0;
+
+            for (std::size_t k = 0; k < visited.size(); ++k) {
+                const StorageIndex node = visited[k];
+                for (OrderingSelection::SparseMatrix::InnerIterator it(m_graph, node); it; ++it) {
+                    const StorageIndex neighbor = static_cast<StorageIndex>(it.row());
+                    if (m_part[neighbor] == part && m_level[neighbor] < 0) {
+                        m_level[neighbor] = m_level[node] + 1;
+                        visited.push_back(neighbor);
+                    }
+                }
+            }
+            return m_level[visited.back()] + 1;
+        }
+
+        void resetLevels(const std::vector<StorageIndex>& nodes)
+        {
+            for (const StorageIndex node : nodes) {
+                m_level[node] = -1;
+            }
+        }
+
+        void dissect(const std::vector<StorageIndex>& nodes)
+        {
+            if (nodes.size() <= LeafSize) {
+                order.insert(order.end(), nodes.begin(), nodes.end());
+                return;
+            }
+
+            std::vector<StorageIndex> visited;
+            search(nodes.front(), visited);
+
+            if (visited.size() < nodes.size()) {
+                // Every connected component is dissected on its own
+                resetLevels(visited);
+                std::vector<std::vector<StorageIndex>> components;
+                for (const StorageIndex node : nodes) {
+                    if (m_level[node] < 0) {
+                        components.emplace_back();
+                        search(node, components.back());
+                        const StorageIndex component = m_numberOfParts++;
+                        for (const StorageIndex member : components.back()) {
+                            m_part[member] = component;
+                        }
+                    }
+                }
+                for (const std::vector<StorageIndex>& component : components) {
+                    resetLevels(component);
+                }
+                for (const std::vector<StorageIndex>& component : components) {
+                    dissect(component);
+                }
+                return;
+            }
+
+            // The last node reached is far from the first one and starts a deeper search
+            const StorageIndex peripheral = visited.back();
+            resetLevels(visited);
+            const StorageIndex numberOfLevels = search(peripheral, visited);
+
+            if (numberOfLevels < 3) {
+                resetLevels(visited);
+                order.insert(order.end(), nodes.begin(), nodes.end());
+                return;
+            }
+
+            // Separator on the level of the median node
+            const StorageIndex separatorLevel =
+                std::min(std::max(m_level[visited[visited.size() / 2]], StorageIndex(1)), numberOfLevels - 2);
+
+            std::vector<StorageIndex> first;
+            std::vector<StorageIndex> second;
+            std::vector<StorageIndex> separator;
+            const StorageIndex firstPart = m_numberOfParts++;
+            const StorageIndex secondPart = m_numberOfParts++;
+            for (const StorageIndex node : visited) {
+                if (m_level[node] < separatorLevel) {
+                    first.push_back(node);
+                    m_part[node] = firstPart;
+                }
+                else if (m_level[node] > separatorLevel) {
+                    second.push_back(node);
+                    m_part[node] = secondPart;
+                }
+                else {
+                    separator.push_back(node);
+                    m_part[node] = SeparatorPart;
+                }
+            }
+            resetLevels(visited);
+
+            dissect(first);
+            dissect(second);
+            order.insert(order.end(), separator.begin(), separator.end());
+        }
+
+    public:
+        OrderingSelection::EliminationOrder order;
+
+        explicit NestedDissection(const OrderingSelection::SparseMatrix& graph)
+            : m_graph(graph)
+            , m_part(graph.cols(), 0)
+            , m_level(graph.cols(), -1)
+        {
+            std::vector<StorageIndex> nodes(graph.cols());
+            for (StorageIndex node = 0; node < static_cast<StorageIndex>(nodes.size()); ++node) {
+                nodes[node] = node;
+            }
+            order.reserve(nodes.size());
+            dissect(nodes);
+        }
+    };
+} // namespace
+
+bool OrderingSelection::evaluate(const SparseMatrix& precision, Candidate& candidate)
+{
+    const Eigen::Index size = precision.cols();
+    if (precision.rows() != size || !isPermutation(candidate.order, size)) {
+        return false;
+    }
+
+    // Same convention of the solver: the k-th eliminated variable goes to the k-th row
+    FactorizedMAPSolver::Permutation inversePermutation(size);
+    std::copy(candidate.order.begin(), candidate.order.end(), inversePermutation.indices().data());
+    const FactorizedMAPSolver::Permutation permutation = inversePermutation.inverse();
+
+    SparseMatrix upper(size, size);
+    upper.selfadjointView<Eigen::Upper>() = precision.selfadjointView<Eigen::Lower>().twistedBy(permutation);
+
+    EliminationTreeLDLT factorization;
+    if (!factorization.analyzePattern(upper, 1)) {
+        return false;
+    }
+
+    const SparseMatrix& factor = factorization.factor();
+    candidate.factorNonZeros = factor.nonZeros();
+    candidate.flops = 0;
+    for (Eigen::Index column = 0; column < size; ++column) {
+        const double columnNonZeros = factor.outerIndexPtr()[column + 1] - factor.outerIndexPtr()[column];
+        candidate.flops += columnNonZeros * columnNonZeros;
+    }
+    return true;
+}
+
+bool OrderingSelection::computeCandidates(const SparseMatrix& precision,
+                                          const SparseMatrixRef& D,
+                                          const SparseMatrixRef& Y,
+                                          const iDynTree::BerdyHelper* berdy,
+                                          std::vector<Candidate>& candidates)
+{
+    const Eigen::Index size = precision.cols();
+    if (D.cols() != size || Y.cols() != size) {
+        return false;
+    }
+    candidates.clear();
+
+    // Orderings returning the inverse permutation, i.e. the elimination order
+    FactorizedMAPSolver::Permutation inversePermutation;
+    Eigen::AMDOrdering<StorageIndex> amd;
+    amd(precision, inversePermutation);
+    candidates.push_back(
+        {"amd", EliminationOrder(inversePermutation.indices().data(), inversePermutation.indices().data() + size)});
+
+    // COLAMD returns the permutation of the columns of the stacked rows of D and Y
+    std::vector<Eigen::Triplet<double, StorageIndex>> stackedTriplets;
+    stackedTriplets.reserve(D.nonZeros() + Y.nonZeros());
+    for (Eigen::Index column = 0; column < size; ++column) {
+        for (SparseMatrixRef::InnerIterator it(D, column); it; ++it) {
+            stackedTriplets.emplace_back(it.row(), column, 1.0);
+        }
+        for (SparseMatrixRef::InnerIterator it(Y, column); it; ++it) {
+            stackedTriplets.emplace_back(D.rows() + it.row(), column, 1.0);
+        }
+    }
+    SparseMatrix stacked(D.rows() + Y.rows(), size);
+    stacked.setFromTriplets(stackedTriplets.begin(), stackedTriplets.end());
+    stacked.makeCompressed();
+
+    FactorizedMAPSolver::Permutation permutation;
+    Eigen::COLAMDOrdering<StorageIndex> colamd;
+    colamd(stacked, permutation);
+    inversePermutation = permutation.inverse();
+    candidates.push_back(
+        {"colamd", EliminationOrder(inversePermutation.indices().data(), inversePermutation.indices().data() + size)});
+
+    candidates.push_back({"nested_dissection", NestedDissection(precision).order});
+
+    if (berdy) {
+        candidates.push_back({"kinematic_tree", {}});
+        if (!KinematicTreeOrdering::compute(*berdy, candidates.back().order)) {
+            return false;
+        }
+    }
+
+    for (Candidate& candidate : candidates) {
+        if (!evaluate(precision, candidate)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t OrderingSelection::selectBest(const std::vector<Candidate>& candidates)
+{
+    const auto best =
+        std::min_element(candidates.begin(), candidates.end(), [](const Candidate& first, const Candidate& second) {
+            return first.flops < second.flops
+                   || (first.flops == second.flops && first.factorNonZeros < second.factorNonZeros);
+        });
+    return static_cast<std::size_t>(best - candidates.begin());
+}
+
+std::uint64_t OrderingSelection::patternKey(const SparseMatrix& precision)
+{
+    const std::uint64_t size = static_cast<std::uint64_t>(precision.cols());
+    std::uint64_t key = hde::utils::hash(&size, sizeof(size));
+
+    for (Eigen::Index column = 0; column < precision.outerSize(); ++column) {
+        for (SparseMatrix::InnerIterator it(precision, column); it; ++it) {
+            const StorageIndex entry[2] = {static_cast<StorageIndex>(it.row()), static_cast<StorageIndex>(column)};
+            key = hde::utils::hash(entry, sizeof(entry), key);
+        }
+    }
+    return key;
+}
+
+bool OrderingSelection::readCache(const std::string& fileName, const std::uint64_t key, Candidate& candidate)
+{
+    hde::utils::MappedFile file;
+    if (!file.open(fileName)) {
+        return false;
+    }
+
+    hde::utils::BinaryReader reader(file.data(), file.size());
+    Header header;
+    std::int64_t factorNonZeros = 0;
+    if (!reader.read(header) || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+        || header.version != CacheVersion || header.byteOrderMark != ByteOrderMark || header.key != key
+        || header.size > (1u << 30) || !reader.readString(candidate.method) || !reader.read(factorNonZeros)
+        || !reader.read(candidate.flops)) {
+        return false;
+    }
+
+    candidate.factorNonZeros = static_cast<Eigen::Index>(factorNonZeros);
+    candidate.order.resize(header.size);
+    return reader.read(candidate.order.data(), header.size * sizeof(StorageIndex)) && reader.atEnd()
+           && isPermutation(candidate.order, static_cast<Eigen::Index>(header.size));
+}
+
+bool OrderingSelection::writeCache(const std::string& fileName, const std::uint64_t key, const Candidate& candidate)
+{
+    hde::utils::BinaryWriter writer(fileName);
+    if (!writer.isOpen()) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = CacheVersion;
+    header.byteOrderMark = ByteOrderMark;
+    header.key = key;
+    header.size = candidate.order.size();
+    writer.write(header);
+
+    writer.writeString(candidate.method);
+    writer.write(static_cast<std::int64_t>(candidate.factorNonZeros));
+    writer.write(candidate.flops);
+    writer.write(candidate.order.data(), candidate.order.size() * sizeof(StorageIndex));
+
+    return writer.commit();
+}
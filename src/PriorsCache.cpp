@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#include "PriorsCache.h"
+#include "BinaryFile.h"
+
+#include <cstring>
+#include <limits>
+
+using namespace hde::utils;
+
+namespace {
+    const char Magic[8] = {'H', 'D', 'E', 'P', 'R', 'I', 'O', 'R'};
+    constexpr std::uint32_t ByteOrderMark = 0x01020304;
+
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrderMark;
+        std::uint64_t key;
+        std::uint64_t numberOfSensors;
+    };
+
+    // The sizes of the header are checked against the data left in the file before allocating,
+    // a corrupted or truncated file is a cache miss
+    bool readVector(BinaryReader& reader, Eigen::VectorXd& vector)
+    {
+        std::uint64_t size = 0;
+        if (!reader.read(size) || size > reader.remaining() / sizeof(double)) {
+            return false;
+        }
+        vector.resize(static_cast<Eigen::Index>(size));
+        return reader.read(vector.data(), size * sizeof(double));
+    }
+
+    bool readMatrix(BinaryReader& reader, PriorsCache::SparseMatrix& matrix)
+    {
+        using StorageIndex = PriorsCache::SparseMatrix::StorageIndex;
+
+        std::uint64_t rows = 0;
+        std::uint64_t cols = 0;
+        std::uint64_t nonZeros = 0;
+        if (!reader.read(rows) || !reader.read(cols) || !reader.read(nonZeros) || rows > (1u << 30)
+            || cols > (1u << 30) || nonZeros > rows * cols
+            || nonZeros > static_cast<std::uint64_t>(std::numeric_limits<StorageIndex>::max())) {
+            return false;
+        }
+
+        // cols and nonZeros are below 2^31, the byte counts do not overflow
+        const std::uint64_t outerBytes = (cols + 1) * sizeof(StorageIndex);
+        const std::uint64_t entriesBytes = nonZeros * (sizeof(StorageIndex) + sizeof(double));
+        if (outerBytes + entriesBytes > reader.remaining()) {
+            return false;
+        }
+
+        matrix.resize(static_cast<Eigen::Index>(rows), static_cast<Eigen::Index>(cols));
+        matrix.resizeNonZeros(static_cast<Eigen::Index>(nonZeros));
+
+        if (!reader.read(matrix.outerIndexPtr(), (cols + 1) * sizeof(StorageIndex))
+            || !reader.read(matrix.innerIndexPtr(), nonZeros * sizeof(StorageIndex))
+            || !reader.read(matrix.valuePtr(), nonZeros * sizeof(double))) {
+            return false;
+        }
+
+        // Validate the compressed structure before handing it to Eigen
+        const StorageIndex* outer = matrix.outerIndexPtr();
+        if (outer[0] != 0 || static_cast<std::uint64_t>(outer[cols]) != nonZeros) {
+            return false;
+        }
+        for (std::uint64_t j = 0; j < cols; ++j) {
+            if (outer[j] > outer[j + 1]) {
+                return false;
+            }
+        }
+        for (std::uint64_t k = 0; k < nonZeros; ++k) {
+            if (matrix.innerIndexPtr()[k] < 0 || static_cast<std::uint64_t>(matrix.innerIndexPtr()[k]) >= rows) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool parse(BinaryReader& reader, const std::uint64_t key, PriorsCache::Entry& entry)
+    {
+        Header header;
+        if (!reader.read(header) || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+            || header.version != PriorsCache::Version || header.byteOrderMark != ByteOrderMark || header.key != key
+            || header.numberOfSensors > (1u << 20)) {
+            return false;
+        }
+
+        if (!readVector(reader, entry.dynamicsRegularizationExpectedValue)
+            || !readMatrix(reader, entry.dynamicsRegularizationCovariance)
+            || !readMatrix(reader, entry.dynamicsConstraintsCovariance)
+            || !readMatrix(reader, entry.measurementsCovariance)) {
+            return false;
+        }
+
+        // Type, offset, size and length of the id of each sensor
+        if (header.numberOfSensors > reader.remaining() / (3 * sizeof(std::int32_t) + sizeof(std::uint32_t))) {
+            return false;
+        }
+        entry.sensors.resize(header.numberOfSensors);
+        for (PriorsCache::Sensor& sensor : entry.sensors) {
+            if (!reader.read(sensor.type) || !reader.read(sensor.offset) || !reader.read(sensor.size)
+                || !reader.readString(sensor.id)) {
+                return false;
+            }
+        }
+
+        return reader.atEnd();
+    }
+
+    void writeMatrix(BinaryWriter& writer, const PriorsCache::SparseMatrix& input)
+    {
+        using StorageIndex = PriorsCache::SparseMatrix::StorageIndex;
+
+        PriorsCache::SparseMatrix matrix = input;
+        matrix.makeCompressed();
+
+        writer.write(static_cast<std::uint64_t>(matrix.rows()));
+        writer.write(static_cast<std::uint64_t>(matrix.cols()));
+        writer.write(static_cast<std::uint64_t>(matrix.nonZeros()));
+        writer.write(matrix.outerIndexPtr(), (matrix.cols() + 1) * sizeof(StorageIndex));
+        writer.write(matrix.innerIndexPtr(), matrix.nonZeros() * sizeof(StorageIndex));
+        writer.write(matrix.valuePtr(), matrix.nonZeros() * sizeof(double));
+    }
+} // namespace
+
+bool PriorsCache::read(const std::string& fileName, const std::uint64_t key, Entry& entry)
+{
+    MappedFile file;
+    if (!file.open(fileName)) {
+        return false;
+    }
+
+    BinaryReader reader(file.data(), file.size());
+    return parse(reader, key, entry);
+}
+
+bool PriorsCache::write(const std::string& fileName, const std::uint64_t key, const Entry& entry)
+{
+    BinaryWriter writer(fileName);
+    if (!writer.isOpen()) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrderMark = ByteOrderMark;
+    header.key = key;
+    header.numberOfSensors = entry.sensors.size();
+    writer.write(header);
+
+    writer.write(static_cast<std::uint64_t>(entry.dynamicsRegularizationExpectedValue.size()));
+    writer.write(entry.dynamicsRegularizationExpectedValue.data(),
+                 entry.dynamicsRegularizationExpectedValue.size() * sizeof(double));
+
+    writeMatrix(writer, entry.dynamicsRegularizationCovariance);
+    writeMatrix(writer, entry.dynamicsConstraintsCovariance);
+    writeMatrix(writer, entry.measurementsCovariance);
+
+    for (const Sensor& sensor : entry.sensors) {
+        writer.write(sensor.type);
+        writer.write(sensor.offset);
+        writer.write(sensor.size);
+        writer.writeString(sensor.id);
+    }
+
+    return writer.commit();
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+#include "StartupProfiler.h"
+
+#include <cstdio>
+#include <sstream>
+
+#include <sys/resource.h>
+
+using namespace hde::utils;
+
+std::int64_t StartupProfiler::getPeakResidentSetSize()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    // Reported in bytes instead of KiB
+    return static_cast<std::int64_t>(usage.ru_maxrss) / 1024;
+#else
+    return static_cast<std::int64_t>(usage.ru_maxrss);
+#endif
+}
+
+void StartupProfiler::reset()
+{
+    m_phases.clear();
+    m_isPhaseRunning = false;
+}
+
+void StartupProfiler::beginPhase(const std::string& name)
+{
+    endPhase();
+
+    Phase phase;
+    phase.name = name;
+    m_phases.push_back(phase);
+
+    m_isPhaseRunning = true;
+    m_phaseBegin = Clock::now();
+}
+
+void StartupProfiler::endPhase()
+{
+    if (!m_isPhaseRunning) {
+        return;
+    }
+
+    m_phases.back().wallTime = std::chrono::duration<double>(Clock::now() - m_phaseBegin).count();
+    m_phases.back().peakResidentSetSize = getPeakResidentSetSize();
+    m_isPhaseRunning = false;
+}
+
+double StartupProfiler::totalWallTime() const
+{
+    double total = 0;
+    for (const Phase& phase : m_phases) {
+        total += phase.wallTime;
+    }
+    return total;
+}
+
+std::string StartupProfiler::toJSON() const
+{
+    std::ostringstream json;
+    json << "{\"total_wall_time_s\": " << totalWallTime()
+         << ", \"peak_rss_kib\": " << (m_phases.empty() ? 0 : m_phases.back().peakResidentSetSize)
+         << ", \"phases\": [";
+
+    for (size_t i = 0; i < m_phases.size(); ++i) {
+        // Phase names are identifiers and do not need escaping
+        json << (i == 0 ? "" : ", ") << "{\"name\": \"" << m_phases[i].name
+             << "\", \"wall_time_s\": " << m_phases[i].wallTime
+             << ", \"peak_rss_kib\": " << m_phases[i].peakResidentSetSize << "}";
+    }
+
+    json << "]}";
+    return json.str();
+}
+
+std::string StartupProfiler::toJSONString(const std::string& text)
+{
+    std::string json = "\"";
+    for (const char character : text) {
+        switch (character) {
+            case '"':
+                json += "\\\"";
+                break;
+            case '\\':
+                json += "\\\\";
+                break;
+            case '\n':
+                json += "\\n";
+                break;
+            case '\t':
+                json += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(character) < 0x20) {
+                    char escaped[7];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(character));
+                    json += escaped;
+                }
+                else {
+                    json += character;
+                }
+        }
+    }
+    json += "\"";
+    return json;
+}
+
+std::string StartupProfiler::toKeyValue() const
+{
+    std::ostringstream keyValue;
+    for (const Phase& phase : m_phases) {
+        keyValue << phase.name << ".wall_time_s=" << phase.wallTime << " " << phase.name
+                 << ".peak_rss_kib=" << phase.peakResidentSetSize << "\n";
+    }
+
+    keyValue << "total.wall_time_s=" << totalWallTime() << "\n";
+    return keyValue.str();
+}
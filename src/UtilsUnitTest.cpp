@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+// Unit tests of the utilities of the device, they do not need the models or YARP
+
+#include "BlockDiagonalMatrixBuilder.h"
+#include "LatencyHistogram.h"
+#include "PriorsCache.h"
+#include "SeqLockChannel.h"
+
+#include <iDynTree/Core/TestUtils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::string temporaryFilePath(const std::string& fileName)
+{
+    const char* temporaryDirectory = std::getenv("TMPDIR");
+    return std::string(temporaryDirectory ? temporaryDirectory : "/tmp") + "/" + fileName;
+}
+
+std::vector<char> readBytes(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeBytes(const std::string& fileName, const std::vector<char>& bytes, const std::size_t size)
+{
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), static_cast<std::streamsize>(size));
+}
+
+bool isSamePriorsMatrix(const hde::utils::PriorsCache::SparseMatrix& first,
+                        const hde::utils::PriorsCache::SparseMatrix& second)
+{
+    return first.rows() == second.rows() && first.cols() == second.cols() && first.nonZeros() == second.nonZeros()
+           && (first - second).norm() == 0;
+}
+
+/*
+ * The priors read back from the cache are the written ones, with their pattern. A file with a
+ * different key, truncated at any length or declaring arrays larger than its data is rejected.
+ */
+void testPriorsCache()
+{
+    using hde::utils::PriorsCache;
+
+    // Like the parsed priors: diagonal sigma_d and sigma_D, sigma_y with a full 3x3 block
+    PriorsCache::Entry entry;
+    entry.dynamicsRegularizationExpectedValue = Eigen::VectorXd::LinSpaced(12, -1.0, 1.0);
+    entry.dynamicsRegularizationCovariance.resize(12, 12);
+    entry.dynamicsRegularizationCovariance.setIdentity();
+    entry.dynamicsRegularizationCovariance *= 1e4;
+    entry.dynamicsConstraintsCovariance.resize(6, 6);
+    entry.dynamicsConstraintsCovariance.setIdentity();
+    entry.dynamicsConstraintsCovariance *= 1e-4;
+
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            triplets.emplace_back(row, col, row == col ? 2.0 : 0.5);
+        }
+    }
+    for (int i = 3; i < 9; ++i) {
+        triplets.emplace_back(i, i, 1e-2);
+    }
+    entry.measurementsCovariance.resize(9, 9);
+    entry.measurementsCovariance.setFromTriplets(triplets.begin(), triplets.end());
+
+    PriorsCache::Sensor accelerometer;
+    accelerometer.type = 1;
+    accelerometer.id = "link1_accelerometer";
+    accelerometer.offset = 0;
+    accelerometer.size = 3;
+    PriorsCache::Sensor wrench;
+    wrench.type = 2;
+    wrench.id = "link1";
+    wrench.offset = 3;
+    wrench.size = 6;
+    entry.sensors = {accelerometer, wrench};
+
+    const std::string fileName = temporaryFilePath("testPriorsCache.cache");
+    const std::uint64_t key = 0x0123456789abcdef;
+    ASSERT_IS_TRUE(PriorsCache::write(fileName, key, entry));
+
+    PriorsCache::Entry loaded;
+    ASSERT_IS_TRUE(PriorsCache::read(fileName, key, loaded));
+    ASSERT_IS_TRUE(loaded.dynamicsRegularizationExpectedValue == entry.dynamicsRegularizationExpectedValue);
+    ASSERT_IS_TRUE(isSamePriorsMatrix(loaded.dynamicsRegularizationCovariance, entry.dynamicsRegularizationCovariance));
+    ASSERT_IS_TRUE(isSamePriorsMatrix(loaded.dynamicsConstraintsCovariance, entry.dynamicsConstraintsCovariance));
+    ASSERT_IS_TRUE(isSamePriorsMatrix(loaded.measurementsCovariance, entry.measurementsCovariance));
+    ASSERT_IS_TRUE(loaded.sensors == entry.sensors);
+
+    ASSERT_IS_TRUE(!PriorsCache::read(fileName, key + 1, loaded));
+
+    const std::vector<char> bytes = readBytes(fileName);
+    const std::string corruptedFileName = temporaryFilePath("testPriorsCache.corrupted");
+    for (std::size_t size = 0; size < bytes.size(); ++size) {
+        writeBytes(corruptedFileName, bytes, size);
+        ASSERT_IS_TRUE(!PriorsCache::read(corruptedFileName, key, loaded));
+    }
+
+    // Size of mu_d, right after the header of 32 bytes, of 2 GB of data not in the file
+    const std::size_t sizeOffset = 32;
+    std::vector<char> oversized = bytes;
+    const std::uint64_t hugeSize = std::uint64_t(1) << 28;
+    std::memcpy(oversized.data() + sizeOffset, &hugeSize, sizeof(hugeSize));
+    writeBytes(corruptedFileName, oversized, oversized.size());
+    ASSERT_IS_TRUE(!PriorsCache::read(corruptedFileName, key, loaded));
+
+    std::remove(fileName.c_str());
+    std::remove(corruptedFileName.c_str());
+}
+
+/*
+ * Readers running concurrently with the writer never see a torn publication: the values, the
+ * timestamp and the tag of every read come from the same publication, whose number is returned
+ * as sequence and never decreases.
+ */
+void testSeqLockChannel()
+{
+    const std::size_t size = 64;
+    const std::uint64_t numberOfPublications = 200000;
+
+    hde::utils::SeqLockChannel channel;
+    channel.resize(size);
+
+    std::vector<double> values(size);
+    std::uint64_t sequence = 0;
+    double timestamp = 0;
+    ASSERT_IS_TRUE(!channel.read(values.data(), sequence, timestamp));
+
+    std::vector<std::thread> readers;
+    std::vector<char> isConsistent(3, true);
+    for (std::size_t reader = 0; reader < isConsistent.size(); ++reader) {
+        readers.emplace_back([&channel, &isConsistent, reader, size, numberOfPublications]() {
+            std::vector<double> read(size);
+            std::uint64_t lastSequence = 0;
+            std::uint64_t sequence = 0;
+            std::uint64_t tag = 0;
+            double timestamp = 0;
+            bool consistent = true;
+
+            while (lastSequence < numberOfPublications) {
+                if (!channel.read(read.data(), sequence, timestamp, tag)) {
+                    continue;
+                }
+                const double expected = static_cast<double>(sequence);
+                for (const double value : read) {
+                    consistent = consistent && value == expected;
+                }
+                consistent = consistent && timestamp == expected && tag == sequence && sequence >= lastSequence;
+                lastSequence = sequence;
+            }
+            isConsistent[reader] = consistent;
+        });
+    }
+
+    // The publication k has all the values, the timestamp and the tag equal to k
+    for (std::uint64_t publication = 1; publication <= numberOfPublications; ++publication) {
+        std::fill(values.begin(), values.end(), static_cast<double>(publication));
+        channel.publish(values.data(), static_cast<double>(publication), publication);
+    }
+
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    for (const char consistent : isConsistent) {
+        ASSERT_IS_TRUE(consistent);
+    }
+}
+
+/*
+ * Every duration falls in a bucket whose upper bound is within 12.5% above it, the quantiles
+ * are the bounds of the buckets of their ranks, capped at the exact maximum, and the overruns
+ * are the samples longer than the threshold.
+ */
+void testLatencyHistogram()
+{
+    using hde::utils::LatencyHistogram;
+    using Nanoseconds = std::chrono::nanoseconds;
+
+    LatencyHistogram histogram;
+    LatencyHistogram::Statistics statistics = histogram.statistics();
+    ASSERT_IS_TRUE(statistics.count == 0 && statistics.p50 == 0 && statistics.p99 == 0 && statistics.max == 0);
+
+    // Geometric steps and the powers of two with their neighbours
+    const std::uint64_t longest = std::uint64_t(1) << 40;
+    std::vector<std::uint64_t> durations;
+    for (std::uint64_t duration = 0; duration < longest; duration += 1 + duration / 7) {
+        durations.push_back(duration);
+    }
+    for (std::uint64_t power = 8; power < longest; power *= 2) {
+        durations.insert(durations.end(), {power - 1, power, power + 1});
+    }
+
+    // With a longer second sample the median is the upper bound of the bucket of the first one
+    for (const std::uint64_t duration : durations) {
+        histogram.reset();
+        histogram.record(Nanoseconds(duration));
+        histogram.record(Nanoseconds(longest));
+
+        const double median = histogram.statistics().p50 * 1e9;
+        ASSERT_IS_TRUE(median >= duration * (1 - 1e-12) && median <= 1.125 * duration + 1);
+    }
+
+    // 1, 2, ..., 1000 us
+    histogram.reset();
+    histogram.setOverrunThreshold(900e-6);
+    for (int microseconds = 1; microseconds <= 1000; ++microseconds) {
+        histogram.record(std::chrono::microseconds(microseconds));
+    }
+
+    statistics = histogram.statistics();
+    ASSERT_IS_TRUE(statistics.count == 1000);
+    ASSERT_IS_TRUE(std::abs(statistics.max - 1000e-6) < 1e-12);
+    ASSERT_IS_TRUE(statistics.p50 >= 500e-6 - 1e-12 && statistics.p50 <= 1.125 * 500e-6);
+    ASSERT_IS_TRUE(statistics.p99 >= 990e-6 - 1e-12 && statistics.p99 <= statistics.max);
+    ASSERT_IS_TRUE(statistics.overruns == 100);
+
+    histogram.reset();
+    statistics = histogram.statistics();
+    ASSERT_IS_TRUE(statistics.count == 0 && statistics.max == 0 && statistics.overruns == 0);
+}
+
+/*
+ * Diagonal and dense symmetric blocks separated by random gaps give the same compressed matrix
+ * of setFromTriplets(): the same outer and inner indices and the same values. Overlapping and
+ * exceeding blocks are rejected without changing the matrix.
+ */
+void testBlockDiagonalMatrixBuilder()
+{
+    using hde::utils::BlockDiagonalMatrixBuilder;
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> blockSizes(1, 6);
+    std::uniform_int_distribution<int> gaps(0, 2);
+    std::uniform_real_distribution<double> values(-1.0, 1.0);
+
+    const Eigen::Index size = 500;
+    BlockDiagonalMatrixBuilder builder;
+
+    for (int repetition = 0; repetition < 2; ++repetition) {
+        builder.reset(size);
+        builder.reserve(size * 6);
+
+        std::vector<Eigen::Triplet<double>> triplets;
+        Eigen::Index numberOfEmptyColumns = 0;
+        Eigen::Index offset = gaps(generator);
+        numberOfEmptyColumns += offset;
+
+        while (true) {
+            const Eigen::Index blockSize = blockSizes(generator);
+            if (offset + blockSize > size) {
+                break;
+            }
+
+            if (blockSize % 2 == 0) {
+                std::vector<double> diagonal(blockSize);
+                for (Eigen::Index i = 0; i < blockSize; ++i) {
+                    diagonal[i] = values(generator);
+                    triplets.emplace_back(offset + i, offset + i, diagonal[i]);
+                }
+                ASSERT_IS_TRUE(builder.appendDiagonalBlock(offset, diagonal.data(), blockSize));
+            }
+            else {
+                std::vector<double> block(blockSize * blockSize);
+                for (Eigen::Index i = 0; i < blockSize; ++i) {
+                    for (Eigen::Index j = 0; j <= i; ++j) {
+                        block[i * blockSize + j] = block[j * blockSize + i] = values(generator);
+                    }
+                }
+                for (Eigen::Index i = 0; i < blockSize; ++i) {
+                    for (Eigen::Index j = 0; j < blockSize; ++j) {
+                        triplets.emplace_back(offset + i, offset + j, block[i * blockSize + j]);
+                    }
+                }
+                ASSERT_IS_TRUE(builder.appendDenseBlock(offset, block.data(), blockSize));
+            }
+
+            // Overlapping the last block or exceeding the matrix
+            const double value = 1.0;
+            ASSERT_IS_TRUE(!builder.appendDiagonalBlock(offset + blockSize - 1, &value, 1));
+            ASSERT_IS_TRUE(!builder.appendDiagonalBlock(size, &value, 1));
+            ASSERT_IS_TRUE(!builder.appendDiagonalBlock(offset + blockSize, &value, 0));
+
+            const Eigen::Index gap = gaps(generator);
+            numberOfEmptyColumns += gap;
+            offset += blockSize + gap;
+        }
+        numberOfEmptyColumns += std::max<Eigen::Index>(size - offset, 0);
+        ASSERT_IS_TRUE(builder.numberOfEmptyColumns() == numberOfEmptyColumns);
+
+        BlockDiagonalMatrixBuilder::SparseMatrix matrix;
+        builder.build(matrix);
+
+        BlockDiagonalMatrixBuilder::SparseMatrix expected(size, size);
+        expected.setFromTriplets(triplets.begin(), triplets.end());
+        expected.makeCompressed();
+
+        ASSERT_IS_TRUE(matrix.isCompressed());
+        ASSERT_IS_TRUE(matrix.rows() == size && matrix.cols() == size);
+        ASSERT_IS_TRUE(matrix.nonZeros() == expected.nonZeros());
+        ASSERT_IS_TRUE(
+            std::equal(expected.outerIndexPtr(), expected.outerIndexPtr() + size + 1, matrix.outerIndexPtr()));
+        ASSERT_IS_TRUE(std::equal(
+            expected.innerIndexPtr(), expected.innerIndexPtr() + expected.nonZeros(), matrix.innerIndexPtr()));
+        ASSERT_IS_TRUE(
+            std::equal(expected.valuePtr(), expected.valuePtr() + expected.nonZeros(), matrix.valuePtr()));
+    }
+}
+
+int main()
+{
+    testPriorsCache();
+    testSeqLockChannel();
+    testLatencyHistogram();
+    testBlockDiagonalMatrixBuilder();
+
+    return EXIT_SUCCESS;
+}
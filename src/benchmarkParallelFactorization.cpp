@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+// Benchmark of the parallel numeric factorization of FactorizedMAPSolver on the BERDY problem
+// of a random configuration of one or more models, with the priors of the device.
+//
+// Usage: benchmarkParallelFactorization <model.urdf> [<model.urdf> ...]
+//
+// Prints a JSON array with the average time of an estimation step for 1, 2, 4, ... threads,
+// up to the hardware concurrency, and the speedup over one thread.
+
+#include "FactorizedMAPSolver.h"
+#include <ModelTestUtils.h>
+
+#include <iDynTree/Core/EigenHelpers.h>
+#include <iDynTree/Core/EigenSparseHelpers.h>
+#include <iDynTree/Estimation/BerdyHelper.h>
+#include <iDynTree/ModelIO/ModelLoader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+using namespace iDynTree;
+
+namespace {
+    const std::size_t NumberOfSteps = 100;
+
+    // Same order of magnitude of the default priors of the device
+    const double DynamicsVariance = 1e4;
+    const double ConstraintsVariance = 1e-4;
+    const double MeasurementsVariance = 1e-2;
+} // namespace
+
+int main(int argc, char** argv)
+{
+    using hde::estimation::FactorizedMAPSolver;
+
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <model.urdf> [<model.urdf> ...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::size_t maxThreads = std::max(2u, std::thread::hardware_concurrency());
+    std::cout << "[";
+
+    for (int i = 1; i < argc; ++i) {
+        ModelLoader loader;
+        if (!loader.loadModelFromFile(argv[i]) || !loader.isValid()) {
+            std::cerr << "Failed to load the model " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        BerdyHelper berdy;
+        BerdyOptions options;
+        options.berdyVariant = iDynTree::BERDY_FLOATING_BASE;
+        options.includeAllNetExternalWrenchesAsDynamicVariables = true;
+        options.includeAllNetExternalWrenchesAsSensors = true;
+        options.includeAllJointTorquesAsSensors = true;
+        if (!berdy.init(loader.model(), loader.sensors(), options)) {
+            std::cerr << "Failed to initialize BERDY for the model " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        FreeFloatingPos pos(berdy.model());
+        FreeFloatingVel vel(berdy.model());
+        FreeFloatingAcc generalizedProperAccs(berdy.model());
+        LinkNetExternalWrenches extWrenches(berdy.model());
+        getRandomInverseDynamicsInputs(pos, vel, generalizedProperAccs, extWrenches);
+
+        const LinkIndex baseIdx = berdy.dynamicTraversal().getBaseLink()->getIndex();
+        berdy.updateKinematicsFromFloatingBase(pos.jointPos(), vel.jointVel(), baseIdx, vel.baseVel().getAngularVec3());
+
+        SparseMatrix<iDynTree::ColumnMajor> D, Y;
+        VectorDynSize bD, bY;
+        berdy.resizeAndZeroBerdyMatrices(D, bD, Y, bY);
+        if (!berdy.getBerdyMatrices(D, bD, Y, bY)) {
+            std::cerr << "Failed to compute the BERDY matrices of the model " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        VectorDynSize y(berdy.getNrOfSensorsMeasurements());
+        getRandomVector(y, -1.0, 1.0);
+
+        const Eigen::VectorXd mu_d = Eigen::VectorXd::Zero(D.columns());
+        FactorizedMAPSolver::SparseMatrix sigma_d(D.columns(), D.columns());
+        FactorizedMAPSolver::SparseMatrix sigma_D(D.rows(), D.rows());
+        FactorizedMAPSolver::SparseMatrix sigma_y(Y.rows(), Y.rows());
+        sigma_d.setIdentity();
+        sigma_d *= DynamicsVariance;
+        sigma_D.setIdentity();
+        sigma_D *= ConstraintsVariance;
+        sigma_y.setIdentity();
+        sigma_y *= MeasurementsVariance;
+
+        std::cout << (i == 1 ? "\n" : ",\n") << "{\"model\": \"" << argv[i] << "\", \"steps\": [";
+
+        double sequentialTime = 0;
+        for (std::size_t threads = 1; threads <= maxThreads; threads *= 2) {
+            FactorizedMAPSolver parallel;
+            bool ok = parallel.setDynamicsRegularizationPrior(mu_d, sigma_d)
+                      && parallel.setDynamicsConstraintsPriorCovariance(sigma_D)
+                      && parallel.setMeasurementsPriorCovariance(sigma_y) && parallel.setNumberOfThreads(threads)
+                      && parallel.doEstimate(toEigen(D), toEigen(bD), toEigen(Y), toEigen(bY), toEigen(y));
+
+            const auto begin = std::chrono::steady_clock::now();
+            for (std::size_t step = 0; ok && step < NumberOfSteps; ++step) {
+                ok = parallel.doEstimate(toEigen(D), toEigen(bD), toEigen(Y), toEigen(bY), toEigen(y));
+            }
+            const double time =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() / NumberOfSteps;
+
+            if (!ok) {
+                std::cerr << "Failed to estimate with " << threads << " threads for the model " << argv[i]
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+            sequentialTime = threads == 1 ? time : sequentialTime;
+
+            std::cout << (threads == 1 ? "" : ", ") << "{\"threads\": " << threads << ", \"step_us\": " << time * 1e6
+                      << ", \"speedup\": " << sequentialTime / time << "}";
+        }
+        std::cout << "]}";
+    }
+
+    std::cout << "\n]" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+// Benchmark of the parsing of the PRIORS and SENSORS_REMOVAL groups on synthetic chains of
+// growing size. Every link has a net external wrench sensor and an accelerometer, every joint
+// a DOF acceleration sensor. The PRIORS group has a specific element for every wrench and DOF
+// acceleration sensor, the SENSORS_REMOVAL group removes every other accelerometer.
+//
+// Usage: benchmarkPriorsParsing [<output directory>]
+//
+// Prints a JSON array with the time of the sensors_removal and priors_parsing phases of
+// HumanDynamicsEstimator::open(). The time per configured element should stay constant as
+// the number of sensors grows.
+
+#include "berdyUnitTest.h"
+
+#include <yarp/os/Property.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+    const std::size_t NumberOfLinks[] = {250, 500, 1000, 2000};
+
+    std::string linkName(const std::size_t index)
+    {
+        return "link" + std::to_string(index);
+    }
+
+    std::string jointName(const std::size_t index)
+    {
+        return "joint" + std::to_string(index);
+    }
+
+    std::string accelerometerName(const std::size_t index)
+    {
+        return "accelerometer" + std::to_string(index);
+    }
+
+    bool writeChainURDF(const std::string& fileName, const std::size_t numberOfLinks)
+    {
+        std::ofstream urdf(fileName);
+        urdf << "<?xml version=\"1.0\"?>\n<robot name=\"chain\">\n";
+
+        for (std::size_t i = 0; i < numberOfLinks; ++i) {
+            urdf << "  <link name=\"" << linkName(i) << "\">\n"
+                 << "    <inertial>\n"
+                 << "      <origin xyz=\"0 0 0.05\" rpy=\"0 0 0\"/>\n"
+                 << "      <mass value=\"1.0\"/>\n"
+                 << "      <inertia ixx=\"0.01\" ixy=\"0\" ixz=\"0\" iyy=\"0.01\" iyz=\"0\" izz=\"0.01\"/>\n"
+                 << "    </inertial>\n"
+                 << "  </link>\n";
+
+            if (i > 0) {
+                urdf << "  <joint name=\"" << jointName(i) << "\" type=\"revolute\">\n"
+                     << "    <origin xyz=\"0 0 0.1\" rpy=\"0 0 0\"/>\n"
+                     << "    <axis xyz=\"0 " << (i % 2) << " " << (1 - i % 2) << "\"/>\n"
+                     << "    <parent link=\"" << linkName(i - 1) << "\"/>\n"
+                     << "    <child link=\"" << linkName(i) << "\"/>\n"
+                     << "    <limit effort=\"100\" lower=\"-3.14\" upper=\"3.14\" velocity=\"10\"/>\n"
+                     << "  </joint>\n";
+            }
+
+            urdf << "  <sensor name=\"" << accelerometerName(i) << "\" type=\"accelerometer\">\n"
+                 << "    <parent link=\"" << linkName(i) << "\"/>\n"
+                 << "    <origin xyz=\"0 0 0.05\" rpy=\"0 0 0\"/>\n"
+                 << "  </sensor>\n";
+        }
+
+        urdf << "</robot>\n";
+        return static_cast<bool>(urdf);
+    }
+
+    // Configuration in the Property syntax, the groups are nested lists
+    std::string chainConfiguration(const std::string& urdfFileName, const std::size_t numberOfLinks)
+    {
+        std::ostringstream config;
+        config << "(urdf \"" << urdfFileName << "\") (baseLink " << linkName(0) << ")"
+               << " (number_of_wrench_sensors 1) (wrench_sensors_link_name (" << linkName(0) << "))"
+               << " (warm_up none)";
+
+        std::ostringstream wrenches;
+        std::ostringstream accelerations;
+        std::ostringstream removals;
+        for (std::size_t i = 0; i < numberOfLinks; ++i) {
+            wrenches << " (" << linkName(i) << " (2.0 2.0 2.0 3.0 3.0 3.0))";
+            if (i > 0) {
+                accelerations << " (" << jointName(i) << " 2.0)";
+            }
+            if (i % 2 == 1) {
+                removals << " " << accelerometerName(i);
+            }
+        }
+
+        config << " (PRIORS (mu_dyn_variables 0.0) (cov_dyn_variables 1.0e+4) (cov_dyn_constraints 1.0e-4)"
+               << " (cov_measurements_ACCELEROMETER_SENSOR (1.0 1.0 1.0))"
+               << " (cov_measurements_NET_EXT_WRENCH_SENSOR (value 1.0) (specific_elements (";
+        for (std::size_t i = 0; i < numberOfLinks; ++i) {
+            config << " " << linkName(i);
+        }
+        config << "))" << wrenches.str() << ")"
+               << " (cov_measurements_DOF_ACCELERATION_SENSOR (value 1.0) (specific_elements (";
+        for (std::size_t i = 1; i < numberOfLinks; ++i) {
+            config << " " << jointName(i);
+        }
+        config << "))" << accelerations.str() << "))";
+
+        config << " (SENSORS_REMOVAL (ACCELEROMETER_SENSOR (" << removals.str() << ")))";
+        return config.str();
+    }
+
+    // Wall time of a phase of the startup report, negative if not found
+    double phaseWallTime(const std::string& report, const std::string& phase)
+    {
+        const std::string key = "{\"name\": \"" + phase + "\", \"wall_time_s\": ";
+        const std::size_t position = report.find(key);
+        if (position == std::string::npos) {
+            return -1;
+        }
+        return std::strtod(report.c_str() + position + key.size(), nullptr);
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* temporaryDirectory = std::getenv("TMPDIR");
+    const std::string directory = argc > 1 ? argv[1] : (temporaryDirectory ? temporaryDirectory : "/tmp");
+
+    std::cout << "[";
+    bool first = true;
+
+    for (const std::size_t numberOfLinks : NumberOfLinks) {
+        const std::string urdfFileName =
+            directory + "/benchmarkPriorsParsing_" + std::to_string(numberOfLinks) + ".urdf";
+        if (!writeChainURDF(urdfFileName, numberOfLinks)) {
+            std::cerr << "Failed to write " << urdfFileName << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        yarp::os::Property config;
+        config.fromString(chainConfiguration(urdfFileName, numberOfLinks));
+
+        hde::modules::HumanDynamicsEstimator estimator;
+        if (!estimator.open(config)) {
+            std::cerr << "Failed to open the estimator with " << numberOfLinks << " links" << std::endl;
+            std::remove(urdfFileName.c_str());
+            return EXIT_FAILURE;
+        }
+
+        const std::string report = estimator.getStartupReport();
+        estimator.close();
+        std::remove(urdfFileName.c_str());
+
+        // Wrench sensors, DOF acceleration sensors and accelerometers
+        const std::size_t numberOfSensors = 3 * numberOfLinks - 1;
+        // Specific elements of the PRIORS group and removed sensors
+        const std::size_t numberOfElements = 2 * numberOfLinks - 1 + numberOfLinks / 2;
+        const double sensorsRemoval = phaseWallTime(report, "sensors_removal");
+        const double priorsParsing = phaseWallTime(report, "priors_parsing");
+
+        std::cout << (first ? "\n" : ",\n") << "{\"links\": " << numberOfLinks << ", \"sensors\": " << numberOfSensors
+                  << ", \"configured_elements\": " << numberOfElements
+                  << ", \"sensors_removal_s\": " << sensorsRemoval << ", \"priors_parsing_s\": " << priorsParsing
+                  << ", \"per_element_us\": " << 1e6 * (sensorsRemoval + priorsParsing) / numberOfElements << "}";
+        first = false;
+    }
+
+    std::cout << "\n]" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -7,10 +7,24 @@
  */
 
 #include "berdyUnitTest.h"
+#include "AllocationMonitor.h"
+#include "BinaryFile.h"
+#include "BlockDiagonalMatrixBuilder.h"
+#include "FactorizedMAPSolver.h"
+#include "FixedThreadPool.h"
+#include "KinematicTreeOrdering.h"
+#include "LatencyHistogram.h"
+#include "ModelSnapshot.h"
+#include "OrderingSelection.h"
+#include "PriorsCache.h"
+#include "SPSCRingBuffer.h"
+#include "SeqLockChannel.h"
+#include "StartupProfiler.h"
 
 //#include "IHumanState.h"
 //#include "IHumanWrench.h"
 
+#include <Eigen/Cholesky>
 #include <Eigen/SparseCholesky>
 #include <Eigen/SparseCore>
 #include <Eigen/SparseLU>
@@ -22,7 +36,6 @@
 #include <iDynTree/Core/Triplets.h>
 #include <iDynTree/Core/Wrench.h>
 #include <iDynTree/Estimation/BerdyHelper.h>
-#include <iDynTree/Estimation/BerdySparseMAPSolver.h>
 #include <iDynTree/Model/ContactWrench.h>
 #include <iDynTree/Model/Model.h>
 #include <iDynTree/ModelIO/ModelLoader.h>
@@ -31,17 +44,37 @@
 
 #include <yarp/os/LogStream.h>
 #include <yarp/os/ResourceFinder.h>
+#include <yarp/os/Time.h>
 #include <yarp/dev/IAnalogSensor.h>
+#include <yarp/sig/Vector.h>
 #include <iDynTree/yarp/YARPConversions.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <limits>
 #include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 const std::string DeviceName = "HumanDynamicsEstimator";
 const std::string LogPrefix = DeviceName + " :";
 constexpr double DefaultPeriod = 0.01;
+constexpr size_t PipelineCapacity = 4;
+// Acquisition, kinematics and solver
+constexpr size_t NumberOfPipelineStages = 3;
+// Number of contiguous samples processed by a worker of the batch estimation
+constexpr size_t BatchChunkSize = 512;
 
 using namespace hde::modules;
 
@@ -103,11 +136,45 @@ struct SensorKeyHash
 
 typedef std::unordered_map<SensorKey, iDynTree::IndexRange, SensorKeyHash> SensorMapIndex;
 
+// Flat description of how the input channels are scattered into the measurements vector y.
+// It is compiled once in open() from the berdy sensors ordering, so that run() only has to
+// execute it without any hashing, string comparison or allocation.
+struct MeasurementScatterPlan
+{
+    struct Copy
+    {
+        size_t sourceOffset; // offset in the wrench values read from the attached wrench provider
+        size_t destinationOffset; // offset in the measurements vector y
+        size_t size;
+    };
+
+    // Ranges of y filled with the wrench sources
+    std::vector<Copy> wrenchCopies;
+    // Ranges of y that are not fed by any input and are filled with zeros
+    std::vector<iDynTree::IndexRange> zeroRanges;
+    // Minimum size of the wrench values vector required by the copies
+    size_t requiredNumberOfWrenchValues = 0;
+
+    void execute(const double* wrenchValues, iDynTree::VectorDynSize& measurements) const
+    {
+        double* y = measurements.data();
+
+        for (const iDynTree::IndexRange& range : zeroRanges) {
+            std::fill_n(y + range.offset, range.size, 0.0);
+        }
+
+        for (const Copy& copy : wrenchCopies) {
+            std::copy_n(wrenchValues + copy.sourceOffset, copy.size, y + copy.destinationOffset);
+        }
+    }
+};
+
 // This function processes the covariance option in the following way:
 // - double: if a single value is passed, it resizes the vector argument to match the
 //           number of values expected from the sensor type
 // - list: validates that the number of elements passed in the options match the
-//         number of values expected from the sensor type
+//         number of values expected from the sensor type, or its square for a full
+//         symmetric covariance block passed in row-major order
 static bool getVectorWithFullCovarianceValues(const std::string& optionName,
                                               std::vector<double>& values)
 {
@@ -143,10 +210,11 @@ static bool getVectorWithFullCovarianceValues(const std::string& optionName,
 
     // Validate list size
     if (values.size() > 1) {
-        if (values.size() != mapBerdySensorInfo[optionName].size) {
+        const size_t sensorSize = mapBerdySensorInfo[optionName].size;
+        if (values.size() != sensorSize && values.size() != sensorSize * sensorSize) {
             yError() << LogPrefix << "The list size from the option (" << values.size()
                      << ") do not match the expected size of the" << optionName << "sensor ("
-                     << mapBerdySensorInfo[optionName].size << ")";
+                     << sensorSize << ") or of its full covariance (" << sensorSize * sensorSize << ")";
             return false;
         }
 
@@ -161,42 +229,61 @@ static bool getVectorWithFullCovarianceValues(const std::string& optionName,
 
 struct BerdyData
 {
-    std::unique_ptr<iDynTree::BerdySparseMAPSolver> solver = nullptr;
+    hde::estimation::FactorizedMAPSolver solver;
     iDynTree::BerdyHelper helper;
 
+    // Stored in compressed sparse column form, the same used by the solver and the priors cache
     struct Priors
     {
+        using SparseMatrix = hde::estimation::FactorizedMAPSolver::SparseMatrix;
+
         // Regularization priors
-        iDynTree::VectorDynSize dynamicsRegularizationExpectedValueVector; // mu_d
-        iDynTree::SparseMatrix<iDynTree::ColumnMajor> dynamicsRegularizationCovarianceMatrix; // sigma_d
+        Eigen::VectorXd dynamicsRegularizationExpectedValueVector; // mu_d
+        SparseMatrix dynamicsRegularizationCovarianceMatrix; // sigma_d
 
         // Dynamic constraint prior
-        iDynTree::SparseMatrix<iDynTree::ColumnMajor> dynamicsConstraintsCovarianceMatrix; // sigma_D
+        SparseMatrix dynamicsConstraintsCovarianceMatrix; // sigma_D
 
         // Measurements prior
-        iDynTree::SparseMatrix<iDynTree::ColumnMajor> measurementsCovarianceMatrix; // sigma_y
+        SparseMatrix measurementsCovarianceMatrix; // sigma_y
 
-        static void
-        initializeSparseMatrixSize(size_t size,
-                                   iDynTree::SparseMatrix<iDynTree::ColumnMajor>& matrix)
+        static void initializeSparseMatrixSize(size_t size, SparseMatrix& matrix)
         {
-            iDynTree::Triplets identityTriplets;
-            identityTriplets.reserve(size);
+            matrix.resize(size, size);
+            matrix.setIdentity();
+        }
 
-            // Set triplets to Identity
-            identityTriplets.setDiagonalMatrix(0, 0, 1.0, size);
+        static void setFromTriplets(const iDynTree::Triplets& triplets, size_t size, SparseMatrix& matrix)
+        {
+            std::vector<Eigen::Triplet<double>> eigenTriplets;
+            eigenTriplets.reserve(triplets.size());
+            for (const iDynTree::Triplet& triplet : triplets) {
+                eigenTriplets.emplace_back(triplet.row, triplet.column, triplet.value);
+            }
 
             matrix.resize(size, size);
-            matrix.setFromTriplets(identityTriplets);
+            matrix.setFromTriplets(eigenTriplets.begin(), eigenTriplets.end());
         }
     } priors;
 
     struct Buffers
     {
         iDynTree::VectorDynSize measurements;
+        iDynTree::VectorDynSize estimatedDynamicVariables;
 
+        // Input buffers filled by the attached interfaces
+        yarp::sig::Vector wrenchValues;
     } buffers;
 
+    // BERDY matrices: D*d + bD = 0 and y = Y*d + bY
+    struct Matrices
+    {
+        iDynTree::SparseMatrix<iDynTree::ColumnMajor> D;
+        iDynTree::SparseMatrix<iDynTree::ColumnMajor> Y;
+        iDynTree::VectorDynSize bD;
+        iDynTree::VectorDynSize bY;
+    } matrices;
+
     struct KinematicState
     {
         iDynTree::FrameIndex floatingBaseFrameIndex;
@@ -213,6 +300,124 @@ struct BerdyData
     } estimates;    
 };
 
+static bool setSolverPriors(const BerdyData::Priors& priors, hde::estimation::FactorizedMAPSolver& solver)
+{
+    if (!solver.setDynamicsRegularizationPrior(priors.dynamicsRegularizationExpectedValueVector,
+                                               priors.dynamicsRegularizationCovarianceMatrix)) {
+        yError() << LogPrefix << "Failed to set the DynamicsRegularizationPrior to the Berdy solver";
+        return false;
+    }
+
+    if (!solver.setDynamicsConstraintsPriorCovariance(priors.dynamicsConstraintsCovarianceMatrix)) {
+        yError() << LogPrefix << "Failed to set the DynamicsConstraintsPriorCovariance to the Berdy solver";
+        return false;
+    }
+
+    if (!solver.setMeasurementsPriorCovariance(priors.measurementsCovarianceMatrix)) {
+        yError() << LogPrefix << "Failed to set the MeasurementsPriorCovariance to the Berdy solver";
+        return false;
+    }
+
+    return true;
+}
+
+// Single precision factorization with iterative refinement, enabled by the MIXED_PRECISION group
+static bool parseMixedPrecisionGroup(const yarp::os::Bottle& mixedPrecisionGroup,
+                                     hde::estimation::FactorizedMAPSolver& solver)
+{
+    double tolerance = hde::estimation::FactorizedMAPSolver::DefaultRefinementTolerance;
+    size_t maxRefinementSteps = hde::estimation::FactorizedMAPSolver::DefaultMaxRefinementSteps;
+
+    if (mixedPrecisionGroup.check("tolerance")) {
+        if (!(mixedPrecisionGroup.find("tolerance").isFloat64()
+              && mixedPrecisionGroup.find("tolerance").asFloat64() > 0)) {
+            yError() << LogPrefix << "Parameter 'tolerance' of the MIXED_PRECISION group invalid";
+            return false;
+        }
+        tolerance = mixedPrecisionGroup.find("tolerance").asFloat64();
+    }
+
+    if (mixedPrecisionGroup.check("max_refinement_steps")) {
+        if (!(mixedPrecisionGroup.find("max_refinement_steps").isInt()
+              && mixedPrecisionGroup.find("max_refinement_steps").asInt() >= 0)) {
+            yError() << LogPrefix << "Parameter 'max_refinement_steps' of the MIXED_PRECISION group invalid";
+            return false;
+        }
+        maxRefinementSteps = static_cast<size_t>(mixedPrecisionGroup.find("max_refinement_steps").asInt());
+    }
+
+    if (!solver.setMixedPrecision(true, tolerance, maxRefinementSteps)) {
+        return false;
+    }
+
+    yInfo() << LogPrefix << "Mixed precision solver with refinement tolerance" << tolerance << "and at most"
+            << maxRefinementSteps << "refinement steps";
+    return true;
+}
+
+// Block-Jacobi preconditioned conjugate gradient instead of the factorization, with the iterative
+// solver backend and the optional ITERATIVE group. The blocks of the preconditioner are the links
+// of the kinematic tree.
+static bool parseIterativeGroup(const yarp::os::Bottle& iterativeGroup,
+                                const iDynTree::BerdyHelper& berdy,
+                                hde::estimation::FactorizedMAPSolver& solver)
+{
+    double tolerance = hde::estimation::FactorizedMAPSolver::DefaultIterativeTolerance;
+    size_t maxIterations = hde::estimation::FactorizedMAPSolver::DefaultMaxIterations;
+
+    if (iterativeGroup.check("tolerance")) {
+        if (!(iterativeGroup.find("tolerance").isFloat64() && iterativeGroup.find("tolerance").asFloat64() > 0)) {
+            yError() << LogPrefix << "Parameter 'tolerance' of the ITERATIVE group invalid";
+            return false;
+        }
+        tolerance = iterativeGroup.find("tolerance").asFloat64();
+    }
+
+    if (iterativeGroup.check("max_iterations")) {
+        if (!(iterativeGroup.find("max_iterations").isInt() && iterativeGroup.find("max_iterations").asInt() > 0)) {
+            yError() << LogPrefix << "Parameter 'max_iterations' of the ITERATIVE group invalid";
+            return false;
+        }
+        maxIterations = static_cast<size_t>(iterativeGroup.find("max_iterations").asInt());
+    }
+
+    std::vector<hde::estimation::KinematicTreeOrdering::StorageIndex> blockOfVariable;
+    if (!hde::estimation::KinematicTreeOrdering::computeLinkGroups(berdy, blockOfVariable)) {
+        yError() << LogPrefix << "Failed to group the dynamic variables by link";
+        return false;
+    }
+
+    if (!solver.setIterative(true, blockOfVariable, tolerance, maxIterations)) {
+        return false;
+    }
+
+    yInfo() << LogPrefix << "Iterative solver with tolerance" << tolerance << "and at most" << maxIterations
+            << "iterations";
+    return true;
+}
+
+// Information of the previous estimate used as prior of the next one, enabled by the RECURSIVE group
+static bool parseRecursiveGroup(const yarp::os::Bottle& recursiveGroup, hde::estimation::FactorizedMAPSolver& solver)
+{
+    double forgettingFactor = hde::estimation::FactorizedMAPSolver::DefaultForgettingFactor;
+
+    if (recursiveGroup.check("forgetting_factor")) {
+        const double value = recursiveGroup.find("forgetting_factor").asFloat64();
+        if (!(recursiveGroup.find("forgetting_factor").isFloat64() && value > 0 && value < 1)) {
+            yError() << LogPrefix << "Parameter 'forgetting_factor' of the RECURSIVE group must be in (0, 1)";
+            return false;
+        }
+        forgettingFactor = value;
+    }
+
+    if (!solver.setRecursive(true, forgettingFactor)) {
+        return false;
+    }
+
+    yInfo() << LogPrefix << "Recursive estimation with forgetting factor" << forgettingFactor;
+    return true;
+}
+
 // Creates an iDynTree sparse matrix (set of triplets) from a vector
 static bool getSparseCovarianceMatrix(const std::vector<double>& values,
                                       iDynTree::Triplets& covarianceMatrix)
@@ -240,9 +445,94 @@ static bool getSparseCovarianceMatrix(const std::vector<double>& values,
     return true;
 }
 
-static bool getTripletsFromPriorGroupCase1Case2(const yarp::os::Value& covMeasurementOption,
-                                                const std::string& sensorType,
-                                                iDynTree::Triplets& triplets)
+// Covariance of the measurements of a single sensor
+struct CovarianceBlock
+{
+    size_t size = 0;
+    bool isDense = false;
+    std::vector<double> values; // diagonal, or full symmetric matrix in row-major order
+};
+
+// Creates a covariance block of the given size from either its variances or its full
+// matrix in row-major order
+static bool getCovarianceBlockOfSize(const std::vector<double>& values, const size_t size, CovarianceBlock& block)
+{
+    if (size == 0 || (values.size() != size && values.size() != size * size)) {
+        yError() << LogPrefix << "Expected" << size << "variances or a full covariance of" << size * size
+                 << "values, found" << values.size() << "values";
+        return false;
+    }
+
+    block.isDense = size > 1 && values.size() == size * size;
+    block.size = size;
+    block.values = values;
+
+    for (size_t i = 0; i < block.size; ++i) {
+        // Check that the variances are not zero since we need to take the inverse
+        const double variance = block.isDense ? values[i * block.size + i] : values[i];
+        if (variance == 0) {
+            yError() << LogPrefix
+                     << "The covariance value specified in the options is 0 and it not allowed";
+            return false;
+        }
+
+        for (size_t j = 0; block.isDense && j < i; ++j) {
+            if (values[i * block.size + j] != values[j * block.size + i]) {
+                yError() << LogPrefix << "The full covariance specified in the options is not symmetric";
+                return false;
+            }
+        }
+    }
+
+    // The inverse of a full covariance is computed by the solver, then it must be positive definite
+    if (block.isDense) {
+        const Eigen::LDLT<Eigen::MatrixXd> factorization(
+            Eigen::Map<const Eigen::MatrixXd>(values.data(), block.size, block.size));
+        if (factorization.info() != Eigen::Success || !(factorization.vectorD().minCoeff() > 0)) {
+            yError() << LogPrefix << "The full covariance specified in the options is not positive definite";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Creates the covariance block of a sensor from the values processed by
+// getVectorWithFullCovarianceValues
+static bool getCovarianceBlock(const std::vector<double>& values, CovarianceBlock& block)
+{
+    if (values.size() == 0) {
+        yError() << LogPrefix << "Trying to parse a covariance block with 0 elements";
+        return false;
+    }
+
+    // Sensors have at most 6 measurements, then 9 and 36 values are always full blocks
+    size_t size = 1;
+    while (size * size < values.size()) {
+        ++size;
+    }
+
+    return getCovarianceBlockOfSize(values, size * size == values.size() ? size : values.size(), block);
+}
+
+static void toSparseMatrix(const CovarianceBlock& block, BerdyData::Priors::SparseMatrix& matrix)
+{
+    hde::utils::BlockDiagonalMatrixBuilder builder;
+    builder.reset(block.size);
+
+    if (block.isDense) {
+        builder.appendDenseBlock(0, block.values.data(), block.size);
+    }
+    else {
+        builder.appendDiagonalBlock(0, block.values.data(), block.size);
+    }
+
+    builder.build(matrix);
+}
+
+static bool getCovarianceBlockFromPriorGroupCase1Case2(const yarp::os::Value& covMeasurementOption,
+                                                       const std::string& sensorType,
+                                                       CovarianceBlock& block)
 {
     if (covMeasurementOption.isDouble()) {
         std::vector<double> covValues;
@@ -253,13 +543,13 @@ static bool getTripletsFromPriorGroupCase1Case2(const yarp::os::Value& covMeasur
             return false;
         }
 
-        if (!getSparseCovarianceMatrix(covValues, triplets)) {
+        if (!getCovarianceBlock(covValues, block)) {
             yError() << LogPrefix << "Failed to process covariance matrix for" << sensorType
                      << "sensor type";
             return false;
         }
 
-        // Triplet returned as function argument
+        // Block returned as function argument
         return true;
     }
 
@@ -282,13 +572,13 @@ static bool getTripletsFromPriorGroupCase1Case2(const yarp::os::Value& covMeasur
             return false;
         }
 
-        if (!getSparseCovarianceMatrix(covValues, triplets)) {
+        if (!getCovarianceBlock(covValues, block)) {
             yError() << LogPrefix << "Failed to process covariance matrix for" << sensorType
                      << "sensor type";
             return false;
         }
 
-        // Triplet returned as function argument
+        // Block returned as function argument
         return true;
     }
 
@@ -296,56 +586,73 @@ static bool getTripletsFromPriorGroupCase1Case2(const yarp::os::Value& covMeasur
     return true;
 }
 
-static bool getTripletsFromPriorGroup(const yarp::os::Bottle priorGroup,
-                                      const std::string& optionPrefix,
-                                      const std::string& sensorType,
-                                      iDynTree::Triplets& triplets,
-                                      const iDynTree::BerdySensor& sensor)
+// Covariance of the measurements of a sensor type, from the option cov_measurements_<type>.
+// Three cases:
+//
+// 1. Single value
+// 2. List of values
+// 3. Group with a 'value' parameter and exceptions for the sensors in 'specific_elements'
+struct MeasurementsCovarianceConfig
 {
-    // Three cases:
-    //
-    // 1. Single value
-    // 2. List of values
-    // 3. Group with a 'value' parameter and exceptions
+    CovarianceBlock value;
+    std::unordered_map<std::string, CovarianceBlock> specificElements; // sensor id -> covariance
+};
+
+// Options of the PRIORS group, read in a single pass over the group
+struct PriorsConfig
+{
+    bool setMuDynVariables = false;
+    bool setCovDynVariables = false;
+    bool setCovDynConstraints = false;
+
+    std::vector<double> muDynVariables; // mu_d
+    std::vector<double> covDynVariables; // sigma_d
+    std::vector<double> covDynConstraints; // sigma_D
+
+    // sigma_y, only the configured sensor types are present
+    std::unordered_map<iDynTree::BerdySensorTypes, MeasurementsCovarianceConfig> covMeasurements;
+};
 
-    // We are in case 3 if there is a group option with a value param inside
-    bool isCase3 = !priorGroup.findGroup(optionPrefix + sensorType).isNull()
-                   && priorGroup.findGroup(optionPrefix + sensorType).check("value");
-    double value = 0;
+static bool parseMeasurementsCovarianceConfig(const yarp::os::Bottle& priorsGroup,
+                                              const std::string& optionName,
+                                              const std::string& sensorType,
+                                              MeasurementsCovarianceConfig& config)
+{
+    const yarp::os::Bottle& covMeasurementGroup = priorsGroup.findGroup(optionName);
 
     // -----------------
     // Case 1 and Case 2
     // -----------------
 
-    if (!isCase3) {
-        // Get the option
-        yarp::os::Value& covMeasurementOption = priorGroup.find("cov_measurements_" + sensorType);
+    if (covMeasurementGroup.isNull() || !covMeasurementGroup.check("value")) {
+        const yarp::os::Value& covMeasurementOption = priorsGroup.find(optionName);
+
+        if (!covMeasurementOption.isDouble() && !covMeasurementOption.isList()) {
+            yError() << LogPrefix << "The option" << optionName
+                     << "must be either a double, a list of doubles or a group with the 'value' parameter";
+            return false;
+        }
 
-        // Case 1 and Case 2
-        if (!getTripletsFromPriorGroupCase1Case2(covMeasurementOption, sensorType, triplets)) {
+        if (!getCovarianceBlockFromPriorGroupCase1Case2(covMeasurementOption, sensorType, config.value)) {
             yError() << LogPrefix << "Failed to parse covariance data for sensor" << sensorType;
             return false;
         }
 
         return true;
     }
+
     // ------
     // Case 3
     // ------
-    else {
-        // Get the value option
-        yarp::os::Value& valueOption = priorGroup.findGroup(optionPrefix + sensorType).find("value");
 
-        // Initialize the triplet with the default value
-        if (!getTripletsFromPriorGroupCase1Case2(valueOption, sensorType, triplets)) {
-            yError() << LogPrefix << "Failed to parse the 'value' option for sensor" << sensorType;
-            return false;
-        }
+    // Default value of the sensors of this type
+    const yarp::os::Value& valueOption = covMeasurementGroup.find("value");
+    if ((!valueOption.isDouble() && !valueOption.isList())
+        || !getCovarianceBlockFromPriorGroupCase1Case2(valueOption, sensorType, config.value)) {
+        yError() << LogPrefix << "Failed to parse the 'value' option for sensor" << sensorType;
+        return false;
     }
 
-    // Parse the exceptions for sensors that have a different covariance than the default one
-    yarp::os::Bottle covMeasurementGroup = priorGroup.findGroup(optionPrefix + sensorType);
-
     // Check if specific_element list exists and is valid
     if (!(covMeasurementGroup.check("specific_elements")
           && covMeasurementGroup.find("specific_elements").isList())) {
@@ -354,8 +661,8 @@ static bool getTripletsFromPriorGroup(const yarp::os::Bottle priorGroup,
         return false;
     }
 
-    // Check if all subgroups associated with the specific_elements exist and are valid
-    yarp::os::Bottle* list = covMeasurementGroup.find("specific_elements").asList();
+    // Parse the exceptions for sensors that have a different covariance than the default one
+    const yarp::os::Bottle* list = covMeasurementGroup.find("specific_elements").asList();
     for (unsigned i = 0; i < list->size(); ++i) {
         // Get the specific element name
         if (!list->get(i).isString()) {
@@ -364,43 +671,37 @@ static bool getTripletsFromPriorGroup(const yarp::os::Bottle priorGroup,
         }
 
         // Check if the options associated to the specific element exists
-        std::string frameName = list->get(i).asString();
+        const std::string frameName = list->get(i).asString();
         if (!covMeasurementGroup.check(frameName)) {
             yError() << LogPrefix << "Failed to find specific option associated to sensor"
                      << frameName;
             return false;
         }
 
-        if (frameName == sensor.id) {
-            // Now it is as Case 1 and 2:
-            yarp::os::Value covMeasurementOfSpecificElement = covMeasurementGroup.find(frameName);
-
-            // This check allows sharing the same getTripletsFromPriorGroupCase1Case2 function
-            // for parsing Case 3
-            if (!covMeasurementOfSpecificElement.isDouble()
-                && !(covMeasurementOfSpecificElement.isList()
-                     && (covMeasurementOfSpecificElement.asList()->size() > 0))) {
-                yError() << LogPrefix << "The specific elements for"
-                         << "frameName should be either a double or a list of doubles";
-                return false;
-            }
+        const yarp::os::Value& covMeasurementOfSpecificElement = covMeasurementGroup.find(frameName);
+        if (!covMeasurementOfSpecificElement.isDouble()
+            && !(covMeasurementOfSpecificElement.isList()
+                 && (covMeasurementOfSpecificElement.asList()->size() > 0))) {
+            yError() << LogPrefix << "The specific elements for" << frameName
+                     << "should be either a double or a list of doubles";
+            return false;
+        }
 
-            // Parse the specific element reusing the Case1Case2 function
-            if (!getTripletsFromPriorGroupCase1Case2(
-                    covMeasurementOfSpecificElement, sensorType, triplets)) {
-                yError() << LogPrefix << "Failed to parse covariance data for specific element"
-                         << frameName;
-                return false;
-            }
+        // Parse the specific element as in Case 1 and 2
+        if (!getCovarianceBlockFromPriorGroupCase1Case2(
+                covMeasurementOfSpecificElement, sensorType, config.specificElements[frameName])) {
+            yError() << LogPrefix << "Failed to parse covariance data for specific element"
+                     << frameName;
+            return false;
         }
     }
 
     return true;
 }
 
-static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
-                             BerdyData& berdyData,
-                             const std::unordered_map<iDynTree::BerdySensorTypes, std::string>& mapBerdySensorType)
+static bool parsePriorsConfig(const yarp::os::Bottle& priorsGroup,
+                              const std::unordered_map<iDynTree::BerdySensorTypes, std::string>& mapBerdySensorType,
+                              PriorsConfig& config)
 {
     // =================
     // CHECK THE OPTIONS
@@ -412,20 +713,20 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
     }
 
     // mu_d
-    bool setMuDynVariables = priorsGroup.check("mu_dyn_variables");
-    if (!setMuDynVariables) {
+    config.setMuDynVariables = priorsGroup.check("mu_dyn_variables");
+    if (!config.setMuDynVariables) {
         yWarning() << LogPrefix << "Using default values for 'mu_dyn_variables' option";
     }
 
     // sigma_d
-    bool setCovDynVariables = priorsGroup.check("cov_dyn_variables");
-    if (!setCovDynVariables) {
+    config.setCovDynVariables = priorsGroup.check("cov_dyn_variables");
+    if (!config.setCovDynVariables) {
         yWarning() << LogPrefix << "Using default values for 'cov_dyn_variables' option";
     }
 
     // sigma_D
-    bool setCovDynConstraints = priorsGroup.check("cov_dyn_constraints");
-    if (!setCovDynConstraints) {
+    config.setCovDynConstraints = priorsGroup.check("cov_dyn_constraints");
+    if (!config.setCovDynConstraints) {
         yWarning() << LogPrefix << "Using default values for 'cov_dyn_constraints' option";
     }
 
@@ -433,28 +734,52 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
     // PARSE THE OPTIONS
     // =================
 
-    std::vector<double> muDynVariables; // mu_d
-    std::vector<double> covDynVariables; //sigma_d
-    std::vector<double> covDynConstraints; // sigma_D
-
-    if (setMuDynVariables
-        && !parseYarpValueToStdVector(priorsGroup.find("mu_dyn_variables"), muDynVariables)) {
+    if (config.setMuDynVariables
+        && !parseYarpValueToStdVector(priorsGroup.find("mu_dyn_variables"), config.muDynVariables)) {
         yError() << LogPrefix << "Failed to parse 'mu_dyn_variables' option";
         return false;
     }
 
-    if (setCovDynVariables
-        && !parseYarpValueToStdVector(priorsGroup.find("cov_dyn_variables"), covDynVariables)) {
+    if (config.setCovDynVariables
+        && !parseYarpValueToStdVector(priorsGroup.find("cov_dyn_variables"), config.covDynVariables)) {
         yError() << LogPrefix << "Failed to parse 'cov_dyn_variables' option";
         return false;
     }
 
-    if (setCovDynConstraints
-        && !parseYarpValueToStdVector(priorsGroup.find("cov_dyn_constraints"), covDynConstraints)) {
+    if (config.setCovDynConstraints
+        && !parseYarpValueToStdVector(priorsGroup.find("cov_dyn_constraints"), config.covDynConstraints)) {
         yError() << LogPrefix << "Failed to parse 'cov_dyn_constraints' option";
         return false;
     }
 
+    // The measurements covariances are read once per sensor type, not once per sensor
+    config.covMeasurements.clear();
+    for (const auto& sensorType : mapBerdySensorType) {
+        const std::string optionName = "cov_measurements_" + sensorType.second;
+
+        if (!priorsGroup.check(optionName)) {
+            continue;
+        }
+
+        if (!parseMeasurementsCovarianceConfig(
+                priorsGroup, optionName, sensorType.second, config.covMeasurements[sensorType.first])) {
+            yError() << LogPrefix << "Failed to parse the option" << optionName;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
+                             BerdyData& berdyData,
+                             const std::unordered_map<iDynTree::BerdySensorTypes, std::string>& mapBerdySensorType)
+{
+    PriorsConfig config;
+    if (!parsePriorsConfig(priorsGroup, mapBerdySensorType, config)) {
+        return false;
+    }
+
     // ==========================
     // PROCESS THE PARSED OPTIONS
     // ==========================
@@ -467,7 +792,9 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
     size_t nrOfDynamicVariables = berdyData.helper.getNrOfDynamicVariables();
 
     // Set the values stored in the configuration if any
-    if (setMuDynVariables) {
+    if (config.setMuDynVariables) {
+        std::vector<double>& muDynVariables = config.muDynVariables;
+
         // If only one value is provided, resize it to the expected size
         if (muDynVariables.size() == 1) {
             muDynVariables = std::vector<double>(static_cast<size_t>(nrOfDynamicVariables),
@@ -487,8 +814,8 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
     // ---------------------------------------------------------------
 
     // Set the values stored in the configuration if any
-    if (setCovDynVariables) {
-        size_t nrOfDynamicVariables = berdyData.helper.getNrOfDynamicVariables();
+    if (config.setCovDynVariables) {
+        std::vector<double>& covDynVariables = config.covDynVariables;
 
         // If only one value is provided, resize it to the expected size
         if (covDynVariables.size() == 1) {
@@ -511,11 +838,10 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
 
         // Check the size of the triplets
         if (covDynVariablesTriplets.size() != 0) {
-            // Resize the sparse matrix before storing values from triplets
-            berdyData.priors.dynamicsRegularizationCovarianceMatrix.resize(covDynVariablesTriplets.size(),
-                                                                            covDynVariablesTriplets.size());
             // Store the value into the berdyData
-            berdyData.priors.dynamicsRegularizationCovarianceMatrix.setFromTriplets(covDynVariablesTriplets);
+            BerdyData::Priors::setFromTriplets(covDynVariablesTriplets,
+                                               nrOfDynamicVariables,
+                                               berdyData.priors.dynamicsRegularizationCovarianceMatrix);
         }
         else {
             yError() << LogPrefix << "covDynVariablesTriplets size invalid";
@@ -531,7 +857,8 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
     // --------------------------------------------------
 
     // Set the values stored in the configuration if any
-    if (setCovDynConstraints) {
+    if (config.setCovDynConstraints) {
+        std::vector<double>& covDynConstraints = config.covDynConstraints;
         size_t nrOfDynamicEquations = berdyData.helper.getNrOfDynamicEquations();
 
         // If only one value is provided, resize it to the expected size
@@ -555,11 +882,10 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
 
         // Check the size of the triplets
         if (covDynConstraintsTriplets.size() != 0) {
-            // Resize the sparse matrix before storing values from triplets
-            berdyData.priors.dynamicsConstraintsCovarianceMatrix.resize(covDynConstraintsTriplets.size(),
-                                                                         covDynConstraintsTriplets.size());
             // Store the value into the berdyData
-            berdyData.priors.dynamicsConstraintsCovarianceMatrix.setFromTriplets(covDynConstraintsTriplets);
+            BerdyData::Priors::setFromTriplets(covDynConstraintsTriplets,
+                                               nrOfDynamicEquations,
+                                               berdyData.priors.dynamicsConstraintsCovarianceMatrix);
         }
         else {
             yError() << LogPrefix << "covDynConstraintsTriplets size invalid";
@@ -574,10 +900,24 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
     // Priors on measurements constraints: Sigma_y
     // -------------------------------------------
 
-    iDynTree::Triplets allSensorsTriplets;
-    std::string covMeasurementOptionPrefix = "cov_measurements_";
+    // The blocks of the sensors are written directly in the compressed sparse columns,
+    // then they are appended in the order of their range in the measurements vector
+    std::vector<iDynTree::BerdySensor> berdySensors = berdyData.helper.getSensorsOrdering();
+    const auto byOffset = [](const iDynTree::BerdySensor& lhs, const iDynTree::BerdySensor& rhs) {
+        return lhs.range.offset < rhs.range.offset;
+    };
+
+    // Berdy usually orders the sensors by offset already
+    if (!std::is_sorted(berdySensors.begin(), berdySensors.end(), byOffset)) {
+        std::sort(berdySensors.begin(), berdySensors.end(), byOffset);
+    }
+
+    const size_t nrOfMeasurements = berdyData.helper.getNrOfSensorsMeasurements();
+    hde::utils::BlockDiagonalMatrixBuilder measurementsCovarianceBuilder;
+    measurementsCovarianceBuilder.reset(nrOfMeasurements);
+    measurementsCovarianceBuilder.reserve(nrOfMeasurements);
 
-    for (const iDynTree::BerdySensor& berdySensor : berdyData.helper.getSensorsOrdering()) {
+    for (const iDynTree::BerdySensor& berdySensor : berdySensors) {
 
         // Check that the sensor is a valid berdy sensor
         if (mapBerdySensorType.find(berdySensor.type) == mapBerdySensorType.end()) {
@@ -585,72 +925,199 @@ static bool parsePriorsGroup(const yarp::os::Bottle& priorsGroup,
             return false;
         }
 
-        // Get the string from the enum
-        std::string berdySensorTypeString = mapBerdySensorType.at(berdySensor.type);
+        const auto covMeasurements = config.covMeasurements.find(berdySensor.type);
+        if (covMeasurements == config.covMeasurements.end()) {
+            yError() << LogPrefix << "Failed to find the parameter"
+                     << "cov_measurements_" + mapBerdySensorType.at(berdySensor.type);
+            return false;
+        }
 
-        if (!priorsGroup.find(covMeasurementOptionPrefix + berdySensorTypeString).isNull()) {
+        // Covariance of the specific element, or the default one of the sensor type
+        const auto specificElement = covMeasurements->second.specificElements.find(berdySensor.id);
+        const CovarianceBlock& block = specificElement != covMeasurements->second.specificElements.end()
+                                           ? specificElement->second
+                                           : covMeasurements->second.value;
 
-            iDynTree::Triplets triplets{};
+        if (static_cast<std::ptrdiff_t>(block.size) != berdySensor.range.size) {
+            yError() << LogPrefix << "The covariance of sensor" << berdySensor.id << "has size" << block.size
+                     << "but the sensor has" << berdySensor.range.size << "measurements";
+            return false;
+        }
 
-            if (!getTripletsFromPriorGroup(
-                    priorsGroup, covMeasurementOptionPrefix, berdySensorTypeString, triplets, berdySensor)) {
-                yError() << LogPrefix << "Failed to get triplets for sensor"
-                         << berdySensorTypeString;
-                return false;
-            }
+        const bool appended =
+            block.isDense
+                ? measurementsCovarianceBuilder.appendDenseBlock(
+                      berdySensor.range.offset, block.values.data(), berdySensor.range.size)
+                : measurementsCovarianceBuilder.appendDiagonalBlock(
+                      berdySensor.range.offset, block.values.data(), berdySensor.range.size);
 
-            // Modify the triplets before adding them to the global sparse matrix.
-            // This is necessary because we stack all the sensors in a single matrix.
-            for (const iDynTree::Triplet& triplet : triplets) {
-                iDynTree::Triplet modifiedTriplet = triplet;
-                modifiedTriplet.row += berdySensor.range.offset;
-                modifiedTriplet.column += berdySensor.range.offset;
+        if (!appended) {
+            yError() << LogPrefix << "The range of sensor" << berdySensor.id
+                     << "overlaps the previous sensor or exceeds the measurements vector";
+            return false;
+        }
+    }
 
-                // Combine the triplet of the sensor with the global one
-                allSensorsTriplets.setTriplet(modifiedTriplet);
-            }
+    // Every measurement needs a variance
+    if (measurementsCovarianceBuilder.numberOfEmptyColumns() != 0) {
+        yError() << LogPrefix << measurementsCovarianceBuilder.numberOfEmptyColumns()
+                 << "measurements are not covered by any sensor covariance";
+        return false;
+    }
 
+    // Store the priors of the sensors
+    measurementsCovarianceBuilder.build(berdyData.priors.measurementsCovarianceMatrix);
+
+    yInfo() << LogPrefix << "Measurements covariance inverse matrix set successfully";
+
+    return true;
+}
+
+// ==============
+// MODEL SNAPSHOT
+// ==============
+
+// Load the model from its snapshot if it is up to date with the URDF, otherwise parse the URDF
+// and refresh the snapshot
+static bool loadModel(const std::string& urdfFilePath,
+                      const std::string& snapshotFilePath,
+                      iDynTree::Model& model,
+                      iDynTree::SensorsList& sensors)
+{
+    std::uint64_t sourceHash = 0;
+    if (!hde::utils::ModelSnapshot::hashFile(urdfFilePath, sourceHash)) {
+        yError() << LogPrefix << "Failed to read" << urdfFilePath;
+        return false;
+    }
+
+    if (!snapshotFilePath.empty()) {
+        if (hde::utils::ModelSnapshot::read(snapshotFilePath, sourceHash, model, sensors)) {
+            yInfo() << LogPrefix << "Loaded the model from the snapshot" << snapshotFilePath;
+            return true;
         }
-        else {
-            yError() << LogPrefix << "Failed to find the parameter " << covMeasurementOptionPrefix + berdySensorTypeString;
-            return false;
-        }
+        yInfo() << LogPrefix << "Model snapshot" << snapshotFilePath << "missing or stale, parsing the URDF";
     }
 
-    // Check the size of the triplets
-    if (allSensorsTriplets.size() != 0) {
-        // Resize the sparse matrix before storing values from triplets
-        berdyData.priors.measurementsCovarianceMatrix.resize(allSensorsTriplets.size(),
-                                                              allSensorsTriplets.size());
-        // Store the priors of the sensors
-        berdyData.priors.measurementsCovarianceMatrix.setFromTriplets(allSensorsTriplets);
+    iDynTree::ModelLoader modelLoader;
+    if (!modelLoader.loadModelFromFile(urdfFilePath) || !modelLoader.isValid()) {
+        yError() << LogPrefix << "Failed to load model" << urdfFilePath;
+        return false;
     }
-    else {
-        yError() << LogPrefix << "allSensorsTriplets size invalid";
+
+    model = modelLoader.model();
+    sensors = modelLoader.sensors();
+
+    if (!snapshotFilePath.empty() && !hde::utils::ModelSnapshot::write(snapshotFilePath, sourceHash, model, sensors)) {
+        yWarning() << LogPrefix << "Failed to write the model snapshot" << snapshotFilePath;
+    }
+
+    return true;
+}
+
+// ============
+// PRIORS CACHE
+// ============
+
+// The key changes with the model, the removed sensors and the priors options
+static bool computePriorsCacheKey(const std::string& urdfFilePath,
+                                  const std::string& baseLink,
+                                  const yarp::os::Bottle& sensorRemovalGroup,
+                                  const yarp::os::Bottle& priorsGroup,
+                                  std::uint64_t& key)
+{
+    if (!hde::utils::ModelSnapshot::hashFile(urdfFilePath, key)) {
         return false;
     }
 
-    yInfo() << LogPrefix << "Measurements covariance inverse matrix set successfully";
+    key = hde::utils::hash(baseLink, key);
+    key = hde::utils::hash(sensorRemovalGroup.toString(), key);
+    key = hde::utils::hash(priorsGroup.toString(), key);
+    return true;
+}
+
+static std::vector<hde::utils::PriorsCache::Sensor>
+getCachedSensorsOrdering(const std::vector<iDynTree::BerdySensor>& berdySensors)
+{
+    std::vector<hde::utils::PriorsCache::Sensor> sensors;
+    sensors.reserve(berdySensors.size());
+
+    for (const iDynTree::BerdySensor& berdySensor : berdySensors) {
+        hde::utils::PriorsCache::Sensor sensor;
+        sensor.type = static_cast<std::int32_t>(berdySensor.type);
+        sensor.id = berdySensor.id;
+        sensor.offset = static_cast<std::int32_t>(berdySensor.range.offset);
+        sensor.size = static_cast<std::int32_t>(berdySensor.range.size);
+        sensors.push_back(sensor);
+    }
+
+    return sensors;
+}
+
+// Returns false if the cache is missing, stale or built against a different sensors ordering
+static bool loadCachedPriors(const std::string& fileName,
+                             const std::uint64_t key,
+                             const iDynTree::BerdyHelper& helper,
+                             BerdyData::Priors& priors)
+{
+    hde::utils::PriorsCache::Entry entry;
+    if (!hde::utils::PriorsCache::read(fileName, key, entry)) {
+        return false;
+    }
+
+    const Eigen::Index numberOfDynVariables = static_cast<Eigen::Index>(helper.getNrOfDynamicVariables());
+    const Eigen::Index numberOfDynEquations = static_cast<Eigen::Index>(helper.getNrOfDynamicEquations());
+    const Eigen::Index numberOfMeasurements = static_cast<Eigen::Index>(helper.getNrOfSensorsMeasurements());
+
+    if (entry.sensors != getCachedSensorsOrdering(helper.getSensorsOrdering())
+        || entry.dynamicsRegularizationExpectedValue.size() != numberOfDynVariables
+        || entry.dynamicsRegularizationCovariance.rows() != numberOfDynVariables
+        || entry.dynamicsConstraintsCovariance.rows() != numberOfDynEquations
+        || entry.measurementsCovariance.rows() != numberOfMeasurements) {
+        return false;
+    }
 
+    priors.dynamicsRegularizationExpectedValueVector = std::move(entry.dynamicsRegularizationExpectedValue);
+    priors.dynamicsRegularizationCovarianceMatrix = std::move(entry.dynamicsRegularizationCovariance);
+    priors.dynamicsConstraintsCovarianceMatrix = std::move(entry.dynamicsConstraintsCovariance);
+    priors.measurementsCovarianceMatrix = std::move(entry.measurementsCovariance);
     return true;
 }
 
-static bool parseSensorRemovalGroup(const yarp::os::Bottle& sensorRemovalGroup,
-                                    iDynTree::SensorsList& sensorList,
-                                    const std::unordered_map<iDynTree::BerdySensorTypes, std::string>& mapBerdySensorType)
+static bool storeCachedPriors(const std::string& fileName,
+                              const std::uint64_t key,
+                              const iDynTree::BerdyHelper& helper,
+                              const BerdyData::Priors& priors)
 {
-    // =================
-    // CHECK THE OPTIONS
-    // =================
+    hde::utils::PriorsCache::Entry entry;
+    entry.dynamicsRegularizationExpectedValue = priors.dynamicsRegularizationExpectedValueVector;
+    entry.dynamicsRegularizationCovariance = priors.dynamicsRegularizationCovarianceMatrix;
+    entry.dynamicsConstraintsCovariance = priors.dynamicsConstraintsCovarianceMatrix;
+    entry.measurementsCovariance = priors.measurementsCovarianceMatrix;
+    entry.sensors = getCachedSensorsOrdering(helper.getSensorsOrdering());
+
+    return hde::utils::PriorsCache::write(fileName, key, entry);
+}
+
+// Options of the SENSORS_REMOVAL group, read in a single pass over the group
+struct SensorsRemovalConfig
+{
+    std::vector<iDynTree::BerdySensorTypes> removeAllTypes; // option "*"
+    std::unordered_map<iDynTree::BerdySensorTypes, std::unordered_set<std::string>> removedSensors;
+};
 
+static bool parseSensorsRemovalConfig(
+    const yarp::os::Bottle& sensorRemovalGroup,
+    const std::unordered_map<iDynTree::BerdySensorTypes, std::string>& mapBerdySensorType,
+    SensorsRemovalConfig& config)
+{
     if (sensorRemovalGroup.isNull()) {
         yError() << LogPrefix << "Failed to find the SENSOR_REMOVAL options group";
         return false;
     }
 
     for (const auto& sensor : mapBerdySensorType) {
-        iDynTree::BerdySensorTypes berdySensorType = sensor.first;
-        std::string sensorTypeString = sensor.second;
+        const iDynTree::BerdySensorTypes berdySensorType = sensor.first;
+        const std::string& sensorTypeString = sensor.second;
 
         // If there is no entry for this sensor type, continue
         if (!sensorRemovalGroup.check(sensorTypeString)) {
@@ -658,52 +1125,22 @@ static bool parseSensorRemovalGroup(const yarp::os::Bottle& sensorRemovalGroup,
             continue;
         }
 
-        // Check if the entry is valid and its type
-        bool isList = false;
-        bool isString = false;
-
-        if (sensorRemovalGroup.find(sensorTypeString).isString()) {
-            isString = true;
-        }
-        else if (sensorRemovalGroup.find(sensorTypeString).isList()) {
-            isList = true;
-        }
-        else {
-            yError() << LogPrefix << "The sensor removal option for sensor type" << sensorTypeString
-                     << "must be either a string or a list";
-            return false;
-        }
+        const yarp::os::Value& option = sensorRemovalGroup.find(sensorTypeString);
 
         // String option
-        if (isString) {
-            // Get the value
-            std::string sensorName = sensorRemovalGroup.find(sensorTypeString).asString();
+        if (option.isString()) {
+            const std::string sensorName = option.asString();
 
             if (sensorName == "*") {
-                // Remove all the sensors of this type
-                if (!sensorList.removeAllSensorsOfType(
-                        static_cast<iDynTree::SensorType>(berdySensorType))) {
-                    yError() << LogPrefix << "Failed to remove all the sensors of type"
-                             << sensorTypeString;
-                    return false;
-                }
-                yInfo() << LogPrefix << "Removed all the sensors or type" << sensorTypeString;
+                config.removeAllTypes.push_back(berdySensorType);
             }
             else {
-                // Remove the single sensor
-                if (!sensorList.removeSensor(static_cast<iDynTree::SensorType>(berdySensorType),
-                                             sensorName)) {
-                    yError() << LogPrefix << "Failed to remove sensor" << sensorName << "of type"
-                             << sensorTypeString;
-                    return false;
-                }
-                yInfo() << LogPrefix << "Removed sensor" << sensorName << "of type"
-                        << sensorTypeString;
+                config.removedSensors[berdySensorType].insert(sensorName);
             }
         }
         // List option
-        else if (isList) {
-            yarp::os::Bottle* list = sensorRemovalGroup.find(sensorTypeString).asList();
+        else if (option.isList()) {
+            const yarp::os::Bottle* list = option.asList();
 
             if (list->size() == 0) {
                 yError() << LogPrefix << "The list for removing sensor type" << sensorTypeString
@@ -711,6 +1148,7 @@ static bool parseSensorRemovalGroup(const yarp::os::Bottle& sensorRemovalGroup,
                 return false;
             }
 
+            std::unordered_set<std::string>& removedSensors = config.removedSensors[berdySensorType];
             for (int index = 0; index < list->size(); ++index) {
                 // Check the sensor name
                 if (!list->get(index).isString()) {
@@ -719,20 +1157,70 @@ static bool parseSensorRemovalGroup(const yarp::os::Bottle& sensorRemovalGroup,
                     return false;
                 }
 
-                // Get the sensor name
-                std::string sensorName = list->get(index).asString();
+                removedSensors.insert(list->get(index).asString());
+            }
+        }
+        else {
+            yError() << LogPrefix << "The sensor removal option for sensor type" << sensorTypeString
+                     << "must be either a string or a list";
+            return false;
+        }
+    }
 
-                // Remove the ith sensor
-                if (!sensorList.removeSensor(static_cast<iDynTree::SensorType>(berdySensorType),
-                                             sensorName)) {
-                    yError() << LogPrefix << "Failed to remove sensor" << sensorName << "of type"
-                             << sensorTypeString;
-                    return false;
+    return true;
+}
+
+static bool parseSensorRemovalGroup(const yarp::os::Bottle& sensorRemovalGroup,
+                                    iDynTree::SensorsList& sensorList,
+                                    const std::unordered_map<iDynTree::BerdySensorTypes, std::string>& mapBerdySensorType)
+{
+    SensorsRemovalConfig config;
+    if (!parseSensorsRemovalConfig(sensorRemovalGroup, mapBerdySensorType, config)) {
+        return false;
+    }
+
+    for (const iDynTree::BerdySensorTypes berdySensorType : config.removeAllTypes) {
+        if (!sensorList.removeAllSensorsOfType(static_cast<iDynTree::SensorType>(berdySensorType))) {
+            yError() << LogPrefix << "Failed to remove all the sensors of type"
+                     << mapBerdySensorType.at(berdySensorType);
+            return false;
+        }
+        yInfo() << LogPrefix << "Removed all the sensors or type" << mapBerdySensorType.at(berdySensorType);
+    }
+
+    if (!config.removedSensors.empty()) {
+        // Removing the sensors one by one from the list costs a scan of the list each, then the
+        // list is rebuilt with a single pass over the sensors that are kept
+        iDynTree::SensorsList keptSensors;
+
+        for (int type = 0; type < iDynTree::NR_OF_SENSOR_TYPES; ++type) {
+            const iDynTree::SensorType sensorType = static_cast<iDynTree::SensorType>(type);
+            const auto removed = config.removedSensors.find(static_cast<iDynTree::BerdySensorTypes>(type));
+
+            for (std::ptrdiff_t index = 0; index < static_cast<std::ptrdiff_t>(sensorList.getNrOfSensors(sensorType));
+                 ++index) {
+                const iDynTree::Sensor* sensor = sensorList.getSensor(sensorType, index);
+
+                if (removed != config.removedSensors.end() && removed->second.erase(sensor->getName()) > 0) {
+                    yInfo() << LogPrefix << "Removed sensor" << sensor->getName() << "of type"
+                            << mapBerdySensorType.at(removed->first);
+                    continue;
                 }
-                yInfo() << LogPrefix << "Removed sensor" << sensorName << "of type"
-                        << sensorTypeString;
+
+                keptSensors.addSensor(*sensor);
+            }
+        }
+
+        // The names left were not found among the sensors of their type
+        for (const auto& removed : config.removedSensors) {
+            for (const std::string& sensorName : removed.second) {
+                yError() << LogPrefix << "Failed to remove sensor" << sensorName << "of type"
+                         << mapBerdySensorType.at(removed.first);
+                return false;
             }
         }
+
+        sensorList = keptSensors;
     }
 
     // Debug code to show the type and number of sensors finally contained in sensor list
@@ -750,6 +1238,262 @@ static bool parseSensorRemovalGroup(const yarp::os::Bottle& sensorRemovalGroup,
     return true;
 }
 
+static bool buildMeasurementScatterPlan(const std::vector<iDynTree::BerdySensor>& berdySensors,
+                                        const SensorMapIndex& sensorMapIndex,
+                                        const std::vector<std::string>& wrenchSensorsLinkNames,
+                                        const size_t numberOfMeasurements,
+                                        MeasurementScatterPlan& plan)
+{
+    plan.wrenchCopies.clear();
+    plan.zeroRanges.clear();
+    plan.requiredNumberOfWrenchValues = 0;
+
+    // Elements of y written by a copy. All the others are zeroed every tick.
+    std::vector<bool> isFedByInput(numberOfMeasurements, false);
+
+    for (const iDynTree::BerdySensor& sensor : berdySensors) {
+        SensorMapIndex::const_iterator found = sensorMapIndex.find({sensor.type, sensor.id});
+        if (found == sensorMapIndex.end()) {
+            continue;
+        }
+
+        switch (sensor.type) {
+            case iDynTree::ACCELEROMETER_SENSOR:
+            case iDynTree::DOF_ACCELERATION_SENSOR:
+                // TODO: Fill the correct data. For the time being they are filled with zeros.
+                break;
+            case iDynTree::NET_EXT_WRENCH_SENSOR: {
+                // Wrench sensors without a matching source are filled with zeros
+                for (size_t idx = 0; idx < wrenchSensorsLinkNames.size(); ++idx) {
+                    if (wrenchSensorsLinkNames[idx] == sensor.id) {
+                        MeasurementScatterPlan::Copy copy;
+                        copy.sourceOffset = idx * 6;
+                        copy.destinationOffset = static_cast<size_t>(found->second.offset);
+                        copy.size = 6;
+
+                        if (copy.destinationOffset + copy.size > numberOfMeasurements) {
+                            yError() << LogPrefix << "The range of sensor" << sensor.id
+                                     << "exceeds the measurements vector";
+                            return false;
+                        }
+
+                        std::fill_n(isFedByInput.begin() + copy.destinationOffset, copy.size, true);
+                        plan.requiredNumberOfWrenchValues =
+                            std::max(plan.requiredNumberOfWrenchValues, copy.sourceOffset + copy.size);
+                        plan.wrenchCopies.push_back(copy);
+                        break;
+                    }
+                }
+            } break;
+            default:
+                yWarning() << LogPrefix << sensor.type << " sensor unimplemented";
+                break;
+        }
+    }
+
+    // Merge all the elements not fed by any input in contiguous zero ranges
+    for (size_t i = 0; i < numberOfMeasurements;) {
+        if (isFedByInput[i]) {
+            ++i;
+            continue;
+        }
+
+        iDynTree::IndexRange range;
+        range.offset = static_cast<std::ptrdiff_t>(i);
+        while (i < numberOfMeasurements && !isFedByInput[i]) {
+            ++i;
+        }
+        range.size = static_cast<std::ptrdiff_t>(i) - range.offset;
+        plan.zeroRanges.push_back(range);
+    }
+
+    return true;
+}
+
+// Instrumented sections of the estimation loop
+enum class LoopStage : size_t
+{
+    InputFetch = 0,
+    MeasurementsFill,
+    KinematicsUpdate,
+    MatricesUpdate,
+    Solve,
+    EstimateExtraction,
+    TorquesExtraction,
+    Tick,
+    PipelineLatency,
+    NumberOfStages,
+};
+
+const std::array<std::string, static_cast<size_t>(LoopStage::NumberOfStages)> LoopStageNames = {
+    {"input_fetch",
+     "measurements_fill",
+     "kinematics_update",
+     "matrices_update",
+     "solve",
+     "estimate_extraction",
+     "torques_extraction",
+     "tick",
+     "pipeline_latency"}};
+
+// Work done at the end of open() before the first tick, selected with the 'warm_up' option
+enum class WarmUpPolicy
+{
+    None, // only the symbolic analysis, the first tick pays the first numeric factorization
+    Synchronous, // dummy estimations on the zero state in open()
+    Asynchronous, // as Synchronous, in a background thread that the first run() waits for
+};
+
+const std::unordered_map<std::string, WarmUpPolicy> WarmUpPolicies = {
+    {"none", WarmUpPolicy::None},
+    {"synchronous", WarmUpPolicy::Synchronous},
+    {"asynchronous", WarmUpPolicy::Asynchronous}};
+
+// Quality tiers of the deadline-aware mode, from the most accurate to the cheapest
+enum class QualityTier : unsigned
+{
+    Full = 0, // numeric factorization of the updated system
+    ReuseFactorization, // updated BERDY matrices solved with the last factorization
+    ReuseMatrices, // only the measurements are updated
+    PublishStale, // the previous estimate is published again
+    NumberOfTiers,
+};
+
+const std::array<std::string, static_cast<size_t>(QualityTier::NumberOfTiers)> QualityTierNames = {
+    {"full", "reuse_factorization", "reuse_matrices", "publish_stale"}};
+
+// Watches the duration of the ticks and selects the quality tier of the next one.
+// It steps down after consecutive overruns of the budget and climbs back one tier at a time
+// after enough consecutive ticks within the recovery headroom.
+struct DeadlineController
+{
+    // Options
+    bool enabled = false;
+    double budget = DefaultPeriod; // [s]
+    QualityTier maxTier = QualityTier::PublishStale;
+    size_t overrunsToDegrade = 2;
+    size_t ticksToRecover = 100;
+    double recoveryHeadroom = 0.5; // fraction of the budget
+
+    // State, written only by the estimation thread
+    std::atomic<unsigned> tier{0};
+    size_t consecutiveOverruns = 0;
+    size_t consecutiveFastTicks = 0;
+
+    // Counters, readable from any thread
+    std::atomic<std::uint64_t> overruns{0};
+    std::atomic<std::uint64_t> degradations{0};
+    std::atomic<std::uint64_t> recoveries{0};
+    std::array<std::atomic<std::uint64_t>, static_cast<size_t>(QualityTier::NumberOfTiers)> ticksPerTier{};
+
+    QualityTier currentTier() const { return static_cast<QualityTier>(tier.load(std::memory_order_relaxed)); }
+
+    void update(const QualityTier executedTier, const double tickDuration)
+    {
+        ticksPerTier[static_cast<size_t>(executedTier)].fetch_add(1, std::memory_order_relaxed);
+        const unsigned current = tier.load(std::memory_order_relaxed);
+
+        if (tickDuration > budget) {
+            overruns.fetch_add(1, std::memory_order_relaxed);
+            consecutiveFastTicks = 0;
+
+            if (++consecutiveOverruns >= overrunsToDegrade && current < static_cast<unsigned>(maxTier)) {
+                tier.store(current + 1, std::memory_order_relaxed);
+                degradations.fetch_add(1, std::memory_order_relaxed);
+                consecutiveOverruns = 0;
+            }
+            return;
+        }
+
+        consecutiveOverruns = 0;
+
+        if (tickDuration > recoveryHeadroom * budget) {
+            consecutiveFastTicks = 0;
+            return;
+        }
+
+        if (++consecutiveFastTicks >= ticksToRecover && current > 0) {
+            tier.store(current - 1, std::memory_order_relaxed);
+            recoveries.fetch_add(1, std::memory_order_relaxed);
+            consecutiveFastTicks = 0;
+        }
+    }
+};
+
+static bool parseDeadlineGroup(const yarp::os::Bottle& deadlineGroup,
+                               const double period,
+                               DeadlineController& deadline)
+{
+    deadline.enabled = true;
+    deadline.budget = period;
+
+    if (deadlineGroup.check("budget")) {
+        if (!(deadlineGroup.find("budget").isFloat64() && deadlineGroup.find("budget").asFloat64() > 0)) {
+            yError() << LogPrefix << "Parameter 'budget' of the DEADLINE group invalid";
+            return false;
+        }
+        deadline.budget = deadlineGroup.find("budget").asFloat64();
+    }
+
+    if (deadlineGroup.check("max_tier")) {
+        const std::string maxTierName = deadlineGroup.find("max_tier").asString();
+        auto found = std::find(QualityTierNames.begin(), QualityTierNames.end(), maxTierName);
+        if (found == QualityTierNames.end()) {
+            yError() << LogPrefix << "Parameter 'max_tier' of the DEADLINE group must be one of"
+                     << "full, reuse_factorization, reuse_matrices, publish_stale";
+            return false;
+        }
+        deadline.maxTier = static_cast<QualityTier>(found - QualityTierNames.begin());
+    }
+
+    if (deadlineGroup.check("overruns_to_degrade")) {
+        if (!(deadlineGroup.find("overruns_to_degrade").isInt()
+              && deadlineGroup.find("overruns_to_degrade").asInt() > 0)) {
+            yError() << LogPrefix << "Parameter 'overruns_to_degrade' of the DEADLINE group invalid";
+            return false;
+        }
+        deadline.overrunsToDegrade = static_cast<size_t>(deadlineGroup.find("overruns_to_degrade").asInt());
+    }
+
+    if (deadlineGroup.check("ticks_to_recover")) {
+        if (!(deadlineGroup.find("ticks_to_recover").isInt() && deadlineGroup.find("ticks_to_recover").asInt() > 0)) {
+            yError() << LogPrefix << "Parameter 'ticks_to_recover' of the DEADLINE group invalid";
+            return false;
+        }
+        deadline.ticksToRecover = static_cast<size_t>(deadlineGroup.find("ticks_to_recover").asInt());
+    }
+
+    if (deadlineGroup.check("recovery_headroom")) {
+        const double headroom = deadlineGroup.find("recovery_headroom").asFloat64();
+        if (!(deadlineGroup.find("recovery_headroom").isFloat64() && headroom > 0 && headroom <= 1)) {
+            yError() << LogPrefix << "Parameter 'recovery_headroom' of the DEADLINE group must be in (0, 1]";
+            return false;
+        }
+        deadline.recoveryHeadroom = headroom;
+    }
+
+    return true;
+}
+
+// Data flowing through the stages of the pipelined estimation
+struct EstimationFrame
+{
+    hde::utils::LatencyHistogram::Clock::time_point acquisitionBegin;
+    BerdyData::KinematicState state;
+    iDynTree::VectorDynSize measurements;
+    BerdyData::Matrices matrices;
+};
+
+struct RecordedSample
+{
+    double time = 0;
+    std::vector<double> jointsPosition;
+    std::vector<double> jointsVelocity;
+    std::array<double, 3> baseAngularVelocity;
+    std::vector<double> wrenchValues;
+    std::vector<double> jointTorques; // output
+};
+
 class HumanDynamicsEstimator::Impl
 {
 public:
@@ -759,12 +1503,20 @@ public:
         gravity(2) = -9.81;
     }
 
+    ~Impl() { stopPipeline(); }
+
     // Attached interfaces
     hde::interfaces::IHumanState* iHumanState = nullptr;
     hde::interfaces::IHumanWrench* iHumanWrench = nullptr;
     yarp::dev::IAnalogSensor* iAnalogSensor = nullptr;
 
-    mutable std::mutex mutex;
+    // Recorded samples read by run() in place of the attached interfaces, if not empty
+    struct Replay
+    {
+        std::vector<RecordedSample> samples;
+        size_t next = 0;
+    } replay;
+
     iDynTree::Vector3 gravity;
 
     const std::unordered_map<iDynTree::BerdySensorTypes, std::string> mapBerdySensorType = {
@@ -783,123 +1535,1086 @@ public:
     // Berdy sensors map
     SensorMapIndex sensorMapIndex;
 
+    // Plan for filling the measurements vector from the input channels
+    MeasurementScatterPlan measurementScatterPlan;
+
     // Berdy variable
     BerdyData berdyData;
 
     // Model variables
     iDynTree::Model humanModel;
+    // Joint names, immutable after open()
+    std::vector<std::string> jointNames;
+
+    // Lock-free publication of the joint torque estimates to the consumers
+    hde::utils::SeqLockChannel jointTorquesChannel;
 
     // Wrench sensor link names variable
     std::vector<std::string> wrenchSensorsLinkNames;
-};
 
-HumanDynamicsEstimator::HumanDynamicsEstimator()
-    : PeriodicThread(DefaultPeriod)
-    , pImpl{new Impl()}
-{}
+    // Heap allocations of the steady-state estimation loop, one monitor per stage
+    hde::utils::AllocationMonitor inputsAllocationMonitor;
+    hde::utils::AllocationMonitor matricesAllocationMonitor;
+    hde::utils::AllocationMonitor estimationAllocationMonitor;
 
-// Without this destructor here, the linker complains for
-// undefined reference to vtable
-HumanDynamicsEstimator::~HumanDynamicsEstimator() = default;
+    // Latency of every section of the loop. Each histogram is written by a single thread.
+    std::array<hde::utils::LatencyHistogram, static_cast<size_t>(LoopStage::NumberOfStages)> stageLatencies;
 
-bool HumanDynamicsEstimator::open(yarp::os::Searchable& config)
+    hde::utils::LatencyHistogram& latency(const LoopStage stage)
+    {
+        return stageLatencies[static_cast<size_t>(stage)];
+    }
+
+    // Pipelined mode: acquisition runs in run(), the other two stages in their own threads
+    struct Pipeline
+    {
+        bool enabled = false;
+        std::atomic<bool> running{false};
+        std::thread kinematicsThread;
+        std::thread solverThread;
+        // BerdyHelper keeps the kinematic state, then the kinematics stage has its own and the
+        // solver stage uses the one of berdyData
+        iDynTree::BerdyHelper kinematicsHelper;
+        // Wakes up the stages waiting for a frame or for a free slot
+        std::mutex mutex;
+        std::condition_variable frameReady;
+        hde::utils::SPSCRingBuffer<EstimationFrame> acquiredFrames;
+        hde::utils::SPSCRingBuffer<EstimationFrame> kinematicsFrames;
+        std::atomic<size_t> droppedFrames{0};
+    } pipeline;
+
+    // Deadline-aware mode of the sequential loop
+    DeadlineController deadline;
+
+    // Posterior variances of the joint torques, computed on request by the thread running the
+    // solver. The estimation itself computes only the expected value of the dynamic variables.
+    struct TorquesVariances
+    {
+        std::atomic<bool> requested{false};
+        // Torque of each DOF as a linear combination of the joint variables, and the entries of
+        // the posterior covariance they need, computed in open()
+        std::vector<std::vector<std::pair<size_t, double>>> torqueCoefficients;
+        std::vector<hde::estimation::FactorizedMAPSolver::VariablesPair> covarianceEntries;
+        Eigen::VectorXd covarianceValues;
+        std::vector<double> variances;
+        hde::utils::SeqLockChannel channel;
+    } torquesVariances;
+
+    bool compileJointTorquesVariances();
+    bool computeJointTorquesVariances();
+
+    // Convergence of the iterative solver, written by the thread running the solver
+    struct IterativeSolver
+    {
+        bool enabled = false;
+        std::atomic<std::uint64_t> solves{0};
+        std::atomic<std::uint64_t> lastIterations{0};
+        std::atomic<std::uint64_t> maxIterations{0};
+        std::atomic<double> lastRelativeResidual{0};
+    } iterativeSolver;
+
+    // Elimination order selected among the fill-reducing candidates, with the auto solver backend
+    struct EliminationOrderSelection
+    {
+        bool enabled = false;
+        std::string cacheFileName; // empty if disabled
+    } eliminationOrderSelection;
+
+    bool selectEliminationOrder(const BerdyData::Matrices& matrices);
+
+    // Wall time and memory of the phases of open()
+    hde::utils::StartupProfiler startupProfiler;
+    // Phases of the asynchronous warm-up, read only once it is completed
+    hde::utils::StartupProfiler warmUpProfiler;
+
+    // Prior covariances replaced at runtime, applied by the thread running the solver
+    struct PriorUpdate
+    {
+        bool isMeasurementsPrior = false; // otherwise dynamics regularization prior
+        size_t offset = 0;
+        CovarianceBlock covariance;
+    };
+
+    struct PriorUpdates
+    {
+        std::mutex mutex;
+        std::vector<PriorUpdate> pending;
+        std::atomic<bool> hasPending{false};
+    } priorUpdates;
+
+    void requestPriorUpdate(PriorUpdate&& update);
+    void applyPendingPriorUpdates();
+
+    // Sensors excluded from or included again in the estimation at runtime
+    struct MaskUpdate
+    {
+        size_t offset = 0;
+        size_t size = 0;
+        bool active = true;
+    };
+
+    // Requested from any thread and applied to the solver of one estimation, either the one of
+    // the device or of a subject. The requested state of every measurement is kept for
+    // initializing the masks of the estimation cores.
+    struct MaskUpdates
+    {
+        std::mutex mutex;
+        std::vector<MaskUpdate> pending;
+        std::atomic<bool> hasPending{false};
+        std::vector<char> isActive; // per measurement, including the pending updates
+
+        void resize(size_t nrOfMeasurements);
+        bool request(const MaskUpdate& update);
+        void applyPending(hde::estimation::FactorizedMAPSolver& solver);
+        void applyRequested(hde::estimation::FactorizedMAPSolver& solver);
+    } maskUpdates;
+
+    // Range in the measurements vector of a berdy sensor, addressed by type name and id
+    bool findSensorRange(const std::string& sensorType, const std::string& sensorId, iDynTree::IndexRange& range) const;
+
+    // Result of the asynchronous warm-up, valid only with that policy. Declared last, so that
+    // its destruction waits for the warm-up before the data it uses is destroyed.
+    std::shared_future<bool> warmUp;
+
+    // Estimation stages. They operate on the passed buffers so that they can be executed
+    // either in sequence on the berdyData buffers or concurrently on the pipeline frames.
+    bool acquireInputs(BerdyData::KinematicState& state, iDynTree::VectorDynSize& measurements);
+    // Last part of acquireInputs(), from the wrench values to y, it ends its allocations check
+    bool fillMeasurements(iDynTree::VectorDynSize& measurements);
+    bool updateBerdyMatrices(iDynTree::BerdyHelper& helper,
+                             const BerdyData::KinematicState& state,
+                             BerdyData::Matrices& matrices);
+    bool estimateJointTorques(const BerdyData::KinematicState& state,
+                              const iDynTree::VectorDynSize& measurements,
+                              const BerdyData::Matrices& matrices,
+                              QualityTier tier = QualityTier::Full);
+
+    // Sequential tick at the given quality tier
+    bool tick(QualityTier tier);
+
+    // BERDY matrices and symbolic analysis on the zero state, followed by the warm-up estimations
+    bool prepareEstimation(WarmUpPolicy policy, hde::utils::StartupProfiler* profiler);
+    bool waitForWarmUp() const { return !warmUp.valid() || warmUp.get(); }
+
+    bool startPipeline(size_t capacity);
+    void stopPipeline();
+    void notifyPipelineStages();
+    void kinematicsStageLoop();
+    void solverStageLoop();
+};
+
+void HumanDynamicsEstimator::Impl::requestPriorUpdate(PriorUpdate&& update)
 {
-    // ===============================
-    // CHECK THE CONFIGURATION OPTIONS
-    // ===============================
+    std::lock_guard<std::mutex> lock(priorUpdates.mutex);
+    priorUpdates.pending.push_back(std::move(update));
+    priorUpdates.hasPending = true;
+}
 
-    if (!(config.check("period") && config.find("period").isFloat64())) {
-        yInfo() << LogPrefix << "Using default period:" << DefaultPeriod << "s";
+void HumanDynamicsEstimator::Impl::applyPendingPriorUpdates()
+{
+    // Checked at every step without taking the lock
+    if (!priorUpdates.hasPending) {
+        return;
     }
 
-    if (!(config.check("urdf") && config.find("urdf").isString())) {
-        yError() << LogPrefix << "Parameter 'urdf' missing or invalid";
-        return false;
-    }
+    std::vector<PriorUpdate> updates;
+    {
+        std::lock_guard<std::mutex> lock(priorUpdates.mutex);
+        updates.swap(priorUpdates.pending);
+        priorUpdates.hasPending = false;
+    }
+
+    for (const PriorUpdate& update : updates) {
+        BerdyData::Priors::SparseMatrix covarianceBlock;
+        toSparseMatrix(update.covariance, covarianceBlock);
+
+        BerdyData::Priors::SparseMatrix& covariance = update.isMeasurementsPrior
+                                                          ? berdyData.priors.measurementsCovarianceMatrix
+                                                          : berdyData.priors.dynamicsRegularizationCovarianceMatrix;
+
+        // Only the values of the stored covariance and of the solver precision change, the
+        // symbolic analysis is kept and the next numeric factorization uses the new prior
+        BerdyData::Priors::SparseMatrix updatedCovariance = covariance;
+        const Eigen::Index offset = static_cast<Eigen::Index>(update.offset);
+        const bool updated =
+            hde::estimation::FactorizedMAPSolver::replaceDiagonalBlock(updatedCovariance, offset, covarianceBlock)
+            && (update.isMeasurementsPrior
+                    ? berdyData.solver.updateMeasurementsPriorCovariance(offset, covarianceBlock)
+                    : berdyData.solver.updateDynamicsRegularizationPriorCovariance(offset, covarianceBlock));
+
+        if (!updated) {
+            yError() << LogPrefix << "Failed to update the"
+                     << (update.isMeasurementsPrior ? "measurements" : "dynamic variables") << "prior covariance at"
+                     << update.offset << ", the new block must keep the sparsity pattern of the configured one";
+            continue;
+        }
 
-    if (!(config.check("baseLink") && config.find("baseLink").isString())) {
-        yError() << LogPrefix << "Parameter 'baseLink' missing or invalid";
-        return false;
+        covariance.swap(updatedCovariance);
     }
+}
 
-    if (!(config.check("number_of_wrench_sensors") && config.find("number_of_wrench_sensors").isInt())) {
-        yError() << LogPrefix << "Parameter 'number_of_wrench_sensors' missing or invalid";
+void HumanDynamicsEstimator::Impl::MaskUpdates::resize(const size_t nrOfMeasurements)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.clear();
+    hasPending = false;
+    isActive.assign(nrOfMeasurements, true);
+}
+
+bool HumanDynamicsEstimator::Impl::MaskUpdates::request(const MaskUpdate& update)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (update.offset + update.size > isActive.size()) {
         return false;
     }
 
-    if (!(config.check("wrench_sensors_link_name") && config.find("wrench_sensors_link_name").isList())) {
-        yError() << LogPrefix << "Parameter 'number_of_wrench_sensors' missing or invalid";
-        return false;
+    std::fill_n(isActive.begin() + update.offset, update.size, update.active);
+    pending.push_back(update);
+    hasPending = true;
+    return true;
+}
+
+void HumanDynamicsEstimator::Impl::MaskUpdates::applyPending(hde::estimation::FactorizedMAPSolver& solver)
+{
+    // Checked at every step without taking the lock
+    if (!hasPending) {
+        return;
     }
 
-    // ===============================
-    // PARSE THE CONFIGURATION OPTIONS
-    // ===============================
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const MaskUpdate& update : pending) {
+        solver.setMeasurementsActive(
+            static_cast<Eigen::Index>(update.offset), static_cast<Eigen::Index>(update.size), update.active);
+    }
+    pending.clear();
+    hasPending = false;
+}
 
-    double period = config.find("period").asFloat64();
-    std::string urdfFileName = config.find("urdf").asString();
-    std::string baseLink = config.find("baseLink").asString();
-    int number_of_wrench_sensors = config.find("number_of_wrench_sensors").asInt();
-    yarp::os::Bottle* linkNames = config.find("wrench_sensors_link_name").asList();
+void HumanDynamicsEstimator::Impl::MaskUpdates::applyRequested(hde::estimation::FactorizedMAPSolver& solver)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < isActive.size(); ++i) {
+        solver.setMeasurementsActive(static_cast<Eigen::Index>(i), 1, isActive[i]);
+    }
+}
 
-    if (number_of_wrench_sensors != linkNames->size()) {
-        yError() << LogPrefix << "mismatch between the number of wrench sensors and corresponding sensor link names list";
+bool HumanDynamicsEstimator::Impl::findSensorRange(const std::string& sensorType,
+                                                   const std::string& sensorId,
+                                                   iDynTree::IndexRange& range) const
+{
+    const auto type = std::find_if(mapBerdySensorType.begin(),
+                                   mapBerdySensorType.end(),
+                                   [&](const std::pair<const iDynTree::BerdySensorTypes, std::string>& entry) {
+                                       return entry.second == sensorType;
+                                   });
+
+    if (type == mapBerdySensorType.end()) {
+        yError() << LogPrefix << "Sensor type" << sensorType << "not supported by Berdy";
         return false;
     }
 
-    pImpl->wrenchSensorsLinkNames.resize(linkNames->size());
-    for (int i = 0; i < linkNames->size(); i++) {
-        pImpl->wrenchSensorsLinkNames.at(i) = linkNames->get(i).asString();
+    const SensorMapIndex::const_iterator sensor = sensorMapIndex.find({type->first, sensorId});
+    if (sensor == sensorMapIndex.end()) {
+        yError() << LogPrefix << "Sensor" << sensorId << "of type" << sensorType << "not found in the berdy sensors";
+        return false;
     }
 
-    yInfo() << LogPrefix << "*** ===========================";
-    yInfo() << LogPrefix << "*** Period                    :" << period;
-    yInfo() << LogPrefix << "*** Urdf file name            :" << urdfFileName;
-    yInfo() << LogPrefix << "*** Base link name            :" << baseLink;
-    yInfo() << LogPrefix << "*** Number of wrench sensors  :" << number_of_wrench_sensors;
-    yInfo() << LogPrefix << "*** Wrench sensors link names :" << linkNames->toString();
-    yInfo() << LogPrefix << "*** ===========================";
+    range = sensor->second;
+    return true;
+}
 
-    // ===========
-    // BERDY SETUP
-    // ===========
+bool HumanDynamicsEstimator::Impl::selectEliminationOrder(const BerdyData::Matrices& matrices)
+{
+    using hde::estimation::OrderingSelection;
 
-    // Find the URDF file
-    auto& rf = yarp::os::ResourceFinder::getResourceFinderSingleton();
-    std::string urdfFilePath = rf.findFile(urdfFileName);
-    if (urdfFilePath.empty()) {
-        yError() << LogPrefix << "Failed to find file" << config.find("urdf").asString();
+    const auto D = iDynTree::toEigen(matrices.D);
+    const auto Y = iDynTree::toEigen(matrices.Y);
+
+    OrderingSelection::SparseMatrix precision;
+    if (!berdyData.solver.computePrecision(D, Y, precision)) {
         return false;
     }
 
-    // Load the model
-    iDynTree::ModelLoader modelLoader;
-    if (!modelLoader.loadModelFromFile(urdfFilePath) || !modelLoader.isValid()) {
-        yError() << LogPrefix << "Failed to load model" << urdfFilePath;
-        return false;
+    const std::uint64_t key = OrderingSelection::patternKey(precision);
+    OrderingSelection::Candidate selected;
+    const std::string& cacheFileName = eliminationOrderSelection.cacheFileName;
+
+    if (!cacheFileName.empty() && OrderingSelection::readCache(cacheFileName, key, selected)) {
+        yInfo() << LogPrefix << "Elimination order" << selected.method << "loaded from the cache" << cacheFileName;
     }
+    else {
+        std::vector<OrderingSelection::Candidate> candidates;
+        if (!OrderingSelection::computeCandidates(precision, D, Y, &berdyData.helper, candidates)) {
+            return false;
+        }
 
-    // Get the model from the loader
-    pImpl->humanModel = modelLoader.model();
+        for (const OrderingSelection::Candidate& candidate : candidates) {
+            yInfo() << LogPrefix << "Elimination order" << candidate.method << ": nnz(L)"
+                    << static_cast<double>(candidate.factorNonZeros) << ", flops" << candidate.flops;
+        }
+        selected = candidates[OrderingSelection::selectBest(candidates)];
 
-    // Set fixed frame index
-    pImpl->berdyData.state.floatingBaseFrameIndex = pImpl->humanModel.getFrameIndex(baseLink);
+        // A failure here only slows down the next startup
+        if (!cacheFileName.empty() && !OrderingSelection::writeCache(cacheFileName, key, selected)) {
+            yWarning() << LogPrefix << "Failed to write the elimination order cache" << cacheFileName;
+        }
+    }
 
-    if (pImpl->berdyData.state.floatingBaseFrameIndex == iDynTree::FRAME_INVALID_INDEX) {
-        yError() << LogPrefix << "Passed frame" << baseLink << "not found in the model";
+    yInfo() << LogPrefix << "Selected elimination order:" << selected.method;
+    return berdyData.solver.setEliminationOrder(selected.order);
+}
+
+bool HumanDynamicsEstimator::Impl::prepareEstimation(const WarmUpPolicy policy,
+                                                     hde::utils::StartupProfiler* profiler)
+{
+    const auto beginPhase = [profiler](const std::string& name) {
+        if (profiler) {
+            profiler->beginPhase(name);
+        }
+    };
+
+    beginPhase("berdy_matrices");
+    if (!updateBerdyMatrices(berdyData.helper, berdyData.state, berdyData.matrices)) {
+        yError() << LogPrefix << "Failed to update the BERDY matrices";
         return false;
     }
 
-    // Initialize the sensors
-    iDynTree::SensorsList humanSensors = modelLoader.sensors();
+    // Compute the fill-reducing ordering and the symbolic factorization once
+    if (eliminationOrderSelection.enabled) {
+        beginPhase("ordering_selection");
+        if (!selectEliminationOrder(berdyData.matrices)) {
+            yError() << LogPrefix << "Failed to select the elimination order of the Berdy MAP problem";
+            return false;
+        }
+    }
 
-    // If any, remove the sensors from the SENSORS_REMOVAL option
-    if (!parseSensorRemovalGroup(config.findGroup("SENSORS_REMOVAL"), humanSensors, pImpl->mapBerdySensorType)) {
-        yError() << LogPrefix << "Failed to parse SENSORS_REMOVAL group";
+    beginPhase("solver_analysis");
+    if (!berdyData.solver.analyzePattern(iDynTree::toEigen(berdyData.matrices.D),
+                                         iDynTree::toEigen(berdyData.matrices.Y))) {
+        yError() << LogPrefix << "Failed to analyze the sparsity pattern of the Berdy MAP problem";
         return false;
     }
 
-    // Initialize the options
+    // Do berdy estimation and publish the joint torques. The first pass allocates the buffers
+    // of the solver, the second one runs the steady-state path and touches the same memory of
+    // the first ticks, so that they do not pay its page faults and cache misses.
+    if (policy != WarmUpPolicy::None) {
+        beginPhase("first_estimation");
+        for (size_t pass = 0; pass < 2; ++pass) {
+            if (!estimateJointTorques(berdyData.state, berdyData.buffers.measurements, berdyData.matrices)) {
+                yError() << LogPrefix << "Failed to launch a first dummy estimation";
+                return false;
+            }
+        }
+    }
+
+    // The preparation is not part of the statistics of the loop
+    for (hde::utils::LatencyHistogram& histogram : stageLatencies) {
+        histogram.reset();
+    }
+
+    return true;
+}
+
+// Copies the input std::vector into the preallocated iDynTree buffer without resizing it
+static bool copyToPreallocatedBuffer(const std::vector<double>& input, iDynTree::VectorDynSize& buffer)
+{
+    if (input.size() != buffer.size()) {
+        return false;
+    }
+
+    std::copy(input.begin(), input.end(), buffer.data());
+    return true;
+}
+
+// With HDE_CHECK_STEADY_STATE_ALLOCATIONS enabled, any allocation in the checked sections is fatal
+static void checkSteadyStateAllocations(const hde::utils::AllocationMonitor& monitor, const std::string& section)
+{
+    if (monitor.count() != 0) {
+        yError() << LogPrefix << "Detected" << monitor.count() << "heap allocations in the steady-state"
+                 << section;
+        std::abort();
+    }
+}
+
+bool HumanDynamicsEstimator::Impl::acquireInputs(BerdyData::KinematicState& state,
+                                                 iDynTree::VectorDynSize& measurements)
+{
+    const auto stageBegin = hde::utils::LatencyHistogram::Clock::now();
+
+    // The replayed samples have the sizes checked when they are loaded
+    if (!replay.samples.empty()) {
+        if (replay.next == replay.samples.size()) {
+            yError() << LogPrefix << "No replayed samples left";
+            return false;
+        }
+        const RecordedSample& sample = replay.samples[replay.next++];
+
+        inputsAllocationMonitor.reset();
+        inputsAllocationMonitor.begin();
+
+        for (unsigned i = 0; i < 3; ++i) {
+            state.baseAngularVelocity.setVal(i, sample.baseAngularVelocity[i]);
+        }
+        copyToPreallocatedBuffer(sample.jointsPosition, state.jointsPosition);
+        copyToPreallocatedBuffer(sample.jointsVelocity, state.jointsVelocity);
+        std::copy(sample.wrenchValues.begin(), sample.wrenchValues.end(), berdyData.buffers.wrenchValues.data());
+
+        latency(LoopStage::InputFetch).record(stageBegin);
+        return fillMeasurements(measurements);
+    }
+
+    // Get state data from the attached IHumanState interface.
+    // Note that IHumanState only provides getters returning by value, that are kept
+    // out of the section checked for heap allocations.
+    std::vector<double> jointsPosition    = iHumanState->getJointPositions();
+    std::vector<double> jointsVelocity    = iHumanState->getJointVelocities();
+
+    std::array<double, 6> baseVelocity    = iHumanState->getBaseVelocity();
+
+    inputsAllocationMonitor.reset();
+    inputsAllocationMonitor.begin();
+
+    // Set base angular velocity
+    state.baseAngularVelocity.setVal(0, baseVelocity[3]);
+    state.baseAngularVelocity.setVal(1, baseVelocity[4]);
+    state.baseAngularVelocity.setVal(2, baseVelocity[5]);
+
+    // Set the received state data to the preallocated berdy state variables
+    if (!copyToPreallocatedBuffer(jointsPosition, state.jointsPosition)
+        || !copyToPreallocatedBuffer(jointsVelocity, state.jointsVelocity)) {
+        yError() << LogPrefix << "Received" << jointsPosition.size() << "joint positions and"
+                 << jointsVelocity.size() << "joint velocities but the model has"
+                 << state.jointsPosition.size() << "joints";
+        return false;
+    }
+
+    // Read the wrench values into the preallocated buffer
+    if (iAnalogSensor->read(berdyData.buffers.wrenchValues) != yarp::dev::IAnalogSensor::AS_OK) {
+        yError() << LogPrefix << "Failed to read the wrench values";
+        return false;
+    }
+
+    latency(LoopStage::InputFetch).record(stageBegin);
+    return fillMeasurements(measurements);
+}
+
+bool HumanDynamicsEstimator::Impl::fillMeasurements(iDynTree::VectorDynSize& measurements)
+{
+    // The channels are checked in attach(), a different size means that the buffer was reallocated
+    if (berdyData.buffers.wrenchValues.size() != 6 * wrenchSensorsLinkNames.size()) {
+        yError() << LogPrefix << "Received" << berdyData.buffers.wrenchValues.size() << "wrench values but"
+                 << 6 * wrenchSensorsLinkNames.size() << "are expected";
+        return false;
+    }
+
+    /* The total number of sensors are :
+     * 17 Accelerometers, 66 DOF Acceleration sensors and 67 NET EXT WRENCH sensors
+     * The total number of sensor measurements = (17x3) + (66x1) + (67x6) = 519
+     */
+
+    // Fill the y vector executing the plan compiled in open()
+    const auto stageBegin = hde::utils::LatencyHistogram::Clock::now();
+    measurementScatterPlan.execute(berdyData.buffers.wrenchValues.data(), measurements);
+    latency(LoopStage::MeasurementsFill).record(stageBegin);
+
+    inputsAllocationMonitor.end();
+    checkSteadyStateAllocations(inputsAllocationMonitor, "inputs acquisition");
+
+    return true;
+}
+
+bool HumanDynamicsEstimator::Impl::updateBerdyMatrices(iDynTree::BerdyHelper& helper,
+                                                       const BerdyData::KinematicState& state,
+                                                       BerdyData::Matrices& matrices)
+{
+    matricesAllocationMonitor.reset();
+    matricesAllocationMonitor.begin();
+
+    // Set the kinematic information necessary for the dynamics estimation
+    auto stageBegin = hde::utils::LatencyHistogram::Clock::now();
+    helper.updateKinematicsFromFloatingBase(state.jointsPosition,
+                                            state.jointsVelocity,
+                                            state.floatingBaseFrameIndex,
+                                            state.baseAngularVelocity);
+    latency(LoopStage::KinematicsUpdate).record(stageBegin);
+
+    // Update the BERDY matrices
+    stageBegin = hde::utils::LatencyHistogram::Clock::now();
+    if (!helper.getBerdyMatrices(matrices.D, matrices.bD, matrices.Y, matrices.bY)) {
+        yError() << LogPrefix << "Failed to get the BERDY matrices";
+        return false;
+    }
+    latency(LoopStage::MatricesUpdate).record(stageBegin);
+
+    matricesAllocationMonitor.end();
+    checkSteadyStateAllocations(matricesAllocationMonitor, "BERDY matrices update");
+
+    return true;
+}
+
+bool HumanDynamicsEstimator::Impl::estimateJointTorques(const BerdyData::KinematicState& state,
+                                                        const iDynTree::VectorDynSize& measurements,
+                                                        const BerdyData::Matrices& matrices,
+                                                        const QualityTier tier)
+{
+    // The runtime updates allocate and are not part of the steady state
+    applyPendingPriorUpdates();
+    maskUpdates.applyPending(berdyData.solver);
+
+    estimationAllocationMonitor.reset();
+    estimationAllocationMonitor.begin();
+
+    // Do berdy estimation. Only the numeric factorization is done here, the symbolic one is
+    // reused from open(). The degraded tiers skip also the numeric factorization.
+    auto stageBegin = hde::utils::LatencyHistogram::Clock::now();
+    const bool estimated =
+        tier == QualityTier::Full
+            ? berdyData.solver.doEstimate(iDynTree::toEigen(matrices.D),
+                                          iDynTree::toEigen(matrices.bD),
+                                          iDynTree::toEigen(matrices.Y),
+                                          iDynTree::toEigen(matrices.bY),
+                                          iDynTree::toEigen(measurements))
+            : berdyData.solver.solveWithLastFactorization(iDynTree::toEigen(matrices.D),
+                                                          iDynTree::toEigen(matrices.bD),
+                                                          iDynTree::toEigen(matrices.Y),
+                                                          iDynTree::toEigen(matrices.bY),
+                                                          iDynTree::toEigen(measurements));
+
+    // Recorded also for the solves that did not converge
+    if (iterativeSolver.enabled) {
+        const std::uint64_t iterations = berdyData.solver.numberOfIterations();
+        iterativeSolver.solves.fetch_add(1, std::memory_order_relaxed);
+        iterativeSolver.lastIterations.store(iterations, std::memory_order_relaxed);
+        iterativeSolver.lastRelativeResidual.store(berdyData.solver.iterativeRelativeResidual(),
+                                                   std::memory_order_relaxed);
+        if (iterations > iterativeSolver.maxIterations.load(std::memory_order_relaxed)) {
+            iterativeSolver.maxIterations.store(iterations, std::memory_order_relaxed);
+        }
+    }
+
+    if (!estimated) {
+        yError() << LogPrefix << "Failed to do berdy estimation";
+        return false;
+    }
+    latency(LoopStage::Solve).record(stageBegin);
+
+    // Extract the estimated dynamic variables
+    stageBegin = hde::utils::LatencyHistogram::Clock::now();
+    iDynTree::toEigen(berdyData.buffers.estimatedDynamicVariables) = berdyData.solver.lastEstimate();
+    latency(LoopStage::EstimateExtraction).record(stageBegin);
+
+    // Extract joint torques from estimated dynamic variables into the private buffer
+    stageBegin = hde::utils::LatencyHistogram::Clock::now();
+    berdyData.helper.extractJointTorquesFromDynamicVariables(berdyData.buffers.estimatedDynamicVariables,
+                                                             state.jointsPosition,
+                                                             berdyData.estimates.jointTorqueEstimates);
+    latency(LoopStage::TorquesExtraction).record(stageBegin);
+
+    // ===========================
+    // EXPOSE DATA FOR IHUMANSTATE
+    // ===========================
+
+    jointTorquesChannel.publish(
+        berdyData.estimates.jointTorqueEstimates.data(), yarp::os::Time::now(), static_cast<std::uint64_t>(tier));
+
+    estimationAllocationMonitor.end();
+    checkSteadyStateAllocations(estimationAllocationMonitor, "estimation");
+
+    if (torquesVariances.requested.exchange(false, std::memory_order_acquire) && !computeJointTorquesVariances()) {
+        yWarning() << LogPrefix << "Failed to compute the variances of the joint torques";
+    }
+
+    return true;
+}
+
+bool HumanDynamicsEstimator::Impl::compileJointTorquesVariances()
+{
+    TorquesVariances& request = torquesVariances;
+    const iDynTree::BerdyHelper& helper = berdyData.helper;
+
+    // The torques are linear in the dynamic variables: their coefficients are found by
+    // extracting the torques of a unit value of each dynamic variable of the joints. The
+    // motion subspaces of the joints do not depend on their position.
+    iDynTree::VectorDynSize probe(helper.getNrOfDynamicVariables());
+    probe.zero();
+    iDynTree::JointPosDoubleArray jointsPosition(helper.model());
+    jointsPosition.zero();
+    iDynTree::JointDOFsDoubleArray torques(helper.model());
+
+    request.torqueCoefficients.assign(torques.size(), {});
+    for (const iDynTree::BerdyDynamicVariable& variable : helper.getDynamicVariablesOrdering()) {
+        if (helper.model().getJointIndex(variable.id) == iDynTree::JOINT_INVALID_INDEX) {
+            continue;
+        }
+
+        for (std::ptrdiff_t i = variable.range.offset; i < variable.range.offset + variable.range.size; ++i) {
+            probe(i) = 1;
+            if (!helper.extractJointTorquesFromDynamicVariables(probe, jointsPosition, torques)) {
+                return false;
+            }
+            probe(i) = 0;
+
+            for (size_t dof = 0; dof < torques.size(); ++dof) {
+                if (torques(dof) != 0) {
+                    request.torqueCoefficients[dof].emplace_back(static_cast<size_t>(i), torques(dof));
+                }
+            }
+        }
+    }
+
+    // var(tau) = t^T * cov(d) * t, with only the entries of the covariance coupling the variables of t
+    request.covarianceEntries.clear();
+    for (const std::vector<std::pair<size_t, double>>& coefficients : request.torqueCoefficients) {
+        for (const std::pair<size_t, double>& first : coefficients) {
+            for (const std::pair<size_t, double>& second : coefficients) {
+                request.covarianceEntries.emplace_back(first.first, second.first);
+            }
+        }
+    }
+
+    request.covarianceValues.resize(request.covarianceEntries.size());
+    request.variances.assign(torques.size(), 0.0);
+    request.channel.resize(torques.size());
+    return true;
+}
+
+bool HumanDynamicsEstimator::Impl::computeJointTorquesVariances()
+{
+    TorquesVariances& request = torquesVariances;
+
+    if (!berdyData.solver.computePosteriorCovariance(request.covarianceEntries, request.covarianceValues)) {
+        return false;
+    }
+
+    Eigen::Index entry = 0;
+    for (size_t dof = 0; dof < request.torqueCoefficients.size(); ++dof) {
+        double variance = 0;
+        for (const std::pair<size_t, double>& first : request.torqueCoefficients[dof]) {
+            for (const std::pair<size_t, double>& second : request.torqueCoefficients[dof]) {
+                variance += first.second * second.second * request.covarianceValues[entry++];
+            }
+        }
+        request.variances[dof] = variance;
+    }
+
+    request.channel.publish(request.variances.data(), yarp::os::Time::now());
+    return true;
+}
+
+bool HumanDynamicsEstimator::Impl::tick(const QualityTier tier)
+{
+    if (tier == QualityTier::PublishStale) {
+        // The buffer still contains the last extracted joint torques
+        jointTorquesChannel.publish(berdyData.estimates.jointTorqueEstimates.data(),
+                                    yarp::os::Time::now(),
+                                    static_cast<std::uint64_t>(QualityTier::PublishStale));
+        return true;
+    }
+
+    if (!acquireInputs(berdyData.state, berdyData.buffers.measurements)) {
+        return false;
+    }
+
+    // The previous BERDY matrices are kept in the buffers
+    if (tier != QualityTier::ReuseMatrices
+        && !updateBerdyMatrices(berdyData.helper, berdyData.state, berdyData.matrices)) {
+        return false;
+    }
+
+    return estimateJointTorques(berdyData.state, berdyData.buffers.measurements, berdyData.matrices, tier);
+}
+
+bool HumanDynamicsEstimator::Impl::startPipeline(const size_t capacity)
+{
+    if (!pipeline.kinematicsHelper.init(
+            berdyData.helper.model(), berdyData.helper.sensors(), berdyData.helper.getOptions())) {
+        yError() << LogPrefix << "Failed to initialize BERDY for the kinematics stage";
+        return false;
+    }
+
+    // The frames are allocated here once and then reused by all the stages
+    EstimationFrame prototype;
+    prototype.state = berdyData.state;
+    prototype.measurements = berdyData.buffers.measurements;
+    prototype.matrices = berdyData.matrices;
+
+    pipeline.acquiredFrames.resize(capacity, prototype);
+    pipeline.kinematicsFrames.resize(capacity, prototype);
+    pipeline.droppedFrames = 0;
+
+    pipeline.running = true;
+    pipeline.kinematicsThread = std::thread(&Impl::kinematicsStageLoop, this);
+    pipeline.solverThread = std::thread(&Impl::solverStageLoop, this);
+    return true;
+}
+
+void HumanDynamicsEstimator::Impl::stopPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(pipeline.mutex);
+        pipeline.running = false;
+    }
+    pipeline.frameReady.notify_all();
+
+    if (pipeline.kinematicsThread.joinable()) {
+        pipeline.kinematicsThread.join();
+    }
+
+    if (pipeline.solverThread.joinable()) {
+        pipeline.solverThread.join();
+    }
+}
+
+void HumanDynamicsEstimator::Impl::notifyPipelineStages()
+{
+    // The ring buffers are lock-free: taking the mutex orders the change with the check of a
+    // stage that is about to wait, so that the notification is not lost
+    {
+        std::lock_guard<std::mutex> lock(pipeline.mutex);
+    }
+    pipeline.frameReady.notify_all();
+}
+
+void HumanDynamicsEstimator::Impl::kinematicsStageLoop()
+{
+    while (true) {
+        EstimationFrame* input = nullptr;
+        EstimationFrame* output = nullptr;
+
+        // Wait for a new frame and for a free slot for the solver stage
+        {
+            std::unique_lock<std::mutex> lock(pipeline.mutex);
+            pipeline.frameReady.wait(lock, [&]() {
+                input = pipeline.acquiredFrames.front();
+                output = pipeline.kinematicsFrames.beginWrite();
+                return !pipeline.running || (input && output);
+            });
+            if (!pipeline.running) {
+                return;
+            }
+        }
+
+        // Same sizes of the prototype, the copy does not allocate
+        output->state = input->state;
+        output->measurements = input->measurements;
+        pipeline.acquiredFrames.pop();
+
+        if (updateBerdyMatrices(pipeline.kinematicsHelper, output->state, output->matrices)) {
+            pipeline.kinematicsFrames.commitWrite();
+            notifyPipelineStages();
+        }
+    }
+}
+
+void HumanDynamicsEstimator::Impl::solverStageLoop()
+{
+    while (true) {
+        EstimationFrame* frame = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(pipeline.mutex);
+            pipeline.frameReady.wait(lock, [&]() {
+                frame = pipeline.kinematicsFrames.front();
+                return !pipeline.running || frame;
+            });
+            if (!pipeline.running) {
+                return;
+            }
+        }
+
+        if (estimateJointTorques(frame->state, frame->measurements, frame->matrices)) {
+            latency(LoopStage::PipelineLatency).record(frame->acquisitionBegin);
+        }
+        pipeline.kinematicsFrames.pop();
+        notifyPipelineStages();
+    }
+}
+
+// ================================
+// ESTIMATION CORES SHARING A SETUP
+// ================================
+
+// Per-thread or per-subject estimation state. The model, the priors and the symbolic
+// analysis of the solver are shared with the opened device, only the buffers and the
+// numeric factors are owned.
+struct EstimationCore
+{
+    iDynTree::BerdyHelper helper;
+    hde::estimation::FactorizedMAPSolver solver;
+    BerdyData::KinematicState state;
+    BerdyData::Matrices matrices;
+    iDynTree::VectorDynSize measurements;
+    iDynTree::VectorDynSize estimatedDynamicVariables;
+    iDynTree::JointDOFsDoubleArray jointTorques;
+};
+
+static bool initializeEstimationCore(const BerdyData& berdyData, EstimationCore& core)
+{
+    // BerdyHelper keeps the kinematic state, then each core needs its own
+    if (!core.helper.init(berdyData.helper.model(), berdyData.helper.sensors(), berdyData.helper.getOptions())) {
+        yError() << LogPrefix << "Failed to initialize BERDY for the estimation core";
+        return false;
+    }
+
+    if (!core.solver.shareSetup(berdyData.solver)) {
+        yError() << LogPrefix << "The Berdy solver of the device has not been analyzed";
+        return false;
+    }
+
+    core.state = berdyData.state;
+    core.matrices = berdyData.matrices;
+    core.measurements = berdyData.buffers.measurements;
+    core.estimatedDynamicVariables = berdyData.buffers.estimatedDynamicVariables;
+    core.jointTorques = berdyData.estimates.jointTorqueEstimates;
+
+    return true;
+}
+
+// Estimates the joint torques of the kinematic state already stored in the core
+static bool estimateWithCore(EstimationCore& core, const MeasurementScatterPlan& plan, const double* wrenchValues)
+{
+    plan.execute(wrenchValues, core.measurements);
+
+    core.helper.updateKinematicsFromFloatingBase(core.state.jointsPosition,
+                                                 core.state.jointsVelocity,
+                                                 core.state.floatingBaseFrameIndex,
+                                                 core.state.baseAngularVelocity);
+
+    if (!core.helper.getBerdyMatrices(core.matrices.D, core.matrices.bD, core.matrices.Y, core.matrices.bY)
+        || !core.solver.doEstimate(iDynTree::toEigen(core.matrices.D),
+                                   iDynTree::toEigen(core.matrices.bD),
+                                   iDynTree::toEigen(core.matrices.Y),
+                                   iDynTree::toEigen(core.matrices.bY),
+                                   iDynTree::toEigen(core.measurements))) {
+        return false;
+    }
+
+    iDynTree::toEigen(core.estimatedDynamicVariables) = core.solver.lastEstimate();
+    core.helper.extractJointTorquesFromDynamicVariables(core.estimatedDynamicVariables,
+                                                        core.state.jointsPosition,
+                                                        core.jointTorques);
+    return true;
+}
+
+// ========================
+// OFFLINE BATCH ESTIMATION
+// ========================
+
+// One line of the recorded file:
+// time, joint positions, joint velocities, base angular velocity, wrench values
+static bool estimateRecordedSample(EstimationCore& core, const MeasurementScatterPlan& plan, RecordedSample& sample)
+{
+    if (!copyToPreallocatedBuffer(sample.jointsPosition, core.state.jointsPosition)
+        || !copyToPreallocatedBuffer(sample.jointsVelocity, core.state.jointsVelocity)) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < 3; ++i) {
+        core.state.baseAngularVelocity.setVal(i, sample.baseAngularVelocity[i]);
+    }
+
+    if (!estimateWithCore(core, plan, sample.wrenchValues.data())) {
+        return false;
+    }
+
+    sample.jointTorques.assign(core.jointTorques.data(), core.jointTorques.data() + core.jointTorques.size());
+    return true;
+}
+
+// Parses a whitespace separated line of the recorded file. Returns false on malformed lines,
+// including the ones with more columns than expected.
+static bool parseRecordedSample(const std::string& line,
+                                const size_t numberOfJoints,
+                                const size_t numberOfWrenchValues,
+                                RecordedSample& sample)
+{
+    std::istringstream stream(line);
+
+    sample.jointsPosition.resize(numberOfJoints);
+    sample.jointsVelocity.resize(numberOfJoints);
+    sample.wrenchValues.resize(numberOfWrenchValues);
+
+    stream >> sample.time;
+    for (double& value : sample.jointsPosition) {
+        stream >> value;
+    }
+    for (double& value : sample.jointsVelocity) {
+        stream >> value;
+    }
+    for (double& value : sample.baseAngularVelocity) {
+        stream >> value;
+    }
+    for (double& value : sample.wrenchValues) {
+        stream >> value;
+    }
+
+    if (stream.fail()) {
+        return false;
+    }
+
+    // Extra columns mean that the file does not match the model
+    stream >> std::ws;
+    return stream.eof();
+}
+
+HumanDynamicsEstimator::HumanDynamicsEstimator()
+    : PeriodicThread(DefaultPeriod)
+    , pImpl{new Impl()}
+{}
+
+// Without this destructor here, the linker complains for
+// undefined reference to vtable
+HumanDynamicsEstimator::~HumanDynamicsEstimator() = default;
+
+bool HumanDynamicsEstimator::open(yarp::os::Searchable& config)
+{
+    hde::utils::StartupProfiler& profiler = pImpl->startupProfiler;
+    profiler.reset();
+    const hde::utils::StartupProfiler::PhaseGuard phaseGuard(profiler);
+    profiler.beginPhase("configuration");
+
+    // ===============================
+    // CHECK THE CONFIGURATION OPTIONS
+    // ===============================
+
+    if (!(config.check("period") && config.find("period").isFloat64())) {
+        yInfo() << LogPrefix << "Using default period:" << DefaultPeriod << "s";
+    }
+
+    if (!(config.check("urdf") && config.find("urdf").isString())) {
+        yError() << LogPrefix << "Parameter 'urdf' missing or invalid";
+        return false;
+    }
+
+    if (!(config.check("baseLink") && config.find("baseLink").isString())) {
+        yError() << LogPrefix << "Parameter 'baseLink' missing or invalid";
+        return false;
+    }
+
+    if (!(config.check("number_of_wrench_sensors") && config.find("number_of_wrench_sensors").isInt())) {
+        yError() << LogPrefix << "Parameter 'number_of_wrench_sensors' missing or invalid";
+        return false;
+    }
+
+    if (!(config.check("wrench_sensors_link_name") && config.find("wrench_sensors_link_name").isList())) {
+        yError() << LogPrefix << "Parameter 'number_of_wrench_sensors' missing or invalid";
+        return false;
+    }
+
+    // ===============================
+    // PARSE THE CONFIGURATION OPTIONS
+    // ===============================
+
+    double period = config.check("period") ? config.find("period").asFloat64() : DefaultPeriod;
+    if (!(period > 0) || !setPeriod(period)) {
+        yError() << LogPrefix << "Parameter 'period' invalid";
+        return false;
+    }
+
+    // Threads of the numeric factorization of the solver, including the one running the estimation.
+    // With the default of one thread the solver uses the sequential Eigen factorization.
+    size_t solverThreads = 1;
+    if (config.check("solver_threads")) {
+        if (!(config.find("solver_threads").isInt() && config.find("solver_threads").asInt() > 0)) {
+            yError() << LogPrefix << "Parameter 'solver_threads' invalid";
+            return false;
+        }
+        solverThreads = static_cast<size_t>(config.find("solver_threads").asInt());
+    }
+    pImpl->pipeline.enabled = config.check("pipelined") && config.find("pipelined").asBool();
+
+    const std::string warmUpPolicyName =
+        config.check("warm_up") ? config.find("warm_up").asString() : std::string("synchronous");
+    if (WarmUpPolicies.find(warmUpPolicyName) == WarmUpPolicies.end()) {
+        yError() << LogPrefix << "Parameter 'warm_up' must be one of: none, synchronous, asynchronous";
+        return false;
+    }
+    const WarmUpPolicy warmUpPolicy = WarmUpPolicies.at(warmUpPolicyName);
+
+    // generic: AMD ordering, kinematic_tree: leaf-to-root elimination along the dynamic traversal,
+    // auto: the ordering with the least flops among AMD, COLAMD, nested dissection and kinematic_tree,
+    // iterative: preconditioned conjugate gradient without factorization
+    const std::string solverBackend =
+        config.check("solver_backend") ? config.find("solver_backend").asString() : std::string("generic");
+    if (solverBackend != "generic" && solverBackend != "kinematic_tree" && solverBackend != "auto"
+        && solverBackend != "iterative") {
+        yError() << LogPrefix
+                 << "Parameter 'solver_backend' must be one of: generic, kinematic_tree, auto, iterative";
+        return false;
+    }
+
+    std::string urdfFileName = config.find("urdf").asString();
+    std::string baseLink = config.find("baseLink").asString();
+    int number_of_wrench_sensors = config.find("number_of_wrench_sensors").asInt();
+    yarp::os::Bottle* linkNames = config.find("wrench_sensors_link_name").asList();
+
+    if (number_of_wrench_sensors != linkNames->size()) {
+        yError() << LogPrefix << "mismatch between the number of wrench sensors and corresponding sensor link names list";
+        return false;
+    }
+
+    pImpl->wrenchSensorsLinkNames.resize(linkNames->size());
+    for (int i = 0; i < linkNames->size(); i++) {
+        pImpl->wrenchSensorsLinkNames.at(i) = linkNames->get(i).asString();
+    }
+
+    yInfo() << LogPrefix << "*** ===========================";
+    yInfo() << LogPrefix << "*** Period                    :" << period;
+    yInfo() << LogPrefix << "*** Pipelined                 :" << pImpl->pipeline.enabled;
+    yInfo() << LogPrefix << "*** Warm-up                   :" << warmUpPolicyName;
+    yInfo() << LogPrefix << "*** Solver backend            :" << solverBackend;
+    yInfo() << LogPrefix << "*** Urdf file name            :" << urdfFileName;
+    yInfo() << LogPrefix << "*** Base link name            :" << baseLink;
+    yInfo() << LogPrefix << "*** Number of wrench sensors  :" << number_of_wrench_sensors;
+    yInfo() << LogPrefix << "*** Wrench sensors link names :" << linkNames->toString();
+    yInfo() << LogPrefix << "*** ===========================";
+
+    // ===========
+    // BERDY SETUP
+    // ===========
+
+    // Find the URDF file
+    profiler.beginPhase("resource_finder");
+    auto& rf = yarp::os::ResourceFinder::getResourceFinderSingleton();
+    std::string urdfFilePath = rf.findFile(urdfFileName);
+    if (urdfFilePath.empty()) {
+        yError() << LogPrefix << "Failed to find file" << config.find("urdf").asString();
+        return false;
+    }
+
+    // Load the model and its sensors
+    profiler.beginPhase("model_loading");
+    const std::string modelSnapshotFilePath =
+        config.check("model_snapshot") ? config.find("model_snapshot").asString() : std::string();
+
+    iDynTree::SensorsList humanSensors;
+    if (!loadModel(urdfFilePath, modelSnapshotFilePath, pImpl->humanModel, humanSensors)) {
+        yError() << LogPrefix << "Failed to load the model";
+        return false;
+    }
+
+    pImpl->jointNames.clear();
+    for (size_t jointIndex = 0; jointIndex < pImpl->humanModel.getNrOfJoints(); ++jointIndex) {
+        pImpl->jointNames.emplace_back(pImpl->humanModel.getJointName(jointIndex));
+    }
+
+    // Set fixed frame index
+    pImpl->berdyData.state.floatingBaseFrameIndex = pImpl->humanModel.getFrameIndex(baseLink);
+
+    if (pImpl->berdyData.state.floatingBaseFrameIndex == iDynTree::FRAME_INVALID_INDEX) {
+        yError() << LogPrefix << "Passed frame" << baseLink << "not found in the model";
+        return false;
+    }
+
+    // If any, remove the sensors from the SENSORS_REMOVAL option
+    profiler.beginPhase("sensors_removal");
+    if (!parseSensorRemovalGroup(config.findGroup("SENSORS_REMOVAL"), humanSensors, pImpl->mapBerdySensorType)) {
+        yError() << LogPrefix << "Failed to parse SENSORS_REMOVAL group";
+        return false;
+    }
+
+    // Initialize the options
     iDynTree::BerdyOptions berdyOptions;
     berdyOptions.baseLink = baseLink;
     berdyOptions.berdyVariant = iDynTree::BerdyVariants::BERDY_FLOATING_BASE;
@@ -916,20 +2631,12 @@ bool HumanDynamicsEstimator::open(yarp::os::Searchable& config)
     }
 
     // Initialize the BerdyHelper
-    if (!pImpl->berdyData.helper.init(modelLoader.model(), humanSensors, berdyOptions)) {
+    profiler.beginPhase("berdy_helper_init");
+    if (!pImpl->berdyData.helper.init(pImpl->humanModel, humanSensors, berdyOptions)) {
         yError() << LogPrefix << "Failed to initialize BERDY";
         return false;
     }
 
-    // Initialize the BerdySolver
-    pImpl->berdyData.solver = std::make_unique<iDynTree::BerdySparseMAPSolver>(pImpl->berdyData.helper);
-    pImpl->berdyData.solver->initialize();
-
-    if (!pImpl->berdyData.solver->isValid()) {
-        yError() << LogPrefix << "Failed to initialize the Berdy MAP solver";
-        return false;
-    }
-
     // Get dynamic and measurement variable size
     size_t numberOfDynVariables = pImpl->berdyData.helper.getNrOfDynamicVariables();
     size_t numberOfDynEquations = pImpl->berdyData.helper.getNrOfDynamicEquations();
@@ -937,8 +2644,21 @@ bool HumanDynamicsEstimator::open(yarp::os::Searchable& config)
 
     // Set measurements size and initialize to zero
     pImpl->berdyData.buffers.measurements.resize(numberOfMeasurements);
+    pImpl->maskUpdates.resize(numberOfMeasurements);
     pImpl->berdyData.buffers.measurements.zero();
 
+    // Set the BERDY matrices size. Their sparsity pattern is fixed after BerdyHelper::init.
+    pImpl->berdyData.helper.resizeAndZeroBerdyMatrices(pImpl->berdyData.matrices.D,
+                                                       pImpl->berdyData.matrices.bD,
+                                                       pImpl->berdyData.matrices.Y,
+                                                       pImpl->berdyData.matrices.bY);
+
+    // Set the remaining buffers used by run(), that are not resized afterwards
+    pImpl->berdyData.buffers.estimatedDynamicVariables.resize(numberOfDynVariables);
+    pImpl->berdyData.buffers.estimatedDynamicVariables.zero();
+
+    pImpl->berdyData.buffers.wrenchValues.resize(6 * pImpl->wrenchSensorsLinkNames.size(), 0.0);
+
     // Set state variables size and initialize to zero
     pImpl->berdyData.state.jointsPosition = iDynTree::JointPosDoubleArray(pImpl->berdyData.helper.model());
     pImpl->berdyData.state.jointsPosition.zero();
@@ -955,7 +2675,17 @@ bool HumanDynamicsEstimator::open(yarp::os::Searchable& config)
     pImpl->berdyData.estimates.jointTorqueEstimates = iDynTree::JointDOFsDoubleArray(pImpl->berdyData.helper.model());
     pImpl->berdyData.estimates.jointTorqueEstimates.zero();
 
+    pImpl->jointTorquesChannel.resize(pImpl->berdyData.estimates.jointTorqueEstimates.size());
+
+    // Only the selected inversion is left to the requests of the joint torques variances
+    profiler.beginPhase("joint_torques_variances");
+    if (!pImpl->compileJointTorquesVariances()) {
+        yError() << LogPrefix << "Failed to compute the joint torques as a function of the dynamic variables";
+        return false;
+    }
+
     // Get the berdy sensors following its internal order
+    profiler.beginPhase("sensor_map_index");
     std::vector<iDynTree::BerdySensor> berdySensors = pImpl->berdyData.helper.getSensorsOrdering();
 
     /* The total number of sensors are :
@@ -983,207 +2713,316 @@ bool HumanDynamicsEstimator::open(yarp::os::Searchable& config)
 
     yInfo() << LogPrefix << "The sensors are parsed successfully";
 
+    // Compile the plan used in run() for filling the y vector
+    if (!buildMeasurementScatterPlan(berdySensors,
+                                     pImpl->sensorMapIndex,
+                                     pImpl->wrenchSensorsLinkNames,
+                                     numberOfMeasurements,
+                                     pImpl->measurementScatterPlan)) {
+        yError() << LogPrefix << "Failed to build the measurements scatter plan";
+        return false;
+    }
 
-    // Set mu_d prior size and initialize to zero
-    pImpl->berdyData.priors.dynamicsRegularizationExpectedValueVector.resize(numberOfDynVariables);
-    pImpl->berdyData.priors.dynamicsRegularizationExpectedValueVector.zero();
+    yInfo() << LogPrefix << "Measurements scatter plan:" << pImpl->measurementScatterPlan.wrenchCopies.size()
+            << "wrench copies," << pImpl->measurementScatterPlan.zeroRanges.size() << "zero ranges";
 
-    // Set sigma_d, sigma_D and sigma_y priors size and initialize identity triplets
-    pImpl->berdyData.priors.initializeSparseMatrixSize(numberOfDynVariables, pImpl->berdyData.priors.dynamicsRegularizationCovarianceMatrix);
-    pImpl->berdyData.priors.initializeSparseMatrixSize(numberOfDynEquations, pImpl->berdyData.priors.dynamicsConstraintsCovarianceMatrix);
-    pImpl->berdyData.priors.initializeSparseMatrixSize(numberOfMeasurements, pImpl->berdyData.priors.measurementsCovarianceMatrix);
 
-    // Parse the priors
-    if (!parsePriorsGroup(config.findGroup("PRIORS"), pImpl->berdyData, pImpl->mapBerdySensorType)) {
-        yError() << LogPrefix << "Failed to parse PRIORS group";
-        return false;
+    // Look for the priors parsed by a previous run, if the cache is enabled
+    profiler.beginPhase("priors_parsing");
+    const std::string priorsCacheFileName =
+        config.check("priors_cache") ? config.find("priors_cache").asString() : std::string();
+    std::uint64_t priorsCacheKey = 0;
+    bool priorsLoadedFromCache = false;
+
+    if (!priorsCacheFileName.empty()) {
+        if (!computePriorsCacheKey(urdfFilePath,
+                                   baseLink,
+                                   config.findGroup("SENSORS_REMOVAL"),
+                                   config.findGroup("PRIORS"),
+                                   priorsCacheKey)) {
+            yError() << LogPrefix << "Failed to read" << urdfFilePath << "for computing the priors cache key";
+            return false;
+        }
+
+        priorsLoadedFromCache = loadCachedPriors(
+            priorsCacheFileName, priorsCacheKey, pImpl->berdyData.helper, pImpl->berdyData.priors);
+
+        if (priorsLoadedFromCache) {
+            yInfo() << LogPrefix << "Priors loaded from the cache" << priorsCacheFileName;
+        }
     }
-    else {
-        yInfo() << LogPrefix << "PRIORS group parsed correctly";
+
+    if (!priorsLoadedFromCache) {
+        // Set mu_d prior size and initialize to zero
+        pImpl->berdyData.priors.dynamicsRegularizationExpectedValueVector.setZero(numberOfDynVariables);
+
+        // Set sigma_d, sigma_D and sigma_y priors size and initialize identity triplets
+        pImpl->berdyData.priors.initializeSparseMatrixSize(numberOfDynVariables, pImpl->berdyData.priors.dynamicsRegularizationCovarianceMatrix);
+        pImpl->berdyData.priors.initializeSparseMatrixSize(numberOfDynEquations, pImpl->berdyData.priors.dynamicsConstraintsCovarianceMatrix);
+        pImpl->berdyData.priors.initializeSparseMatrixSize(numberOfMeasurements, pImpl->berdyData.priors.measurementsCovarianceMatrix);
+
+        // Parse the priors
+        if (!parsePriorsGroup(config.findGroup("PRIORS"), pImpl->berdyData, pImpl->mapBerdySensorType)) {
+            yError() << LogPrefix << "Failed to parse PRIORS group";
+            return false;
+        }
+        else {
+            yInfo() << LogPrefix << "PRIORS group parsed correctly";
+        }
+
+        // A failure here only slows down the next startup
+        if (!priorsCacheFileName.empty()
+            && !storeCachedPriors(
+                priorsCacheFileName, priorsCacheKey, pImpl->berdyData.helper, pImpl->berdyData.priors)) {
+            yWarning() << LogPrefix << "Failed to write the priors cache" << priorsCacheFileName;
+        }
     }
 
     // Set the priors to berdy solver
-    pImpl->berdyData.solver->setDynamicsRegularizationPriorExpectedValue(pImpl->berdyData.priors.dynamicsRegularizationExpectedValueVector);
-    yInfo() << LogPrefix << "Berdy solver DynamicsRegularizationPriorExpectedValue set successfully";
+    profiler.beginPhase("solver_priors");
+    if (!setSolverPriors(pImpl->berdyData.priors, pImpl->berdyData.solver)) {
+        yError() << LogPrefix << "Failed to set the priors to the Berdy solver";
+        return false;
+    }
+    yInfo() << LogPrefix << "Berdy solver priors set successfully";
+
+    if (solverBackend == "kinematic_tree") {
+        hde::estimation::FactorizedMAPSolver::EliminationOrder eliminationOrder;
+        if (!hde::estimation::KinematicTreeOrdering::compute(pImpl->berdyData.helper, eliminationOrder)
+            || !pImpl->berdyData.solver.setEliminationOrder(eliminationOrder)) {
+            yError() << LogPrefix << "Failed to set the kinematic tree elimination order to the Berdy solver";
+            return false;
+        }
+    }
+
+    // The selection runs on the first BERDY matrices, its result is persisted beside the model by default.
+    // An empty ordering_cache disables the cache.
+    if (solverBackend == "auto") {
+        pImpl->eliminationOrderSelection.enabled = true;
+        pImpl->eliminationOrderSelection.cacheFileName = config.check("ordering_cache")
+                                                             ? config.find("ordering_cache").asString()
+                                                             : urdfFilePath + ".ordering";
+    }
+
+    if (!pImpl->berdyData.solver.setNumberOfThreads(solverThreads)) {
+        yError() << LogPrefix << "Failed to set the number of threads of the Berdy solver";
+        return false;
+    }
+    if (solverThreads > 1) {
+        yInfo() << LogPrefix << "Parallel factorization with" << solverThreads << "threads";
+    }
 
-    pImpl->berdyData.solver->setDynamicsRegularizationPriorCovariance(pImpl->berdyData.priors.dynamicsRegularizationCovarianceMatrix);
-    yInfo() << LogPrefix << "Berdy solver DynamicsRegularizationPriorCovariance set successfully";
+    yarp::os::Bottle& mixedPrecisionGroup = config.findGroup("MIXED_PRECISION");
+    if (!mixedPrecisionGroup.isNull() && !parseMixedPrecisionGroup(mixedPrecisionGroup, pImpl->berdyData.solver)) {
+        yError() << LogPrefix << "Failed to parse MIXED_PRECISION group";
+        return false;
+    }
 
-    pImpl->berdyData.solver->setDynamicsConstraintsPriorCovariance(pImpl->berdyData.priors.dynamicsConstraintsCovarianceMatrix);
-    yInfo() << LogPrefix << "Berdy solver DynamicsConstraintsPriorCovariance set successfully";
+    yarp::os::Bottle& iterativeGroup = config.findGroup("ITERATIVE");
+    if (solverBackend == "iterative") {
+        if (!mixedPrecisionGroup.isNull()) {
+            yError() << LogPrefix << "The iterative solver backend excludes the MIXED_PRECISION group";
+            return false;
+        }
+        if (!parseIterativeGroup(iterativeGroup, pImpl->berdyData.helper, pImpl->berdyData.solver)) {
+            yError() << LogPrefix << "Failed to parse ITERATIVE group";
+            return false;
+        }
+        pImpl->iterativeSolver.enabled = true;
+    }
+    else if (!iterativeGroup.isNull()) {
+        yWarning() << LogPrefix << "The ITERATIVE group is used only by the iterative solver backend, ignoring it";
+    }
 
-    pImpl->berdyData.solver->setMeasurementsPriorCovariance(pImpl->berdyData.priors.measurementsCovarianceMatrix);
-    yInfo() << LogPrefix << "Berdy solver MeasurementsPriorCovariance set successfully";
+    yarp::os::Bottle& recursiveGroup = config.findGroup("RECURSIVE");
+    if (!recursiveGroup.isNull() && !parseRecursiveGroup(recursiveGroup, pImpl->berdyData.solver)) {
+        yError() << LogPrefix << "Failed to parse RECURSIVE group";
+        return false;
+    }
 
-    // ----------------------------
-    // Run a first dummy estimation
-    // ----------------------------
+    profiler.endPhase();
 
-    // Set the kinematic information necessary for the dynamics estimation
-    pImpl->berdyData.helper.updateKinematicsFromFloatingBase(pImpl->berdyData.state.jointsPosition,
-                                                             pImpl->berdyData.state.jointsVelocity,
-                                                             pImpl->berdyData.state.floatingBaseFrameIndex,
-                                                             pImpl->berdyData.state.baseAngularVelocity);
+    // Parse the options of the deadline-aware mode, if any
+    yarp::os::Bottle& deadlineGroup = config.findGroup("DEADLINE");
+    if (!deadlineGroup.isNull()) {
+        if (pImpl->pipeline.enabled) {
+            yError() << LogPrefix << "The DEADLINE group is not supported by the pipelined estimation";
+            return false;
+        }
 
-    // Update estimator information
-    pImpl->berdyData.solver->updateEstimateInformationFloatingBase(pImpl->berdyData.state.jointsPosition,
-                                                                   pImpl->berdyData.state.jointsVelocity,
-                                                                   pImpl->berdyData.state.floatingBaseFrameIndex,
-                                                                   pImpl->berdyData.state.baseAngularVelocity,
-                                                                   pImpl->berdyData.buffers.measurements);
+        if (!parseDeadlineGroup(deadlineGroup, period, pImpl->deadline)) {
+            yError() << LogPrefix << "Failed to parse DEADLINE group";
+            return false;
+        }
 
-    // Do berdy estimation
-    if (!pImpl->berdyData.solver->doEstimate()) {
-        yError() << LogPrefix << "Failed to launch a first dummy estimation";
+        yInfo() << LogPrefix << "Deadline-aware mode with budget" << pImpl->deadline.budget << "s up to tier"
+                << QualityTierNames[static_cast<size_t>(pImpl->deadline.maxTier)];
+    }
+
+    // Every section of the loop overruns if alone it takes longer than the period
+    for (hde::utils::LatencyHistogram& histogram : pImpl->stageLatencies) {
+        histogram.setOverrunThreshold(period);
+    }
+    // A frame spends up to a period in each stage of the pipeline
+    pImpl->latency(LoopStage::PipelineLatency).setOverrunThreshold(NumberOfPipelineStages * period);
+
+    // ------------------------------------------
+    // Prepare the solver and warm the loop up
+    // ------------------------------------------
+
+    pImpl->warmUp = {};
+    if (warmUpPolicy == WarmUpPolicy::Asynchronous) {
+        // The first run() waits for it only if it is still in flight
+        Impl* impl = pImpl.get();
+        pImpl->warmUp = std::async(std::launch::async, [impl]() {
+                            hde::utils::StartupProfiler& warmUpProfiler = impl->warmUpProfiler;
+                            warmUpProfiler.reset();
+                            const bool prepared =
+                                impl->prepareEstimation(WarmUpPolicy::Asynchronous, &warmUpProfiler);
+                            warmUpProfiler.endPhase();
+
+                            yInfo() << LogPrefix << "Asynchronous warm-up"
+                                    << (prepared ? "completed in" : "failed after")
+                                    << warmUpProfiler.totalWallTime() << "s";
+                            std::istringstream warmUpReport(warmUpProfiler.toKeyValue());
+                            for (std::string line; std::getline(warmUpReport, line);) {
+                                yInfo() << LogPrefix << "Asynchronous warm-up" << line;
+                            }
+                            return prepared;
+                        }).share();
+    }
+    else if (!pImpl->prepareEstimation(warmUpPolicy, &profiler)) {
         return false;
     }
 
-    // Extract the estimated dynamic variables
-    iDynTree::VectorDynSize estimatedDynamicVariables(pImpl->berdyData.helper.getNrOfDynamicVariables());
-    pImpl->berdyData.solver->getLastEstimate(estimatedDynamicVariables);
+    profiler.endPhase();
 
-    // Extract joint torques from estimated dynamic variables
-    pImpl->berdyData.helper.extractJointTorquesFromDynamicVariables(estimatedDynamicVariables,
-                                                                    pImpl->berdyData.state.jointsPosition,
-                                                                    pImpl->berdyData.estimates.jointTorqueEstimates);
+    // ====
+    // MISC
+    // ====
 
-    return true;
-}
+    // With the asynchronous warm-up the stages are started by the first run()
+    if (pImpl->pipeline.enabled && !pImpl->warmUp.valid()) {
+        if (!pImpl->startPipeline(PipelineCapacity)) {
+            return false;
+        }
+        yInfo() << LogPrefix << "Started the pipelined estimation stages";
+    }
+
+    // Startup report
+    std::istringstream startupReport(profiler.toKeyValue());
+    for (std::string line; std::getline(startupReport, line);) {
+        yInfo() << LogPrefix << "Startup" << line;
+    }
+
+    if (config.check("startup_report")) {
+        const std::string reportFileName = config.find("startup_report").asString();
+        std::ofstream reportFile(reportFileName);
+        if (!(reportFile << profiler.toJSON() << "\n")) {
+            yWarning() << LogPrefix << "Failed to write the startup report" << reportFileName;
+        }
+    }
 
-bool HumanDynamicsEstimator::close()
-{
     return true;
 }
 
-void HumanDynamicsEstimator::run()
+bool HumanDynamicsEstimator::close()
 {
-    // Get state data from the attached IHumanState interface
-    std::vector<double> jointsPosition    = pImpl->iHumanState->getJointPositions();
-    std::vector<double> jointsVelocity    = pImpl->iHumanState->getJointVelocities();
+    // The loop feeds the pipeline, it is stopped before the stages
+    if (isRunning()) {
+        stop();
+    }
 
-    std::array<double, 3> basePosition    = pImpl->iHumanState->getBasePosition();
-    std::array<double, 4> baseOrientation = pImpl->iHumanState->getBaseOrientation();
-    std::array<double, 6> baseVelocity    = pImpl->iHumanState->getBaseVelocity();
+    pImpl->waitForWarmUp();
+    pImpl->stopPipeline();
 
-    // Set base angular velocity
-    pImpl->berdyData.state.baseAngularVelocity.setVal(0, baseVelocity.at(3));
-    pImpl->berdyData.state.baseAngularVelocity.setVal(1, baseVelocity.at(4));
-    pImpl->berdyData.state.baseAngularVelocity.setVal(2, baseVelocity.at(5));
+    if (pImpl->pipeline.enabled) {
+        yInfo() << LogPrefix << "Pipelined estimation dropped" << pImpl->pipeline.droppedFrames << "frames";
+    }
 
-    // Set the received state data to berdy state variables
-    pImpl->berdyData.state.jointsPosition.resize(jointsPosition.size());
-    for (size_t i = 0; i < jointsPosition.size(); i++) {
-        pImpl->berdyData.state.jointsPosition.setVal(i, jointsPosition.at(i));
+    if (pImpl->deadline.enabled) {
+        const DeadlineStatistics deadline = getDeadlineStatistics();
+        yInfo() << LogPrefix << "Deadline-aware mode: overruns" << deadline.overruns << "degradations"
+                << deadline.degradations << "recoveries" << deadline.recoveries << "last tier"
+                << deadline.currentTierName;
     }
 
-    pImpl->berdyData.state.jointsVelocity.resize(jointsVelocity.size());
-    for (size_t i = 0; i < jointsVelocity.size(); ++i) {
-        pImpl->berdyData.state.jointsVelocity.setVal(i, jointsVelocity.at(i));
+    if (pImpl->iterativeSolver.enabled) {
+        const IterativeSolverStatistics iterative = getIterativeSolverStatistics();
+        yInfo() << LogPrefix << "Iterative solver: solves" << iterative.solves << "max iterations"
+                << iterative.maxIterations << "last relative residual" << iterative.lastRelativeResidual;
     }
 
-    // Fill in the y vector with sensor measurements for the FT sensors
-    std::vector<double> wrenchValues = pImpl->iHumanWrench->getWrenches();
+    // Dump the latency statistics of the estimation loop
+    for (const StageLatency& stage : getStageLatencies()) {
+        yInfo() << LogPrefix << "Latency of" << stage.stage << ": samples" << stage.count << "p50"
+                << stage.p50 << "s p99" << stage.p99 << "s max" << stage.max << "s period overruns"
+                << stage.periodOverruns;
+    }
 
-    // Get the berdy sensors following its internal order
-    std::vector<iDynTree::BerdySensor> berdySensors = pImpl->berdyData.helper.getSensorsOrdering();
+    return true;
+}
 
-    // Clear measurements
-    pImpl->berdyData.buffers.measurements.zero();
+void HumanDynamicsEstimator::run()
+{
+    // The first ticks wait for the asynchronous warm-up if it is still in flight. Without
+    // the solver the device cannot estimate, then its thread is stopped.
+    if (!pImpl->waitForWarmUp()) {
+        yError() << LogPrefix << "The asynchronous warm-up failed, stopping the estimation";
+        askToStop();
+        return;
+    }
+
+    if (pImpl->pipeline.enabled) {
+        if (!pImpl->pipeline.running) {
+            if (!pImpl->startPipeline(PipelineCapacity)) {
+                askToStop();
+                return;
+            }
+            yInfo() << LogPrefix << "Started the pipelined estimation stages";
+        }
 
-    /* The total number of sensors are :
-     * 17 Accelerometers, 66 DOF Acceleration sensors and 67 NET EXT WRENCH sensors
-     * The total number of sensor measurements = (17x3) + (66x1) + (67x6) = 519
-     */
+        // Only the acquisition is executed here, the other stages run in their threads
+        const auto tickBegin = hde::utils::LatencyHistogram::Clock::now();
+        EstimationFrame* frame = pImpl->pipeline.acquiredFrames.beginWrite();
 
-    // Iterate over the sensors and add corresponding measurements
-    for (const iDynTree::BerdySensor& sensor : berdySensors) {
-        // Create the key
-        SensorKey key = {sensor.type, sensor.id};
+        if (!frame) {
+            ++pImpl->pipeline.droppedFrames;
+            return;
+        }
 
-        // Check that it exists in the sensorMapIndex
-        if (pImpl->sensorMapIndex.find(key) != pImpl->sensorMapIndex.end()) {
-            SensorMapIndex::const_iterator found = pImpl->sensorMapIndex.find(key);
-            // Update sensor measurements vector y
-            switch (sensor.type)
-            {
-                case iDynTree::ACCELEROMETER_SENSOR:
-                {
-                    // Filling y vector with zero values for ACCELEROMETER sensors
-                    // TODO: Fill the correct data
-                    for (int i = 0; i < 3; i++)
-                    {
-                        pImpl->berdyData.buffers.measurements(found->second.offset + i) = 0;
-                    }
-                }
-                break;
-                case iDynTree::DOF_ACCELERATION_SENSOR:
-                {
-                    // Filling y vector with zero values for DOF_ACCELEROMETER sensors
-                    pImpl->berdyData.buffers.measurements(found->second.offset) = 0;
-                }
-                break;
-                case iDynTree::NET_EXT_WRENCH_SENSOR:
-                {
-                    // Filling y vector with zero values for NET_EXT_WRENCH sensors
-                    for (int idx = 0; idx < pImpl->wrenchSensorsLinkNames.size(); idx++) {
-                        std::string wrenchSensorLinkName = pImpl->wrenchSensorsLinkNames.at(idx);
-                        if (wrenchSensorLinkName.compare(sensor.id) == 0) {
-                            for (int i = 0; i < 6; i++)
-                            {
-                                pImpl->berdyData.buffers.measurements(found->second.offset + i) = wrenchValues.at(idx*6 + i);
-                            }
-                            break;
-                        }
-                        else {
-                            for (int i = 0; i < 6; i++)
-                            {
-                                pImpl->berdyData.buffers.measurements(found->second.offset + i) = 0;
-                            }
-                        }
-                    }
-                }
-                break;
-            default:
-                yWarning() << LogPrefix << sensor.type << " sensor unimplemented";
-                break;
-            }
+        if (pImpl->acquireInputs(frame->state, frame->measurements)) {
+            frame->acquisitionBegin = tickBegin;
+            pImpl->pipeline.acquiredFrames.commitWrite();
+            pImpl->notifyPipelineStages();
+            pImpl->latency(LoopStage::Tick).record(tickBegin);
         }
-    }
 
-    // Set the kinematic information necessary for the dynamics estimation
-    pImpl->berdyData.helper.updateKinematicsFromFloatingBase(pImpl->berdyData.state.jointsPosition,
-                                                             pImpl->berdyData.state.jointsVelocity,
-                                                             pImpl->berdyData.state.floatingBaseFrameIndex,
-                                                             pImpl->berdyData.state.baseAngularVelocity);
-
-    // Update estimator information
-    pImpl->berdyData.solver->updateEstimateInformationFloatingBase(pImpl->berdyData.state.jointsPosition,
-                                                                   pImpl->berdyData.state.jointsVelocity,
-                                                                   pImpl->berdyData.state.floatingBaseFrameIndex,
-                                                                   pImpl->berdyData.state.baseAngularVelocity,
-                                                                   pImpl->berdyData.buffers.measurements);
-    // Do berdy estimation
-    if (!pImpl->berdyData.solver->doEstimate()) {
-        yError() << LogPrefix << "Failed to do berdy estimation";
+        return;
     }
 
-    // Extract the estimated dynamic variables
-    iDynTree::VectorDynSize estimatedDynamicVariables(pImpl->berdyData.helper.getNrOfDynamicVariables());
-    pImpl->berdyData.solver->getLastEstimate(estimatedDynamicVariables);
+    const auto tickBegin = hde::utils::LatencyHistogram::Clock::now();
+    const QualityTier tier = pImpl->deadline.enabled ? pImpl->deadline.currentTier() : QualityTier::Full;
 
-    // ===========================
-    // EXPOSE DATA FOR IHUMANSTATE
-    // ===========================
+    const bool succeeded = pImpl->tick(tier);
+    const auto tickDuration = hde::utils::LatencyHistogram::Clock::now() - tickBegin;
 
-    {
-        std::lock_guard<std::mutex> lock(pImpl->mutex);
+    if (pImpl->deadline.enabled) {
+        pImpl->deadline.update(tier, std::chrono::duration<double>(tickDuration).count());
 
-        // Extract joint torques from estimated dynamic variables
-        pImpl->berdyData.helper.extractJointTorquesFromDynamicVariables(estimatedDynamicVariables,
-                                                                        pImpl->berdyData.state.jointsPosition,
-                                                                        pImpl->berdyData.estimates.jointTorqueEstimates);
+        const QualityTier nextTier = pImpl->deadline.currentTier();
+        if (nextTier > tier) {
+            yWarning() << LogPrefix << "Tick budget overrun, degrading the estimation to"
+                       << QualityTierNames[static_cast<size_t>(nextTier)];
+        }
+        else if (nextTier < tier) {
+            yInfo() << LogPrefix << "Recovering the estimation to" << QualityTierNames[static_cast<size_t>(nextTier)];
+        }
     }
 
+    if (succeeded) {
+        pImpl->latency(LoopStage::Tick).record(tickDuration);
+    }
 }
 
 bool HumanDynamicsEstimator::attach(yarp::dev::PolyDriver* poly)
@@ -1221,13 +3060,6 @@ bool HumanDynamicsEstimator::attach(yarp::dev::PolyDriver* poly)
             return false;
         }
 
-        // Check the interface
-        auto numberOfSensors = stoi(poly->getValue("number_of_sources").asString());
-        if (pImpl->iAnalogSensor->getChannels() != 6 * numberOfSensors) {
-            yError() << LogPrefix << "The IAnalogSensor interface might not be ready";
-            return false;
-        }
-
         // Attach IHumanWrench interfaces coming from HumanWrenchProvider
         if (pImpl->iHumanWrench || !poly->view(pImpl->iHumanWrench) || !pImpl->iHumanWrench) {
             yError() << LogPrefix << "Failed to view iHumanWrench interface from the polydriver";
@@ -1235,12 +3067,30 @@ bool HumanDynamicsEstimator::attach(yarp::dev::PolyDriver* poly)
         }
 
         // Check the interface
+        const std::vector<std::string> wrenchSourceNames = pImpl->iHumanWrench->getWrenchSourceNames();
         if (pImpl->iHumanWrench->getNumberOfWrenchSources() == 0
-                || pImpl->iHumanWrench->getNumberOfWrenchSources() != pImpl->iHumanWrench->getWrenchSourceNames().size()) {
+                || pImpl->iHumanWrench->getNumberOfWrenchSources() != wrenchSourceNames.size()) {
             yError() << "The IHumanWrench interface might not be ready";
             return false;
         }
 
+        // run() reads 6 channels per source in the order of the sources, the scatter plan
+        // expects them in the order of wrench_sensors_link_name
+        if (wrenchSourceNames != pImpl->wrenchSensorsLinkNames) {
+            yError() << LogPrefix << "The wrench sources of" << deviceName
+                     << "do not match the 'wrench_sensors_link_name' parameter in number and order";
+            return false;
+        }
+
+        // The preallocated buffer has exactly the channels read by run()
+        if (pImpl->iAnalogSensor->getChannels() < 0
+            || static_cast<size_t>(pImpl->iAnalogSensor->getChannels())
+                   != pImpl->berdyData.buffers.wrenchValues.size()) {
+            yError() << LogPrefix << "The IAnalogSensor interface has" << pImpl->iAnalogSensor->getChannels()
+                     << "channels but" << pImpl->berdyData.buffers.wrenchValues.size() << "are expected";
+            return false;
+        }
+
         yInfo() << LogPrefix << deviceName << "attach() successful";
     }
 
@@ -1302,30 +3152,580 @@ bool HumanDynamicsEstimator::detachAll()
 
 std::vector<std::string> HumanDynamicsEstimator::getJointNames() const
 {
-    std::lock_guard<std::mutex> lock(pImpl->mutex);
-    std::vector<std::string> jointNames;
+    return pImpl->jointNames;
+}
 
-    for (size_t jointIndex = 0; jointIndex < pImpl->humanModel.getNrOfJoints(); ++jointIndex) {
-        jointNames.emplace_back(pImpl->humanModel.getJointName(jointIndex));
+size_t HumanDynamicsEstimator::getNumberOfJoints() const
+{
+    return pImpl->jointNames.size();
+}
+
+std::vector<double> HumanDynamicsEstimator::getJointTorques() const
+{
+    // Empty until the first estimate is published
+    JointTorquesSnapshot snapshot;
+    if (!getJointTorquesSnapshot(snapshot)) {
+        return {};
+    }
+    return snapshot.torques;
+}
+
+bool HumanDynamicsEstimator::getJointTorquesSnapshot(JointTorquesSnapshot& snapshot) const
+{
+    std::uint64_t tier = 0;
+    snapshot.torques.resize(pImpl->jointTorquesChannel.size());
+
+    if (!pImpl->jointTorquesChannel.read(snapshot.torques.data(), snapshot.sequence, snapshot.timestamp, tier)) {
+        return false;
     }
 
-    return jointNames;
+    snapshot.qualityTier = static_cast<unsigned>(tier);
+    snapshot.isStale = tier == static_cast<std::uint64_t>(QualityTier::PublishStale);
+    return true;
 }
 
-size_t HumanDynamicsEstimator::getNumberOfJoints() const
+void HumanDynamicsEstimator::requestJointTorquesVariances()
 {
-    std::lock_guard<std::mutex> lock(pImpl->mutex);
-    return pImpl->humanModel.getNrOfJoints();
+    pImpl->torquesVariances.requested.store(true, std::memory_order_release);
 }
 
-std::vector<double> HumanDynamicsEstimator::getJointTorques() const
+bool HumanDynamicsEstimator::getJointTorquesVariances(std::vector<double>& variances) const
+{
+    std::uint64_t sequence = 0;
+    double timestamp = 0;
+    variances.resize(pImpl->torquesVariances.channel.size());
+
+    return pImpl->torquesVariances.channel.read(variances.data(), sequence, timestamp);
+}
+
+std::vector<HumanDynamicsEstimator::StageLatency> HumanDynamicsEstimator::getStageLatencies() const
+{
+    std::vector<StageLatency> stages;
+    stages.reserve(LoopStageNames.size());
+
+    for (size_t i = 0; i < LoopStageNames.size(); ++i) {
+        const hde::utils::LatencyHistogram::Statistics statistics = pImpl->stageLatencies[i].statistics();
+
+        StageLatency stage;
+        stage.stage = LoopStageNames[i];
+        stage.count = statistics.count;
+        stage.p50 = statistics.p50;
+        stage.p99 = statistics.p99;
+        stage.max = statistics.max;
+        stage.periodOverruns = statistics.overruns;
+        stages.push_back(stage);
+    }
+
+    return stages;
+}
+
+std::string HumanDynamicsEstimator::getStartupReport() const
+{
+    std::string report = pImpl->startupProfiler.toJSON();
+
+    // The asynchronous warm-up overlaps with the end of open() and the first ticks, its phases
+    // are reported in their own object
+    if (pImpl->warmUp.valid()) {
+        pImpl->waitForWarmUp();
+        report.insert(report.size() - 1, ", \"asynchronous_warm_up\": " + pImpl->warmUpProfiler.toJSON());
+    }
+    return report;
+}
+
+bool HumanDynamicsEstimator::setSensorPriorCovariance(const std::string& sensorType,
+                                                      const std::string& sensorId,
+                                                      const std::vector<double>& covariance)
+{
+    iDynTree::IndexRange range;
+    if (!pImpl->findSensorRange(sensorType, sensorId, range)) {
+        return false;
+    }
+
+    // A single value is used for all the variances, as in the PRIORS group
+    std::vector<double> values = covariance;
+    if (values.size() == 1 && !getVectorWithFullCovarianceValues(sensorType, values)) {
+        return false;
+    }
+
+    Impl::PriorUpdate update;
+    update.isMeasurementsPrior = true;
+    update.offset = static_cast<size_t>(range.offset);
+
+    if (!getCovarianceBlockOfSize(values, static_cast<size_t>(range.size), update.covariance)) {
+        yError() << LogPrefix << "Invalid covariance for the sensor" << sensorId;
+        return false;
+    }
+
+    pImpl->requestPriorUpdate(std::move(update));
+    return true;
+}
+
+bool HumanDynamicsEstimator::setSensorActive(const std::string& sensorType,
+                                             const std::string& sensorId,
+                                             const bool active)
+{
+    iDynTree::IndexRange range;
+    if (!pImpl->findSensorRange(sensorType, sensorId, range)) {
+        return false;
+    }
+
+    Impl::MaskUpdate update;
+    update.offset = static_cast<size_t>(range.offset);
+    update.size = static_cast<size_t>(range.size);
+    update.active = active;
+
+    return pImpl->maskUpdates.request(update);
+}
+
+bool HumanDynamicsEstimator::setDynamicVariablesPriorCovariance(const size_t offset,
+                                                                const size_t size,
+                                                                const std::vector<double>& covariance)
+{
+    if (offset + size > pImpl->berdyData.helper.getNrOfDynamicVariables()) {
+        yError() << LogPrefix << "The range of dynamic variables [" << offset << "," << offset + size
+                 << ") exceeds their number" << pImpl->berdyData.helper.getNrOfDynamicVariables();
+        return false;
+    }
+
+    Impl::PriorUpdate update;
+    update.isMeasurementsPrior = false;
+    update.offset = offset;
+
+    // A single value is used for all the variances
+    const std::vector<double> values =
+        covariance.size() == 1 ? std::vector<double>(size, covariance.front()) : covariance;
+    if (!getCovarianceBlockOfSize(values, size, update.covariance)) {
+        yError() << LogPrefix << "Invalid covariance for the dynamic variables";
+        return false;
+    }
+
+    pImpl->requestPriorUpdate(std::move(update));
+    return true;
+}
+
+HumanDynamicsEstimator::DeadlineStatistics HumanDynamicsEstimator::getDeadlineStatistics() const
+{
+    const DeadlineController& deadline = pImpl->deadline;
+
+    DeadlineStatistics statistics;
+    statistics.enabled = deadline.enabled;
+    statistics.budget = deadline.budget;
+    statistics.currentTier = static_cast<unsigned>(deadline.currentTier());
+    statistics.currentTierName = QualityTierNames[statistics.currentTier];
+    statistics.overruns = deadline.overruns.load(std::memory_order_relaxed);
+    statistics.degradations = deadline.degradations.load(std::memory_order_relaxed);
+    statistics.recoveries = deadline.recoveries.load(std::memory_order_relaxed);
+
+    for (const std::atomic<std::uint64_t>& ticks : deadline.ticksPerTier) {
+        statistics.ticksPerTier.push_back(ticks.load(std::memory_order_relaxed));
+    }
+
+    return statistics;
+}
+
+HumanDynamicsEstimator::IterativeSolverStatistics HumanDynamicsEstimator::getIterativeSolverStatistics() const
+{
+    IterativeSolverStatistics statistics;
+    statistics.enabled = pImpl->iterativeSolver.enabled;
+    statistics.solves = pImpl->iterativeSolver.solves.load(std::memory_order_relaxed);
+    statistics.lastIterations = pImpl->iterativeSolver.lastIterations.load(std::memory_order_relaxed);
+    statistics.maxIterations = pImpl->iterativeSolver.maxIterations.load(std::memory_order_relaxed);
+    statistics.lastRelativeResidual = pImpl->iterativeSolver.lastRelativeResidual.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+bool HumanDynamicsEstimator::replayRecordedInputs(const std::string& inputFileName)
+{
+    if (isRunning() || !pImpl->waitForWarmUp() || !pImpl->berdyData.solver.isAnalyzed()) {
+        yError() << LogPrefix << "The recorded inputs must be replayed after open() and before start()";
+        return false;
+    }
+
+    std::ifstream inputFile(inputFileName);
+    if (!inputFile.is_open()) {
+        yError() << LogPrefix << "Failed to open the recorded file" << inputFileName;
+        return false;
+    }
+
+    const size_t numberOfJoints = pImpl->berdyData.state.jointsPosition.size();
+    const size_t numberOfWrenchValues = 6 * pImpl->wrenchSensorsLinkNames.size();
+
+    std::vector<RecordedSample> samples;
+    size_t lineNumber = 0;
+    for (std::string line; std::getline(inputFile, line);) {
+        ++lineNumber;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        samples.emplace_back();
+        if (!parseRecordedSample(line, numberOfJoints, numberOfWrenchValues, samples.back())) {
+            yError() << LogPrefix << "Malformed line" << lineNumber << "in" << inputFileName;
+            return false;
+        }
+    }
+
+    if (samples.empty()) {
+        yError() << LogPrefix << "No samples in the recorded file" << inputFileName;
+        return false;
+    }
+
+    pImpl->replay.samples = std::move(samples);
+    pImpl->replay.next = 0;
+    return true;
+}
+
+bool HumanDynamicsEstimator::runBatchEstimation(const std::string& inputFileName,
+                                                const std::string& outputFileName,
+                                                const size_t numberOfThreads)
+{
+    if (!pImpl->waitForWarmUp() || !pImpl->berdyData.solver.isAnalyzed()) {
+        yError() << LogPrefix << "The device must be opened before running the batch estimation";
+        return false;
+    }
+
+    std::ifstream inputFile(inputFileName);
+    if (!inputFile.is_open()) {
+        yError() << LogPrefix << "Failed to open the recorded file" << inputFileName;
+        return false;
+    }
+
+    std::ofstream outputFile(outputFileName);
+    if (!outputFile.is_open()) {
+        yError() << LogPrefix << "Failed to open the output file" << outputFileName;
+        return false;
+    }
+    outputFile.precision(std::numeric_limits<double>::max_digits10);
+
+    // The recursive estimate of a sample depends on all the previous ones, then the samples are
+    // estimated in time order by a single worker, whatever the number of threads
+    size_t nrOfWorkers = std::max<size_t>(1, numberOfThreads);
+    if (pImpl->berdyData.solver.isRecursive() && nrOfWorkers > 1) {
+        yWarning() << LogPrefix << "The recursive estimation of the recorded samples is sequential, using one thread";
+        nrOfWorkers = 1;
+    }
+
+    // Every worker owns its estimation core, sharing the setup done in open()
+    std::vector<std::unique_ptr<EstimationCore>> workers;
+    for (size_t i = 0; i < nrOfWorkers; ++i) {
+        workers.emplace_back(new EstimationCore());
+        if (!initializeEstimationCore(pImpl->berdyData, *workers.back())) {
+            yError() << LogPrefix << "Failed to initialize the batch worker" << i;
+            return false;
+        }
+        // The sensors excluded from the device are excluded also from the recorded samples
+        pImpl->maskUpdates.applyRequested(workers.back()->solver);
+    }
+
+    // The calling thread is one of the workers
+    hde::utils::FixedThreadPool threadPool(nrOfWorkers - 1);
+
+    const size_t numberOfJoints = pImpl->berdyData.state.jointsPosition.size();
+    const size_t numberOfWrenchValues = 6 * pImpl->wrenchSensorsLinkNames.size();
+
+    // The file is streamed in blocks. Each block is split in contiguous time chunks, one per worker,
+    // and written in order once all the workers are done.
+    std::vector<RecordedSample> block(nrOfWorkers * BatchChunkSize);
+    std::vector<char> chunkSucceeded(nrOfWorkers);
+    size_t lineNumber = 0;
+    size_t nrOfSamples = 0;
+    std::string line;
+
+    const auto batchBegin = std::chrono::steady_clock::now();
+
+    while (inputFile) {
+        // Read the next block
+        size_t blockSize = 0;
+        while (blockSize < block.size() && std::getline(inputFile, line)) {
+            ++lineNumber;
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            if (!parseRecordedSample(line, numberOfJoints, numberOfWrenchValues, block[blockSize])) {
+                yError() << LogPrefix << "Malformed line" << lineNumber << "in" << inputFileName;
+                return false;
+            }
+            ++blockSize;
+        }
+
+        if (blockSize == 0) {
+            break;
+        }
+
+        // Process the chunks in parallel
+        threadPool.parallelFor(nrOfWorkers, [&](const size_t w) {
+            const size_t chunkBegin = std::min(blockSize, w * BatchChunkSize);
+            const size_t chunkEnd = std::min(blockSize, chunkBegin + BatchChunkSize);
+            chunkSucceeded[w] = true;
+
+            for (size_t i = chunkBegin; i < chunkEnd; ++i) {
+                if (!estimateRecordedSample(*workers[w], pImpl->measurementScatterPlan, block[i])) {
+                    chunkSucceeded[w] = false;
+                    return;
+                }
+            }
+        });
+
+        if (std::find(chunkSucceeded.begin(), chunkSucceeded.end(), false) != chunkSucceeded.end()) {
+            yError() << LogPrefix << "Failed to estimate the block ending at line" << lineNumber;
+            return false;
+        }
+
+        // Write the time-indexed torques
+        for (size_t i = 0; i < blockSize; ++i) {
+            outputFile << block[i].time;
+            for (const double torque : block[i].jointTorques) {
+                outputFile << " " << torque;
+            }
+            outputFile << "\n";
+        }
+
+        nrOfSamples += blockSize;
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchBegin).count();
+    yInfo() << LogPrefix << "Batch estimation of" << nrOfSamples << "samples with" << nrOfWorkers
+            << "threads completed in" << elapsed << "s";
+
+    return static_cast<bool>(outputFile);
+}
+
+// ===================================
+// MULTI SUBJECT ESTIMATION, ONE SETUP
+// ===================================
+
+class MultiSubjectDynamicsEstimator::Impl
+{
+public:
+    struct Subject
+    {
+        hde::interfaces::IHumanState* iHumanState = nullptr;
+        yarp::dev::IAnalogSensor* iAnalogSensor = nullptr;
+
+        EstimationCore core;
+        yarp::sig::Vector wrenchValues;
+        hde::utils::SeqLockChannel jointTorquesChannel;
+
+        // Sensors of this subject excluded from the estimation
+        HumanDynamicsEstimator::Impl::MaskUpdates maskUpdates;
+    };
+
+    // Owner of the shared setup: model, sensors ordering, priors and solver analysis
+    HumanDynamicsEstimator setup;
+    bool isOpen = false;
+
+    std::vector<std::unique_ptr<Subject>> subjects;
+    std::vector<char> subjectSucceeded;
+    std::unique_ptr<hde::utils::FixedThreadPool> threadPool;
+
+    bool tick(Subject& subject);
+};
+
+bool MultiSubjectDynamicsEstimator::Impl::tick(Subject& subject)
+{
+    // IHumanState only provides getters returning by value
+    const std::vector<double> jointsPosition = subject.iHumanState->getJointPositions();
+    const std::vector<double> jointsVelocity = subject.iHumanState->getJointVelocities();
+    const std::array<double, 6> baseVelocity = subject.iHumanState->getBaseVelocity();
+
+    EstimationCore& core = subject.core;
+
+    if (!copyToPreallocatedBuffer(jointsPosition, core.state.jointsPosition)
+        || !copyToPreallocatedBuffer(jointsVelocity, core.state.jointsVelocity)) {
+        yError() << LogPrefix << "Received" << jointsPosition.size() << "joint positions and"
+                 << jointsVelocity.size() << "joint velocities but the model has"
+                 << core.state.jointsPosition.size() << "joints";
+        return false;
+    }
+
+    for (unsigned i = 0; i < 3; ++i) {
+        core.state.baseAngularVelocity.setVal(i, baseVelocity[3 + i]);
+    }
+
+    const MeasurementScatterPlan& plan = setup.pImpl->measurementScatterPlan;
+
+    if (subject.iAnalogSensor->read(subject.wrenchValues) != yarp::dev::IAnalogSensor::AS_OK
+        || subject.wrenchValues.size() != setup.pImpl->berdyData.buffers.wrenchValues.size()) {
+        yError() << LogPrefix << "Failed to read the wrench values";
+        return false;
+    }
+
+    subject.maskUpdates.applyPending(core.solver);
+
+    if (!estimateWithCore(core, plan, subject.wrenchValues.data())) {
+        yError() << LogPrefix << "Failed to do berdy estimation";
+        return false;
+    }
+
+    subject.jointTorquesChannel.publish(core.jointTorques.data(), yarp::os::Time::now());
+    return true;
+}
+
+MultiSubjectDynamicsEstimator::MultiSubjectDynamicsEstimator()
+    : pImpl{new Impl()}
+{}
+
+MultiSubjectDynamicsEstimator::~MultiSubjectDynamicsEstimator()
+{
+    close();
+}
+
+bool MultiSubjectDynamicsEstimator::open(yarp::os::Searchable& config)
+{
+    if (pImpl->isOpen) {
+        yError() << LogPrefix << "The multi subject estimator is already open";
+        return false;
+    }
+
+    size_t numberOfThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    if (config.check("number_of_threads")) {
+        if (!(config.find("number_of_threads").isInt() && config.find("number_of_threads").asInt() > 0)) {
+            yError() << LogPrefix << "Parameter 'number_of_threads' invalid";
+            return false;
+        }
+        numberOfThreads = static_cast<size_t>(config.find("number_of_threads").asInt());
+    }
+
+    if (config.check("pipelined") && config.find("pipelined").asBool()) {
+        yWarning() << LogPrefix << "The 'pipelined' option is ignored by the multi subject estimator";
+    }
+
+    // Build the shared setup only once
+    if (!pImpl->setup.open(config) || !pImpl->setup.pImpl->waitForWarmUp()) {
+        yError() << LogPrefix << "Failed to build the setup shared by the subjects";
+        return false;
+    }
+    pImpl->setup.pImpl->stopPipeline();
+
+    // The calling thread is one of the workers
+    pImpl->threadPool.reset(new hde::utils::FixedThreadPool(numberOfThreads - 1));
+    pImpl->isOpen = true;
+
+    yInfo() << LogPrefix << "Multi subject estimator ready with" << numberOfThreads << "threads";
+    return true;
+}
+
+bool MultiSubjectDynamicsEstimator::close()
+{
+    if (!pImpl->isOpen) {
+        return true;
+    }
+
+    pImpl->threadPool.reset();
+    pImpl->subjects.clear();
+    pImpl->subjectSucceeded.clear();
+    pImpl->isOpen = false;
+
+    return pImpl->setup.close();
+}
+
+bool MultiSubjectDynamicsEstimator::addSubject(hde::interfaces::IHumanState* iHumanState,
+                                               yarp::dev::IAnalogSensor* iAnalogSensor,
+                                               size_t& subjectIndex)
+{
+    if (!pImpl->isOpen) {
+        yError() << LogPrefix << "The multi subject estimator must be opened before adding subjects";
+        return false;
+    }
+
+    if (!iHumanState || !iAnalogSensor) {
+        yError() << LogPrefix << "Passed interfaces of the subject are nullptr";
+        return false;
+    }
+
+    if (iHumanState->getNumberOfJoints() != pImpl->setup.getNumberOfJoints()) {
+        yError() << LogPrefix << "The subject has" << iHumanState->getNumberOfJoints()
+                 << "joints but the shared model has" << pImpl->setup.getNumberOfJoints();
+        return false;
+    }
+
+    // The wrench channels are read in the order of 'wrench_sensors_link_name'
+    const size_t numberOfWrenchValues = pImpl->setup.pImpl->berdyData.buffers.wrenchValues.size();
+    if (iAnalogSensor->getChannels() < 0 || static_cast<size_t>(iAnalogSensor->getChannels()) != numberOfWrenchValues) {
+        yError() << LogPrefix << "The subject has" << iAnalogSensor->getChannels() << "wrench channels but"
+                 << numberOfWrenchValues << "are expected";
+        return false;
+    }
+
+    std::unique_ptr<Impl::Subject> subject(new Impl::Subject());
+    subject->iHumanState = iHumanState;
+    subject->iAnalogSensor = iAnalogSensor;
+
+    if (!initializeEstimationCore(pImpl->setup.pImpl->berdyData, subject->core)) {
+        yError() << LogPrefix << "Failed to initialize the estimation core of the subject";
+        return false;
+    }
+
+    subject->wrenchValues.resize(numberOfWrenchValues, 0.0);
+    subject->maskUpdates.resize(pImpl->setup.pImpl->berdyData.buffers.measurements.size());
+    subject->jointTorquesChannel.resize(subject->core.jointTorques.size());
+
+    subjectIndex = pImpl->subjects.size();
+    pImpl->subjects.push_back(std::move(subject));
+    pImpl->subjectSucceeded.resize(pImpl->subjects.size());
+
+    yInfo() << LogPrefix << "Added subject" << subjectIndex;
+    return true;
+}
+
+size_t MultiSubjectDynamicsEstimator::getNumberOfSubjects() const
+{
+    return pImpl->subjects.size();
+}
+
+bool MultiSubjectDynamicsEstimator::runTick()
+{
+    if (!pImpl->isOpen) {
+        return false;
+    }
+
+    pImpl->threadPool->parallelFor(pImpl->subjects.size(), [this](const size_t i) {
+        pImpl->subjectSucceeded[i] = pImpl->tick(*pImpl->subjects[i]);
+    });
+
+    return std::find(pImpl->subjectSucceeded.begin(), pImpl->subjectSucceeded.end(), false)
+           == pImpl->subjectSucceeded.end();
+}
+
+bool MultiSubjectDynamicsEstimator::setSensorActive(const size_t subjectIndex,
+                                                    const std::string& sensorType,
+                                                    const std::string& sensorId,
+                                                    const bool active)
+{
+    if (subjectIndex >= pImpl->subjects.size()) {
+        yError() << LogPrefix << "Subject" << subjectIndex << "not found";
+        return false;
+    }
+
+    iDynTree::IndexRange range;
+    if (!pImpl->setup.pImpl->findSensorRange(sensorType, sensorId, range)) {
+        return false;
+    }
+
+    HumanDynamicsEstimator::Impl::MaskUpdate update;
+    update.offset = static_cast<size_t>(range.offset);
+    update.size = static_cast<size_t>(range.size);
+    update.active = active;
+
+    return pImpl->subjects[subjectIndex]->maskUpdates.request(update);
+}
+
+std::vector<std::string> MultiSubjectDynamicsEstimator::getJointNames() const
+{
+    return pImpl->setup.getJointNames();
+}
+
+bool MultiSubjectDynamicsEstimator::getJointTorquesSnapshot(const size_t subjectIndex,
+                                                            JointTorquesSnapshot& snapshot) const
 {
-    std::vector<double> jointTorques;
-    std::lock_guard<std::mutex> lock(pImpl->mutex);
-    size_t vecSize = pImpl->berdyData.estimates.jointTorqueEstimates.size();
-    jointTorques.resize(vecSize);
-    for (size_t index = 0; index < vecSize; index++) {
-        jointTorques.at(index) = pImpl->berdyData.estimates.jointTorqueEstimates.getVal(index);
+    if (subjectIndex >= pImpl->subjects.size()) {
+        return false;
     }
-    return jointTorques;
+
+    const hde::utils::SeqLockChannel& channel = pImpl->subjects[subjectIndex]->jointTorquesChannel;
+    snapshot.torques.resize(channel.size());
+    snapshot.qualityTier = static_cast<unsigned>(QualityTier::Full);
+    snapshot.isStale = false;
+    return channel.read(snapshot.torques.data(), snapshot.sequence, snapshot.timestamp);
 }
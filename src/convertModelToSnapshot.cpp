@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+// Converts a URDF model to the binary snapshot loaded by HumanDynamicsEstimator through the
+// model_snapshot option, and by the tests when it is available.
+//
+// Usage: convertModelToSnapshot <model.urdf> <model.snapshot>
+//
+// A model not supported by the snapshot is reported and no snapshot is written. The
+// conversion fails, so that a build rule producing the snapshot fails as well, but the
+// model can still be loaded from the URDF.
+
+#include "ModelSnapshot.h"
+
+#include <iDynTree/ModelIO/ModelLoader.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <model.urdf> <model.snapshot>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::uint64_t sourceHash = 0;
+    if (!hde::utils::ModelSnapshot::hashFile(argv[1], sourceHash)) {
+        std::cerr << "Failed to read " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    iDynTree::ModelLoader modelLoader;
+    if (!modelLoader.loadModelFromFile(argv[1]) || !modelLoader.isValid()) {
+        std::cerr << "Failed to load the model " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string reason;
+    if (!hde::utils::ModelSnapshot::isSupported(modelLoader.model(), modelLoader.sensors(), reason)) {
+        std::cerr << "No snapshot written for " << argv[1] << ", " << reason << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!hde::utils::ModelSnapshot::write(argv[2], sourceHash, modelLoader.model(), modelLoader.sensors())) {
+        std::cerr << "Failed to write the snapshot " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -14,6 +14,11 @@
 #include <iDynTree/Sensors/PredictSensorsMeasurements.h>
 
 #include "testModels.h"
+#include "FactorizedMAPSolver.h"
+#include "KinematicTreeOrdering.h"
+#include "ModelSnapshot.h"
+#include "OrderingSelection.h"
+#include "berdyUnitTest.h"
 #include <iDynTree/Core/EigenHelpers.h>
 #include <iDynTree/Core/EigenSparseHelpers.h>
 #include <iDynTree/Core/TestUtils.h>
@@ -22,70 +27,28 @@
 
 #include <iDynTree/Model/ForwardKinematics.h>
 #include <iDynTree/Model/Dynamics.h>
+#include <iDynTree/Model/Traversal.h>
 #include <iDynTree/Estimation/BerdySparseMAPSolver.h>
+#include <iDynTree/ModelIO/ModelLoader.h>
 
+#include <yarp/os/Property.h>
 
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace iDynTree;
 
-
-struct BerdyData
-{
-    std::unique_ptr<iDynTree::BerdySparseMAPSolver> solver = nullptr;
-    iDynTree::BerdyHelper helper;
-
-    struct Priors
-    {
-        // Regularization priors
-        iDynTree::VectorDynSize dynamicsRegularizationExpectedValueVector; // mu_d
-        iDynTree::SparseMatrix<iDynTree::ColumnMajor> dynamicsRegularizationCovarianceMatrix; // sigma_d
-
-        // Dynamic constraint prior
-        iDynTree::SparseMatrix<iDynTree::ColumnMajor> dynamicsConstraintsCovarianceMatrix; // sigma_D
-
-        // Measurements prior
-        iDynTree::SparseMatrix<iDynTree::ColumnMajor> measurementsCovarianceMatrix; // sigma_y
-
-        static void
-        initializeSparseMatrixSize(size_t size,
-                                   iDynTree::SparseMatrix<iDynTree::ColumnMajor>& matrix)
-        {
-            iDynTree::Triplets identityTriplets;
-            identityTriplets.reserve(size);
-
-            // Set triplets to Identity
-            identityTriplets.setDiagonalMatrix(0, 0, 1.0, size);
-
-            matrix.resize(size, size);
-            matrix.setFromTriplets(identityTriplets);
-        }
-    } priors;
-
-    struct Buffers
-    {
-        iDynTree::VectorDynSize measurements;
-
-    } buffers;
-
-    struct KinematicState
-    {
-        iDynTree::FrameIndex floatingBaseFrameIndex;
-
-        iDynTree::Vector3 baseAngularVelocity;
-        iDynTree::JointPosDoubleArray jointsPosition;
-        iDynTree::JointDOFsDoubleArray jointsVelocity;
-        iDynTree::JointDOFsDoubleArray jointsAcceleration;
-    } state;
-
-    struct DynamicEstimates
-    {
-        iDynTree::JointDOFsDoubleArray jointTorqueEstimates;
-    } estimates;
-};
-
-
 void testBerdySensorMatrices(BerdyHelper & berdy, std::string filename)
 {
     // Check the concistency of the sensor matrices
@@ -362,17 +325,581 @@ void testBerdyOriginalFixedBase(BerdyHelper & berdy, std::string filename)
     testBerdyOriginalFixedBaseDynamicEquationSerialization(berdy);
 }
 
-void testBerdyHelpers(std::string fileName)
+bool loadTestModel(std::string fileName, std::string snapshotFileName, ExtWrenchesAndJointTorquesEstimator& estimator)
+{
+    // The snapshots of the test models are generated at build time and skip the URDF parsing
+    std::uint64_t sourceHash = 0;
+    Model snapshotModel;
+    SensorsList snapshotSensors;
+    ASSERT_IS_TRUE(hde::utils::ModelSnapshot::hashFile(fileName, sourceHash));
+    ASSERT_IS_TRUE(hde::utils::ModelSnapshot::read(snapshotFileName, sourceHash, snapshotModel, snapshotSensors));
+    return estimator.setModelAndSensors(snapshotModel, snapshotSensors);
+}
+
+/*
+ * The model and the sensors read from the snapshot must be the ones loaded from the URDF.
+ */
+void testModelSnapshot(std::string fileName, std::string snapshotFileName)
+{
+    ModelLoader loader;
+    ASSERT_IS_TRUE(loader.loadModelFromFile(fileName) && loader.isValid());
+    const Model& model = loader.model();
+    const SensorsList& sensors = loader.sensors();
+
+    std::uint64_t sourceHash = 0;
+    Model snapshotModel;
+    SensorsList snapshotSensors;
+    ASSERT_IS_TRUE(hde::utils::ModelSnapshot::hashFile(fileName, sourceHash));
+    ASSERT_IS_TRUE(hde::utils::ModelSnapshot::read(snapshotFileName, sourceHash, snapshotModel, snapshotSensors));
+    ASSERT_IS_TRUE(!hde::utils::ModelSnapshot::read(snapshotFileName, sourceHash + 1, snapshotModel, snapshotSensors));
+    ASSERT_IS_TRUE(hde::utils::ModelSnapshot::read(snapshotFileName, sourceHash, snapshotModel, snapshotSensors));
+
+    ASSERT_IS_TRUE(snapshotModel.getNrOfLinks() == model.getNrOfLinks());
+    for (LinkIndex link = 0; link < static_cast<LinkIndex>(model.getNrOfLinks()); ++link) {
+        ASSERT_IS_TRUE(snapshotModel.getLinkName(link) == model.getLinkName(link));
+        ASSERT_EQUAL_MATRIX(snapshotModel.getLink(link)->getInertia().asMatrix(),
+                            model.getLink(link)->getInertia().asMatrix());
+    }
+
+    ASSERT_IS_TRUE(snapshotModel.getNrOfJoints() == model.getNrOfJoints());
+    ASSERT_IS_TRUE(snapshotModel.getNrOfDOFs() == model.getNrOfDOFs());
+    for (JointIndex joint = 0; joint < static_cast<JointIndex>(model.getNrOfJoints()); ++joint) {
+        IJointConstPtr expected = model.getJoint(joint);
+        IJointConstPtr actual = snapshotModel.getJoint(joint);
+        ASSERT_IS_TRUE(snapshotModel.getJointName(joint) == model.getJointName(joint));
+        ASSERT_IS_TRUE(actual->getNrOfDOFs() == expected->getNrOfDOFs());
+        ASSERT_IS_TRUE(actual->getFirstAttachedLink() == expected->getFirstAttachedLink());
+        ASSERT_IS_TRUE(actual->getSecondAttachedLink() == expected->getSecondAttachedLink());
+        ASSERT_EQUAL_TRANSFORM(
+            actual->getRestTransform(actual->getFirstAttachedLink(), actual->getSecondAttachedLink()),
+            expected->getRestTransform(expected->getFirstAttachedLink(), expected->getSecondAttachedLink()));
+    }
+
+    ASSERT_IS_TRUE(snapshotModel.getNrOfFrames() == model.getNrOfFrames());
+    for (FrameIndex frame = model.getNrOfLinks(); frame < static_cast<FrameIndex>(model.getNrOfFrames()); ++frame) {
+        ASSERT_IS_TRUE(snapshotModel.getFrameName(frame) == model.getFrameName(frame));
+        ASSERT_IS_TRUE(snapshotModel.getFrameLink(frame) == model.getFrameLink(frame));
+        ASSERT_EQUAL_TRANSFORM(snapshotModel.getFrameTransform(frame), model.getFrameTransform(frame));
+    }
+    ASSERT_IS_TRUE(snapshotModel.getDefaultBaseLink() == model.getDefaultBaseLink());
+
+    for (int type = 0; type < NR_OF_SENSOR_TYPES; ++type) {
+        const SensorType sensorType = static_cast<SensorType>(type);
+        ASSERT_IS_TRUE(snapshotSensors.getNrOfSensors(sensorType) == sensors.getNrOfSensors(sensorType));
+        for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(sensors.getNrOfSensors(sensorType)); ++i) {
+            ASSERT_IS_TRUE(snapshotSensors.getSensor(sensorType, i)->getSensorType() == sensorType);
+            ASSERT_IS_TRUE(snapshotSensors.getSensor(sensorType, i)->getName()
+                           == sensors.getSensor(sensorType, i)->getName());
+        }
+    }
+    ASSERT_IS_TRUE(snapshotSensors.isConsistent(snapshotModel));
+}
+
+std::string temporaryFilePath(const std::string& fileName)
+{
+    const char* temporaryDirectory = std::getenv("TMPDIR");
+    return std::string(temporaryDirectory ? temporaryDirectory : "/tmp") + "/" + fileName;
+}
+
+std::string readFile(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+    std::ostringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+// Time, two joint positions and velocities, base angular velocity and the wrench of link1 of
+// threeLinks.urdf
+bool writeRecordedTrajectory(const std::string& fileName, const size_t numberOfSamples)
+{
+    std::ofstream input(fileName);
+    input.precision(std::numeric_limits<double>::max_digits10);
+    for (size_t sample = 0; sample < numberOfSamples; ++sample) {
+        const double time = 0.01 * sample;
+        input << time << " " << std::sin(time) << " " << std::cos(time) << " " << std::cos(time) << " "
+              << -std::sin(time) << " 0 0 " << 0.1 * std::sin(time);
+        for (size_t i = 0; i < 6; ++i) {
+            input << " " << std::sin(time + i);
+        }
+        input << "\n";
+    }
+    input.close();
+    return static_cast<bool>(input);
+}
+
+/*
+ * Batch estimation of a recorded trajectory spanning several blocks of samples, with one and
+ * with several threads: the output must be the same, also with the recursive estimation. A
+ * file with more columns than the model is rejected.
+ */
+void testBatchEstimationThreads(std::string fileName)
+{
+    const std::string inputFileName = temporaryFilePath("testBatchEstimation.input");
+    const std::string outputFileName = temporaryFilePath("testBatchEstimation.output");
+    const std::string extraColumnFileName = temporaryFilePath("testBatchEstimation.extra");
+
+    ASSERT_IS_TRUE(writeRecordedTrajectory(inputFileName, 3000));
+
+    std::ofstream extraColumn(extraColumnFileName);
+    extraColumn << "0 0 0 0 0 0 0 0 0 0 0 0 0 0\n0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n";
+    extraColumn.close();
+    ASSERT_IS_TRUE(static_cast<bool>(extraColumn));
+
+    const std::string config = "(urdf \"" + fileName + "\") (baseLink link1) (number_of_wrench_sensors 1)"
+                               " (wrench_sensors_link_name (link1)) (warm_up none)"
+                               " (PRIORS (mu_dyn_variables 0.0) (cov_dyn_variables 1.0e+4)"
+                               " (cov_dyn_constraints 1.0e-4) (cov_measurements_NET_EXT_WRENCH_SENSOR 1.0)"
+                               " (cov_measurements_DOF_ACCELERATION_SENSOR 1.0))";
+
+    for (const std::string& recursiveGroup : {std::string(), std::string(" (RECURSIVE (forgetting_factor 0.5))")}) {
+        yarp::os::Property property;
+        property.fromString(config + recursiveGroup);
+
+        hde::modules::HumanDynamicsEstimator estimator;
+        bool ok = estimator.open(property);
+        ASSERT_IS_TRUE(ok);
+
+        // The joint torques variances are compiled in their own startup phase
+        const std::string report = estimator.getStartupReport();
+        ASSERT_IS_TRUE(report.find("{\"name\": \"joint_torques_variances\"") != std::string::npos);
+
+        // Three threads split the blocks in non-contiguous chunks
+        std::vector<std::string> outputs;
+        for (const size_t threads : {1, 3}) {
+            ok = estimator.runBatchEstimation(inputFileName, outputFileName, threads);
+            ASSERT_IS_TRUE(ok);
+            outputs.push_back(readFile(outputFileName));
+        }
+        ASSERT_IS_TRUE(!estimator.runBatchEstimation(extraColumnFileName, outputFileName, 1));
+        estimator.close();
+
+        ASSERT_IS_TRUE(!outputs.front().empty());
+        ASSERT_IS_TRUE(outputs.front() == outputs.back());
+    }
+
+    std::remove(inputFileName.c_str());
+    std::remove(outputFileName.c_str());
+    std::remove(extraColumnFileName.c_str());
+}
+
+/*
+ * The priors written to the cache by a first run and loaded by the next ones give the estimates
+ * of the parsed priors. A truncated cache is a cache miss: the priors are parsed again.
+ */
+void testPriorsCacheEstimates(std::string fileName)
+{
+    const std::string inputFileName = temporaryFilePath("testPriorsCache.input");
+    const std::string outputFileName = temporaryFilePath("testPriorsCache.output");
+    const std::string cacheFileName = temporaryFilePath("testPriorsCache.priors");
+    std::remove(cacheFileName.c_str());
+    ASSERT_IS_TRUE(writeRecordedTrajectory(inputFileName, 100));
+
+    const std::string config = "(urdf \"" + fileName + "\") (baseLink link1) (number_of_wrench_sensors 1)"
+                               " (wrench_sensors_link_name (link1)) (warm_up none)"
+                               " (PRIORS (mu_dyn_variables 0.0) (cov_dyn_variables 1.0e+4)"
+                               " (cov_dyn_constraints 1.0e-4) (cov_measurements_NET_EXT_WRENCH_SENSOR 1.0)"
+                               " (cov_measurements_DOF_ACCELERATION_SENSOR 1.0))";
+
+    auto estimate = [&](const std::string& cacheGroup) {
+        yarp::os::Property property;
+        property.fromString(config + cacheGroup);
+
+        hde::modules::HumanDynamicsEstimator estimator;
+        bool ok = estimator.open(property) && estimator.runBatchEstimation(inputFileName, outputFileName, 1);
+        ASSERT_IS_TRUE(ok);
+        estimator.close();
+        return readFile(outputFileName);
+    };
+
+    const std::string parsed = estimate("");
+    const std::string cacheGroup = " (priors_cache \"" + cacheFileName + "\")";
+    ASSERT_IS_TRUE(!parsed.empty());
+    ASSERT_IS_TRUE(estimate(cacheGroup) == parsed);
+    const std::string cache = readFile(cacheFileName);
+    ASSERT_IS_TRUE(!cache.empty());
+    ASSERT_IS_TRUE(estimate(cacheGroup) == parsed);
+
+    std::ofstream truncated(cacheFileName, std::ios::binary | std::ios::trunc);
+    truncated.write(cache.data(), static_cast<std::streamsize>(cache.size() / 2));
+    truncated.close();
+    ASSERT_IS_TRUE(estimate(cacheGroup) == parsed);
+    ASSERT_IS_TRUE(readFile(cacheFileName) == cache);
+
+    std::remove(inputFileName.c_str());
+    std::remove(outputFileName.c_str());
+    std::remove(cacheFileName.c_str());
+}
+
+// Joint torques published by run() for every sample of the recorded file
+std::vector<std::vector<double>> estimateOnline(const std::string& config,
+                                                const std::string& inputFileName,
+                                                const size_t numberOfTicks,
+                                                std::vector<unsigned>& qualityTiers)
+{
+    yarp::os::Property property;
+    property.fromString(config);
+
+    hde::modules::HumanDynamicsEstimator estimator;
+    bool ok = estimator.open(property) && estimator.replayRecordedInputs(inputFileName);
+    ASSERT_IS_TRUE(ok);
+
+    std::vector<std::vector<double>> torques;
+    qualityTiers.clear();
+    hde::modules::HumanDynamicsEstimator::JointTorquesSnapshot snapshot;
+
+    for (size_t tick = 0; tick < numberOfTicks; ++tick) {
+        const std::uint64_t lastSequence = snapshot.sequence;
+        estimator.run();
+
+        // In pipelined mode the estimate is published by the solver stage
+        const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!(estimator.getJointTorquesSnapshot(snapshot) && snapshot.sequence > lastSequence)) {
+            ASSERT_IS_TRUE(std::chrono::steady_clock::now() < timeout);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        torques.push_back(snapshot.torques);
+        qualityTiers.push_back(snapshot.qualityTier);
+    }
+
+    estimator.close();
+    return torques;
+}
+
+bool isSameEstimate(const std::vector<double>& first, const std::vector<double>& second)
+{
+    if (first.size() != second.size()) {
+        return false;
+    }
+
+    const Eigen::Map<const Eigen::VectorXd> firstVector(first.data(), first.size());
+    const Eigen::Map<const Eigen::VectorXd> secondVector(second.data(), second.size());
+    return (firstVector - secondVector).norm() <= 1e-10 * (1.0 + secondVector.norm());
+}
+
+/*
+ * The estimates published by the pipelined loop and by the deadline-aware one, with a budget
+ * that is never exceeded, are the ones of the sequential loop. When the deadline degrades the
+ * estimation of a constant input, the degraded tiers publish the estimate of the full one.
+ */
+void testOnlineEstimationModes(std::string fileName)
+{
+    const std::string inputFileName = temporaryFilePath("testOnlineEstimation.input");
+    const std::string constantFileName = temporaryFilePath("testOnlineEstimation.constant");
+    const size_t numberOfTicks = 50;
+    ASSERT_IS_TRUE(writeRecordedTrajectory(inputFileName, numberOfTicks));
+
+    const std::string config = "(urdf \"" + fileName + "\") (baseLink link1) (number_of_wrench_sensors 1)"
+                               " (wrench_sensors_link_name (link1)) (warm_up none)"
+                               " (PRIORS (mu_dyn_variables 0.0) (cov_dyn_variables 1.0e+4)"
+                               " (cov_dyn_constraints 1.0e-4) (cov_measurements_NET_EXT_WRENCH_SENSOR 1.0)"
+                               " (cov_measurements_DOF_ACCELERATION_SENSOR 1.0))";
+
+    std::vector<unsigned> qualityTiers;
+    const std::vector<std::vector<double>> sequential =
+        estimateOnline(config, inputFileName, numberOfTicks, qualityTiers);
+
+    for (const std::string& mode : {std::string(" (pipelined true)"), std::string(" (DEADLINE (budget 10.0))")}) {
+        const std::vector<std::vector<double>> estimates =
+            estimateOnline(config + mode, inputFileName, numberOfTicks, qualityTiers);
+        for (size_t tick = 0; tick < numberOfTicks; ++tick) {
+            ASSERT_IS_TRUE(qualityTiers[tick] == 0);
+            ASSERT_IS_TRUE(isSameEstimate(estimates[tick], sequential[tick]));
+        }
+    }
+
+    // The first sample repeated, every tick exceeds the budget and degrades the next one
+    std::ifstream input(inputFileName);
+    std::string firstLine;
+    ASSERT_IS_TRUE(static_cast<bool>(std::getline(input, firstLine)));
+    std::ofstream constant(constantFileName);
+    for (size_t tick = 0; tick < numberOfTicks; ++tick) {
+        constant << firstLine << "\n";
+    }
+    constant.close();
+    ASSERT_IS_TRUE(static_cast<bool>(constant));
+
+    const std::vector<std::vector<double>> degraded = estimateOnline(
+        config + " (DEADLINE (budget 1.0e-9) (overruns_to_degrade 1))", constantFileName, numberOfTicks, qualityTiers);
+    ASSERT_IS_TRUE(qualityTiers.front() == 0 && qualityTiers.back() > 0);
+    for (size_t tick = 0; tick < numberOfTicks; ++tick) {
+        ASSERT_IS_TRUE(isSameEstimate(degraded[tick], sequential.front()));
+    }
+
+    std::remove(inputFileName.c_str());
+    std::remove(constantFileName.c_str());
+}
+
+/*
+ * Solve the MAP problem of a random configuration with the generic solver (AMD ordering),
+ * with the kinematic tree backend and with the mixed precision solver. The tree backend must
+ * give the same estimate, the mixed precision one a normwise backward error within the
+ * refinement tolerance or comparable to the one of the double precision solver.
+ */
+void testMAPSolverBackends(std::string fileName, std::string snapshotFileName)
+{
+    using hde::estimation::FactorizedMAPSolver;
+
+    ExtWrenchesAndJointTorquesEstimator estimator;
+    bool ok = loadTestModel(fileName, snapshotFileName, estimator);
+    ASSERT_IS_TRUE(ok);
+
+    BerdyHelper berdy;
+    BerdyOptions options;
+    options.berdyVariant = iDynTree::BERDY_FLOATING_BASE;
+    options.includeAllNetExternalWrenchesAsDynamicVariables = true;
+    options.includeAllNetExternalWrenchesAsSensors = true;
+    options.includeAllJointTorquesAsSensors = true;
+
+    // Every link has at least its net external wrench sensor
+    ok = berdy.init(estimator.model(), estimator.sensors(), options);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE(berdy.getNrOfSensorsMeasurements() > 0);
+
+    FreeFloatingPos pos(berdy.model());
+    FreeFloatingVel vel(berdy.model());
+    FreeFloatingAcc generalizedProperAccs(berdy.model());
+    LinkNetExternalWrenches extWrenches(berdy.model());
+    getRandomInverseDynamicsInputs(pos,vel,generalizedProperAccs,extWrenches);
+
+    LinkIndex baseIdx = berdy.dynamicTraversal().getBaseLink()->getIndex();
+    berdy.updateKinematicsFromFloatingBase(pos.jointPos(),vel.jointVel(),baseIdx,vel.baseVel().getAngularVec3());
+
+    SparseMatrix<iDynTree::ColumnMajor> D, Y;
+    VectorDynSize bD, bY;
+    berdy.resizeAndZeroBerdyMatrices(D,bD,Y,bY);
+    ok = berdy.getBerdyMatrices(D,bD,Y,bY);
+    ASSERT_IS_TRUE(ok);
+
+    VectorDynSize y(berdy.getNrOfSensorsMeasurements());
+    getRandomVector(y, -1.0, 1.0);
+
+    // Same order of magnitude of the default priors of the device
+    const double dynamicsVariance = 1e4;
+    const double constraintsVariance = 1e-4;
+    const double measurementsVariance = 1e-2;
+
+    Eigen::VectorXd mu_d = Eigen::VectorXd::Zero(D.columns());
+    FactorizedMAPSolver::SparseMatrix sigma_d(D.columns(), D.columns());
+    FactorizedMAPSolver::SparseMatrix sigma_D(D.rows(), D.rows());
+    FactorizedMAPSolver::SparseMatrix sigma_y(Y.rows(), Y.rows());
+    sigma_d.setIdentity();
+    sigma_d *= dynamicsVariance;
+    sigma_D.setIdentity();
+    sigma_D *= constraintsVariance;
+    sigma_y.setIdentity();
+    sigma_y *= measurementsVariance;
+
+    FactorizedMAPSolver::EliminationOrder treeOrder;
+    ok = hde::estimation::KinematicTreeOrdering::compute(berdy, treeOrder);
+    ASSERT_IS_TRUE(ok);
+
+    const double refinementTolerance = 1e-12;
+
+    FactorizedMAPSolver generic, tree, mixed;
+    for (FactorizedMAPSolver* solver : {&generic, &tree, &mixed}) {
+        ok = solver->setDynamicsRegularizationPrior(mu_d, sigma_d)
+             && solver->setDynamicsConstraintsPriorCovariance(sigma_D)
+             && solver->setMeasurementsPriorCovariance(sigma_y);
+        ASSERT_IS_TRUE(ok);
+    }
+    ok = tree.setEliminationOrder(treeOrder);
+    ASSERT_IS_TRUE(ok);
+    ok = mixed.setMixedPrecision(true, refinementTolerance);
+    ASSERT_IS_TRUE(ok);
+
+    for (FactorizedMAPSolver* solver : {&generic, &tree, &mixed}) {
+        ok = solver->doEstimate(toEigen(D), toEigen(bD), toEigen(Y), toEigen(bY), toEigen(y));
+        ASSERT_IS_TRUE(ok);
+    }
+
+    std::cout << "MAP solver backends for model " << fileName << ": nnz(L) generic " << generic.factorNonZeros()
+              << ", kinematic tree " << tree.factorNonZeros() << std::endl;
+
+    const double difference = (tree.lastEstimate() - generic.lastEstimate()).norm();
+    ASSERT_IS_TRUE(difference <= 1e-9 * (1.0 + generic.lastEstimate().norm()));
+
+    // With the tree order the columns of a link group have nonzeros only in the groups of the
+    // link, of its parent, of its siblings and in the unmapped group, then nnz(L) is linear in
+    // the number of links of a tree with bounded branching
+    std::vector<hde::estimation::KinematicTreeOrdering::StorageIndex> groups;
+    ok = hde::estimation::KinematicTreeOrdering::computeLinkGroups(berdy, groups);
+    ASSERT_IS_TRUE(ok);
+
+    const Traversal& traversal = berdy.dynamicTraversal();
+    const size_t nrOfVisitedLinks = traversal.getNrOfVisitedLinks();
+    std::vector<double> groupSizes(nrOfVisitedLinks + 1, 0);
+    for (const auto group : groups) {
+        ++groupSizes[group];
+    }
+
+    std::vector<size_t> traversalIndices(berdy.model().getNrOfLinks(), 0);
+    std::vector<double> childrenSizes(nrOfVisitedLinks, 0);
+    for (size_t traversalIndex = 0; traversalIndex < nrOfVisitedLinks; ++traversalIndex) {
+        traversalIndices[traversal.getLink(traversalIndex)->getIndex()] = traversalIndex;
+        if (traversal.getParentLink(traversalIndex)) {
+            // The parents precede their children in the traversal
+            childrenSizes[traversalIndices[traversal.getParentLink(traversalIndex)->getIndex()]] +=
+                groupSizes[traversalIndex];
+        }
+    }
+
+    const double unmappedSize = groupSizes[nrOfVisitedLinks];
+    double treeFillBound = unmappedSize * unmappedSize;
+    for (size_t traversalIndex = 0; traversalIndex < nrOfVisitedLinks; ++traversalIndex) {
+        const double size = groupSizes[traversalIndex];
+        const LinkConstPtr parent = traversal.getParentLink(traversalIndex);
+        if (!parent) {
+            treeFillBound += size * (size + unmappedSize);
+            continue;
+        }
+        const size_t parentIndex = traversalIndices[parent->getIndex()];
+        // The siblings and the link itself are the children of the parent
+        treeFillBound += size * (groupSizes[parentIndex] + childrenSizes[parentIndex] + unmappedSize);
+    }
+    ASSERT_IS_TRUE(tree.factorNonZeros() <= treeFillBound);
+
+    // Parallel factorization: same estimate for every number of threads, its timing is measured
+    // by benchmarkParallelFactorization
+    const size_t maxThreads = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        FactorizedMAPSolver parallel;
+        ok = parallel.setDynamicsRegularizationPrior(mu_d, sigma_d)
+             && parallel.setDynamicsConstraintsPriorCovariance(sigma_D)
+             && parallel.setMeasurementsPriorCovariance(sigma_y) && parallel.setNumberOfThreads(threads)
+             && parallel.doEstimate(toEigen(D), toEigen(bD), toEigen(Y), toEigen(bY), toEigen(y));
+        ASSERT_IS_TRUE(ok);
+        ASSERT_IS_TRUE((parallel.lastEstimate() - generic.lastEstimate()).norm()
+                       <= 1e-9 * (1.0 + generic.lastEstimate().norm()));
+    }
+
+    // Normal equations P * d = r of the MAP problem in double precision, mu_d is zero
+    const FactorizedMAPSolver::SparseMatrix Dm = toEigen(D);
+    const FactorizedMAPSolver::SparseMatrix Ym = toEigen(Y);
+    FactorizedMAPSolver::SparseMatrix P(D.columns(), D.columns());
+    P.setIdentity();
+    P /= dynamicsVariance;
+    P += FactorizedMAPSolver::SparseMatrix(Dm.transpose() * Dm) / constraintsVariance;
+    P += FactorizedMAPSolver::SparseMatrix(Ym.transpose() * Ym) / measurementsVariance;
+    const Eigen::VectorXd r = -Dm.transpose() * toEigen(bD) / constraintsVariance
+                              + Ym.transpose() * (toEigen(y) - toEigen(bY)) / measurementsVariance;
+
+    const auto backwardError = [&](const Eigen::VectorXd& estimate) {
+        return (r - P * estimate).norm() / (P.norm() * estimate.norm());
+    };
+
+    std::cout << "MAP solver precision for model " << fileName << ": backward error double "
+              << backwardError(generic.lastEstimate()) << ", mixed " << backwardError(mixed.lastEstimate()) << " after "
+              << mixed.numberOfRefinementSteps() << " refinement steps and "
+              << mixed.numberOfDoublePrecisionFallbacks() << " fallbacks" << std::endl;
+
+    ASSERT_IS_TRUE(backwardError(mixed.lastEstimate())
+                   <= std::max(refinementTolerance, 10 * backwardError(generic.lastEstimate())));
+
+    // Posterior variances and covariances by selected inversion against the columns of the
+    // explicit P^-1. The covariances are taken at the nonzeros of P below the diagonal of a few
+    // columns, and compared relative to their bound sqrt(var_i * var_j).
+    const Eigen::SimplicialLDLT<FactorizedMAPSolver::SparseMatrix> reference(P);
+    ASSERT_IS_TRUE(reference.info() == Eigen::Success);
+
+    const Eigen::Index lastVariable = D.columns() - 1;
+    std::vector<FactorizedMAPSolver::VariablesPair> entries = {
+        {0, 0}, {lastVariable / 2, lastVariable / 2}, {lastVariable, lastVariable}};
+    for (const Eigen::Index column : {Eigen::Index(0), lastVariable / 3, lastVariable / 2, 2 * lastVariable / 3}) {
+        for (FactorizedMAPSolver::SparseMatrix::InnerIterator it(P, column); it; ++it) {
+            if (it.row() > column) {
+                entries.emplace_back(it.row(), column);
+            }
+        }
+    }
+    ASSERT_IS_TRUE(entries.size() > 3);
+
+    Eigen::MatrixXd columns(D.columns(), entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        columns.col(i) = reference.solve(Eigen::VectorXd::Unit(D.columns(), entries[i].second));
+    }
+
+    for (FactorizedMAPSolver* solver : {&generic, &tree}) {
+        Eigen::VectorXd values;
+        ok = solver->computePosteriorCovariance(entries, values);
+        ASSERT_IS_TRUE(ok);
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const Eigen::Index first = entries[i].first;
+            const Eigen::Index second = entries[i].second;
+            const double bound = std::sqrt(reference.solve(Eigen::VectorXd::Unit(D.columns(), first))[first]
+                                           * columns(second, i));
+            ASSERT_IS_TRUE(std::abs(values[i] - columns(first, i)) <= 1e-9 * bound);
+        }
+    }
+
+    // Fill and flops of the factorization of P for every candidate elimination order
+    using hde::estimation::OrderingSelection;
+    FactorizedMAPSolver::SparseMatrix precision;
+    ok = generic.computePrecision(Dm, Ym, precision);
+    ASSERT_IS_TRUE(ok);
+
+    std::vector<OrderingSelection::Candidate> candidates;
+    ok = OrderingSelection::computeCandidates(precision, Dm, Ym, &berdy, candidates);
+    ASSERT_IS_TRUE(ok);
+    const OrderingSelection::Candidate& best = candidates[OrderingSelection::selectBest(candidates)];
+
+    // The symbolic factorization of every candidate has the nonzeros of the factorization of the
+    // permuted P in the natural order
+    using NaturalLDLT = Eigen::SimplicialLDLT<FactorizedMAPSolver::SparseMatrix,
+                                              Eigen::Lower,
+                                              Eigen::NaturalOrdering<FactorizedMAPSolver::SparseMatrix::StorageIndex>>;
+    std::cout << "Elimination orders for model " << fileName << ":";
+    for (const OrderingSelection::Candidate& candidate : candidates) {
+        std::cout << " " << candidate.method << " nnz(L) " << candidate.factorNonZeros << " flops " << candidate.flops
+                  << ",";
+
+        FactorizedMAPSolver::Permutation inversePermutation(D.columns());
+        std::copy(candidate.order.begin(), candidate.order.end(), inversePermutation.indices().data());
+        FactorizedMAPSolver::SparseMatrix permuted(D.columns(), D.columns());
+        permuted.selfadjointView<Eigen::Lower>() =
+            precision.selfadjointView<Eigen::Lower>().twistedBy(inversePermutation.inverse());
+
+        NaturalLDLT natural;
+        natural.analyzePattern(permuted);
+        natural.factorize(permuted);
+        ASSERT_IS_TRUE(natural.info() == Eigen::Success);
+        ASSERT_IS_TRUE(candidate.factorNonZeros == natural.matrixL().nestedExpression().nonZeros());
+    }
+    std::cout << " selected " << best.method << std::endl;
+
+    // The selected order survives the cache and is discarded for another pattern
+    const std::string cacheFileName = temporaryFilePath("testOrderingSelection.ordering");
+    const std::uint64_t key = OrderingSelection::patternKey(precision);
+    OrderingSelection::Candidate cached;
+    ok = OrderingSelection::writeCache(cacheFileName, key, best)
+         && OrderingSelection::readCache(cacheFileName, key, cached);
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE(cached.method == best.method && cached.order == best.order);
+    OrderingSelection::Candidate otherPattern;
+    ASSERT_IS_TRUE(!OrderingSelection::readCache(cacheFileName, key + 1, otherPattern));
+    std::remove(cacheFileName.c_str());
+
+    // The auto backend estimates with the cached order, as the generic one
+    FactorizedMAPSolver selected;
+    ok = selected.setDynamicsRegularizationPrior(mu_d, sigma_d)
+         && selected.setDynamicsConstraintsPriorCovariance(sigma_D)
+         && selected.setMeasurementsPriorCovariance(sigma_y) && selected.setEliminationOrder(cached.order)
+         && selected.doEstimate(toEigen(D), toEigen(bD), toEigen(Y), toEigen(bY), toEigen(y));
+    ASSERT_IS_TRUE(ok);
+    ASSERT_IS_TRUE(selected.factorNonZeros() == best.factorNonZeros);
+    ASSERT_IS_TRUE((selected.lastEstimate() - generic.lastEstimate()).norm()
+                   <= 1e-9 * (1.0 + generic.lastEstimate().norm()));
+}
+
+void testBerdyHelpers(std::string fileName, std::string snapshotFileName)
 {
     // \todo TODO simplify model loading (now we rely on teh ExtWrenchesAndJointTorquesEstimator
     ExtWrenchesAndJointTorquesEstimator estimator;
-    bool ok = estimator.loadModelAndSensorsFromFile(fileName);
+    bool ok = loadTestModel(fileName, snapshotFileName, estimator);
 
     ASSERT_IS_TRUE(estimator.sensors().isConsistent(estimator.model()));
     ASSERT_IS_TRUE(ok);
-    class Impl;
-    std::unique_ptr<Impl> pImpl;
-//    pImpl{new Impl()};
 
     BerdyHelper berdyHelper;
 
@@ -418,12 +945,6 @@ void testBerdyHelpers(std::string fileName)
     berdyOptions.includeAllJointTorquesAsSensors = false;
     berdyOptions.includeFixedBaseExternalWrench = false;
 
-    // Initialize the BerdyHelper
-    if (!pImpl->berdyData.helper.init(modelLoader.model(), humanSensors, berdyOptions)) {
-        yError() << LogPrefix << "Failed to initialize BERDY";
-        return false;
-    }
-
     // Check berdy options
     if (!berdyOptions.checkConsistency()) {
         std::cout<< "BERDY options are not consistent";
@@ -452,55 +973,23 @@ void testBerdyHelpers(std::string fileName)
 
 int main()
 {
+    testBatchEstimationThreads(getAbsModelPath("threeLinks.urdf"));
+    testPriorsCacheEstimates(getAbsModelPath("threeLinks.urdf"));
+    testOnlineEstimationModes(getAbsModelPath("threeLinks.urdf"));
+
     for(unsigned int mdl = 0; mdl < 1; mdl++ )
     {
         std::string urdfFileName = getAbsModelPath(std::string(IDYNTREE_TESTS_URDFS[mdl]));
         std::cout << "BerdyHelperUnitTest, testing file " << std::string(IDYNTREE_TESTS_URDFS[mdl]) <<  std::endl;
-        testBerdyHelpers(urdfFileName);
+        testBerdyHelpers(urdfFileName, getAbsSnapshotPath(std::string(IDYNTREE_TESTS_URDFS[mdl])));
     }
 
-    return EXIT_SUCCESS;
-}
-
-class Impl
-{
-public:
-    Impl()
+    for(unsigned int mdl = 0; mdl < IDYNTREE_TESTS_URDFS_NR; mdl++ )
     {
-        gravity.zero();
-        gravity(2) = -9.81;
+        std::string urdfFileName = getAbsModelPath(std::string(IDYNTREE_TESTS_URDFS[mdl]));
+        testModelSnapshot(urdfFileName, getAbsSnapshotPath(std::string(IDYNTREE_TESTS_URDFS[mdl])));
+        testMAPSolverBackends(urdfFileName, getAbsSnapshotPath(std::string(IDYNTREE_TESTS_URDFS[mdl])));
     }
 
-    // Attached interfaces
-    hde::interfaces::IHumanState* iHumanState = nullptr;
-    hde::interfaces::IHumanWrench* iHumanWrench = nullptr;
-    yarp::dev::IAnalogSensor* iAnalogSensor = nullptr;
-
-    mutable std::mutex mutex;
-    iDynTree::Vector3 gravity;
-
-    const std::unordered_map<iDynTree::BerdySensorTypes, std::string> mapBerdySensorType = {
-        {iDynTree::BerdySensorTypes::SIX_AXIS_FORCE_TORQUE_SENSOR, "SIX_AXIS_FORCE_TORQUE_SENSOR"},
-        {iDynTree::BerdySensorTypes::ACCELEROMETER_SENSOR, "ACCELEROMETER_SENSOR"},
-        {iDynTree::BerdySensorTypes::GYROSCOPE_SENSOR, "GYROSCOPE_SENSOR"},
-        {iDynTree::BerdySensorTypes::THREE_AXIS_ANGULAR_ACCELEROMETER_SENSOR,
-         "THREE_AXIS_ANGULAR_ACCELEROMETER_SENSOR"},
-        {iDynTree::BerdySensorTypes::THREE_AXIS_FORCE_TORQUE_CONTACT_SENSOR,
-         "THREE_AXIS_FORCE_TORQUE_CONTACT_SENSOR"},
-        {iDynTree::BerdySensorTypes::DOF_ACCELERATION_SENSOR, "DOF_ACCELERATION_SENSOR"},
-        {iDynTree::BerdySensorTypes::DOF_TORQUE_SENSOR, "DOF_TORQUE_SENSOR"},
-        {iDynTree::BerdySensorTypes::NET_EXT_WRENCH_SENSOR, "NET_EXT_WRENCH_SENSOR"},
-        {iDynTree::BerdySensorTypes::JOINT_WRENCH_SENSOR, "JOINT_WRENCH_SENSOR"}};
-
-    // Berdy sensors map
-    SensorMapIndex sensorMapIndex;
-
-    // Berdy variable
-    BerdyData berdyData;
-
-    // Model variables
-    iDynTree::Model humanModel;
-
-    // Wrench sensor link names variable
-    std::vector<std::string> wrenchSensorsLinkNames;
-};
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 Istituto Italiano di Tecnologia (IIT)
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the
+ * GNU Lesser General Public License v2.1 or any later version.
+ */
+
+// Profiles HumanDynamicsEstimator::open() for one or more configuration files, without
+// connecting to a YARP network, and prints a JSON array with the startup report of each.
+// The configurations failing to open have no report.
+//
+// Usage: profileStartup <config.ini> [<config.ini> ...]
+//
+// The peak RSS is the high-water mark of this process, then it accumulates across the
+// configurations. Run one configuration per process to compare the models.
+
+#include "berdyUnitTest.h"
+#include "StartupProfiler.h"
+
+#include <yarp/os/Property.h>
+
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <config.ini> [<config.ini> ...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool allOpened = true;
+    std::cout << "[";
+
+    for (int i = 1; i < argc; ++i) {
+        yarp::os::Property config;
+        if (!config.fromConfigFile(argv[i])) {
+            std::cerr << "Failed to read the configuration file " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        hde::modules::HumanDynamicsEstimator estimator;
+        const bool opened = estimator.open(config);
+        allOpened = allOpened && opened;
+
+        using hde::utils::StartupProfiler;
+        std::cout << (i == 1 ? "\n" : ",\n") << "{\"config\": " << StartupProfiler::toJSONString(argv[i])
+                  << ", \"urdf\": " << StartupProfiler::toJSONString(config.find("urdf").asString())
+                  << ", \"opened\": " << (opened ? "true" : "false");
+        if (opened) {
+            std::cout << ", \"report\": " << estimator.getStartupReport();
+        }
+        std::cout << "}";
+
+        estimator.close();
+    }
+
+    std::cout << "\n]" << std::endl;
+    return allOpened ? EXIT_SUCCESS : EXIT_FAILURE;
+}